@@ -1,18 +1,158 @@
+#include<errno.h>
+#include<stdlib.h>
+#include<algorithm>
 #include"buffer.h"
 
-//writePos_和readPos_之间的数据是待读取的
+thread_local Buffer::SlabPool Buffer::t_pool;
+
+//线程退出时释放空闲块，之后还回来的块直接释放
+Buffer::SlabPool::~SlabPool()
+{
+    while(head)
+    {
+        Slab* slab = head;
+        head = slab->next;
+        free(slab);
+    }
+    count = 0;
+    closed = true;
+}
+
+Buffer::Buffer()
+{
+    m_head = m_read = m_tail = nullptr;
+    m_readPos = 0;
+    m_readable = 0;
+    m_slabCount = 0;
+    m_bigCount = 0;
+}
+
+Buffer::~Buffer()
+{
+    releaseMemory();
+}
+
+//优先从本线程的空闲链表取，要的比块大时单独分配
+Buffer::Slab* Buffer::acquire(size_t capacity)
+{
+    Slab* slab;
+    if(capacity <= SLAB_SIZE && t_pool.head)
+    {
+        slab = t_pool.head;
+        t_pool.head = slab->next;
+        t_pool.count--;
+    }
+    else
+    {
+        capacity = std::max(capacity, SLAB_SIZE);
+        slab = static_cast<Slab*>(malloc(sizeof(Slab) + capacity));
+        if(!slab)
+            throw std::bad_alloc();
+        slab->capacity = capacity;
+    }
+    slab->next = nullptr;
+    slab->end = 0;
+    return slab;
+}
+
+void Buffer::release(Slab* slab)
+{
+    if(slab->capacity == SLAB_SIZE && !t_pool.closed && t_pool.count < MAX_POOLED)
+    {
+        slab->next = t_pool.head;
+        t_pool.head = slab;
+        t_pool.count++;
+    }
+    else
+    {
+        free(slab);
+    }
+}
+
+//接到链表末尾，没有未读数据时读位置也移到新块
+void Buffer::link(Slab* slab)
+{
+    if(m_tail)
+        m_tail->next = slab;
+    else
+        m_head = slab;
+    if(!m_read || m_readable == 0)
+    {
+        m_read = slab;
+        m_readPos = 0;
+    }
+    m_tail = slab;
+    m_slabCount++;
+    m_bigCount += slab->capacity > SLAB_SIZE;
+}
+
+//第一块后面的块全部还回去，都是普通块时整条接到空闲链表上
+void Buffer::releaseAfterHead()
+{
+    Slab* first = m_head->next;
+    if(!first)
+        return;
+    size_t count = m_slabCount - 1;
+    bool headBig = m_head->capacity > SLAB_SIZE;
+    if(m_bigCount == static_cast<size_t>(headBig) && !t_pool.closed && t_pool.count + count <= MAX_POOLED)
+    {
+        m_tail->next = t_pool.head;
+        t_pool.head = first;
+        t_pool.count += count;
+    }
+    else
+    {
+        while(first)
+        {
+            Slab* slab = first;
+            first = slab->next;
+            release(slab);
+        }
+    }
+    m_head->next = nullptr;
+    m_tail = m_read = m_head;
+    m_slabCount = 1;
+    m_bigCount = headBig;
+}
+
+//写入前回收读完的块：全部读完时只留第一块从头写，否则回收读位置前面的块
+void Buffer::reclaim()
+{
+    if(!m_head)
+        return;
+    if(m_readable == 0)
+    {
+        initPtr();
+        return;
+    }
+    releaseConsumed();
+}
+
+//回收读位置前面已经读完的块
+void Buffer::releaseConsumed()
+{
+    while(m_head != m_read)
+    {
+        Slab* slab = m_head;
+        m_head = slab->next;
+        m_slabCount--;
+        m_bigCount -= slab->capacity > SLAB_SIZE;
+        release(slab);
+    }
+}
+
+//所有块里没读的数据
 size_t Buffer::readableBytes() const
 {
-    return m_writePos - m_readPos;
+    return m_readable;
 }
 
-//writePos_后面剩下的空间是可写的
+//最后一块后面剩下的空间是可写的
 size_t Buffer::writeableBytes() const
 {
-    return m_buffer.size() - m_writePos;
+    return m_tail ? m_tail->capacity - m_tail->end : 0;
 }
 
-//已读取的字节数
 size_t Buffer::readBytes() const
 {
     return m_readPos;
@@ -20,84 +160,114 @@ size_t Buffer::readBytes() const
 
 const char* Buffer::curReadPtr() const
 {
-    return BeginPtr() + m_readPos;
+    return m_read ? m_read->data() + m_readPos : nullptr;
 }
 
 const char* Buffer::curWritePtrConst() const
 {
-    return BeginPtr() + m_writePos;
+    return m_tail ? m_tail->data() + m_tail->end : nullptr;
 }
 
 char* Buffer::curWritePtr()
 {
-    return BeginPtr() + m_writePos; 
+    if(!m_tail)
+        link(acquire(SLAB_SIZE));
+    return m_tail->data() + m_tail->end;
 }
 
-//读取了len的数据，指针后移len位
+//读取了len的数据，读完一块就移到下一块
 void Buffer::updateReadPtr(size_t len)
 {
     assert(len <= readableBytes());
+    if(!m_read)
+        return;
+    m_readable -= len;
     m_readPos += len;
+    while(m_readPos >= m_read->end && m_read->next)
+    {
+        m_readPos -= m_read->end;
+        m_read = m_read->next;
+    }
 }
 
-//读取所有数据
+//读到当前块里的end为止
 void Buffer::updateReadPtrUntilEnd(const char* end)
 {
     assert(end >= curReadPtr());
-    updateReadPtr(end - curReadPtr());    
+    updateReadPtr(end - curReadPtr());
 }
 
-//写入了len的数据
+//在最后一块写入了len的数据
 void Buffer::updateWritePtr(size_t len)
 {
     assert(len <= writeableBytes());
-    m_writePos += len;
+    if(len == 0)
+        return;
+    if(m_readable == 0)
+    {
+        m_read = m_tail;
+        m_readPos = m_tail->end;
+    }
+    m_tail->end += len;
+    m_readable += len;
 }
 
-//数组和指针都清零
+//只重置位置，多出来的块还回去，第一块是大块时也还回去，不留着占内存
 void Buffer::initPtr()
 {
-    bzero(&m_buffer[0], m_buffer.size());
+    if(!m_head)
+        return;
+    releaseAfterHead();
     m_readPos = 0;
-    m_writePos = 0;
+    m_readable = 0;
+    if(m_head->capacity > SLAB_SIZE)
+    {
+        release(m_head);
+        m_head = m_read = m_tail = nullptr;
+        m_slabCount = 0;
+        m_bigCount = 0;
+        return;
+    }
+    m_head->end = 0;
 }
 
-//分配len长度的空间
-void Buffer::allocateSpace(size_t len)
+void Buffer::releaseMemory()
 {
-    //空闲空间（write后面和read前面）若不足len，在数组后面扩张len
-    if(writeableBytes() + readBytes() < len)
-    {
-        m_buffer.resize(m_writePos + len + 1);
-    }
-    else
-    {
-        size_t readable = readableBytes();
-        //把read和write之间待读取的数据拷贝到数组前面(避免申请新空间),更新write和read指针
-        std::copy(BeginPtr() + m_readPos, BeginPtr() + m_writePos, BeginPtr());   
-        m_readPos = 0;
-        m_writePos = readable;
-        assert(readable == readableBytes());
-    }
+    initPtr();
+    if(!m_head)
+        return;
+    release(m_head);
+    m_head = m_read = m_tail = nullptr;
+    m_slabCount = 0;
+    m_bigCount = 0;
 }
 
-//利用allocateSpace确保有len的空间可用
+//最后一块放不下len字节时接上一块新的，不搬动已有数据
 void Buffer::ensureWriteable(size_t len)
 {
+    reclaim();
     if(writeableBytes() < len)
     {
-        allocateSpace(len);
+        link(acquire(len));
     }
     assert(writeableBytes() >= len);
-} 
+}
 
-//保证空间足够，然后在curWritePtr后面写入字符串
+//写满最后一块后接上新块继续写
 void Buffer::append(const char* str, size_t len)
 {
     assert(str != nullptr);
-    ensureWriteable(len);
-    std::copy(str, str + len, curWritePtr());
-    updateWritePtr(len);
+    reclaim();
+    while(len > 0)
+    {
+        if(writeableBytes() == 0)
+            link(acquire(SLAB_SIZE));
+        size_t n = std::min(len, writeableBytes());
+        memcpy(m_tail->data() + m_tail->end, str, n);
+        updateWritePtr(n);
+        str += n;
+        len -= n;
+    }
 }
 
 void Buffer::append(const std::string& str)
@@ -113,67 +283,150 @@ void Buffer::append(const void* data, size_t len)
 
 void Buffer::append(const Buffer& buf)
 {
-    append(buf.curReadPtr(), buf.readableBytes());
+    for(const Slab* slab = buf.m_read; slab && buf.m_readable > 0; slab = slab->next)
+    {
+        size_t begin = slab == buf.m_read ? buf.m_readPos : 0;
+        if(slab->end > begin)
+            append(slab->data() + begin, slab->end - begin);
+    }
 }
 
-//读取fd的数据放到缓冲区里，为了避免盲目扩张，设置一个暂存buf
+//跨块时拷到一块能放下全部数据的块里；超过半块时按两倍分配，之后readFd直接读进它的剩余空间，大的消息体不会反复拷贝
+//读位置所在的已经是大块时用realloc原地扩大，大块是mmap来的时扩大不用拷贝，只把后面块里的数据接上
+const char* Buffer::linearize()
+{
+    if(m_readable == 0 || m_read->end - m_readPos == m_readable)
+        return curReadPtr();
+    size_t readable = m_readable;
+    size_t capacity = readable > SLAB_SIZE / 2 ? readable * 2 : SLAB_SIZE;
+    Slab* slab;
+    Slab* rest;
+    if(m_read->capacity > SLAB_SIZE)
+    {
+        releaseConsumed();
+        rest = m_read->next;
+        memmove(m_read->data(), m_read->data() + m_readPos, m_read->end - m_readPos);
+        m_read->end -= m_readPos;
+        slab = static_cast<Slab*>(realloc(m_read, sizeof(Slab) + capacity));
+        if(!slab)
+            throw std::bad_alloc();
+        slab->capacity = capacity;
+        slab->next = nullptr;
+    }
+    else
+    {
+        slab = acquire(capacity);
+        rest = m_read;
+        rest->end -= m_readPos;
+        memmove(rest->data(), rest->data() + m_readPos, rest->end);
+        //后面的块和前面读完的块一起还回去
+        releaseConsumed();
+        m_head = m_read = nullptr;
+    }
+    while(rest)
+    {
+        Slab* next = rest->next;
+        memcpy(slab->data() + slab->end, rest->data(), rest->end);
+        slab->end += rest->end;
+        release(rest);
+        rest = next;
+    }
+    m_head = m_read = m_tail = slab;
+    m_readPos = 0;
+    m_readable = readable;
+    m_slabCount = 1;
+    m_bigCount = slab->capacity > SLAB_SIZE;
+    return curReadPtr();
+}
+
+void Buffer::peekIov(size_t offset, size_t len, std::vector<struct iovec>& iov) const
+{
+    assert(offset + len <= readableBytes());
+    const Slab* slab = m_read;
+    size_t pos = m_readPos + offset;
+    while(slab && pos >= slab->end && slab->next)
+    {
+        pos -= slab->end;
+        slab = slab->next;
+    }
+    for(; slab && len > 0; slab = slab->next, pos = 0)
+    {
+        size_t n = std::min(len, slab->end - pos);
+        if(n > 0)
+            iov.push_back({const_cast<char*>(slab->data()) + pos, n});
+        len -= n;
+    }
+}
+
+//读进最后一块的剩余空间和几块新块，没用上的新块还回去，不再需要栈上的暂存区和之后的拷贝
 ssize_t Buffer::readFd(int fd, int* Errno)
 {
-    char buf[BUFFER_SIZE];
-    struct iovec iov[2];
+    reclaim();
+    struct iovec iov[READ_SLABS + 1];
+    Slab* fresh[READ_SLABS];
+    int iovCnt = 0;
+    int freshCnt = 0;
     const size_t writeable = writeableBytes();
+    if(writeable > 0)
+        iov[iovCnt++] = {m_tail->data() + m_tail->end, writeable};
+    for(size_t room = writeable; freshCnt < READ_SLABS && room < READ_SLABS * SLAB_SIZE; room += SLAB_SIZE)
+    {
+        fresh[freshCnt] = acquire(SLAB_SIZE);
+        iov[iovCnt++] = {fresh[freshCnt]->data(), SLAB_SIZE};
+        freshCnt++;
+    }
 
-    //设置两个缓冲区，先读入buffer_中，不够就暂存到buf里
-    iov[0].iov_base = BeginPtr() + m_writePos;
-    iov[0].iov_len = writeableBytes();
-    iov[1].iov_base  = buf;
-    iov[1].iov_len = sizeof(buf);   
-
-    const ssize_t len = readv(fd, iov, 2);
+    const ssize_t len = readv(fd, iov, iovCnt);
     if(len < 0)
     {
         *Errno = errno;
     }
-    else if(static_cast<size_t>(len) < writeable)//剩余写空间足够,已正常读入，后移write指针即可
-    {
-        m_writePos += len;
-    }
-    else    //剩余空间不足，需调用append把剩余的数据读回buffer_（append保证不够就扩容）
+    size_t left = len > 0 ? len : 0;
+    size_t n = std::min(left, writeable);
+    updateWritePtr(n);
+    left -= n;
+    for(int i = 0; i < freshCnt; i++)
     {
-        m_writePos = m_buffer.size();
-        append(buf, len - writeable);
+        if(left > 0)
+        {
+            link(fresh[i]);
+            n = std::min(left, SLAB_SIZE);
+            updateWritePtr(n);
+            left -= n;
+        }
+        else
+        {
+            release(fresh[i]);
+        }
     }
     return len;
 }
 
-//写数据到fd里，read到write之间的数据是有效的
+//所有块里的数据一次writev
 ssize_t Buffer::writeFd(int fd, int* Errno)
 {
-    size_t readSize = readableBytes();
-    ssize_t len = write(fd, curReadPtr(), readSize);
+    std::vector<struct iovec> iov;
+    peekIov(0, readableBytes(), iov);
+    ssize_t len = writev(fd, iov.data(), std::min<size_t>(iov.size(), IOV_MAX));
     if(len < 0)
     {
         *Errno = errno;
         return len;
     }
-    m_readPos += len;
+    updateReadPtr(len);
     return len;
 }
 
 //将缓冲区的数据全转为string
 std::string Buffer::alltoStr()
 {
-    std::string str(curReadPtr(), readableBytes());
+    std::string str;
+    str.reserve(readableBytes());
+    for(const Slab* slab = m_read; slab && m_readable > 0; slab = slab->next)
+    {
+        size_t begin = slab == m_read ? m_readPos : 0;
+        str.append(slab->data() + begin, slab->end - begin);
+    }
     initPtr();
     return str;
 }
-
-char* Buffer::BeginPtr()
-{
-    return &*m_buffer.begin();
-}
-
-const char* Buffer::BeginPtr() const
-{
-    return &*m_buffer.begin();
-}
\ No newline at end of file
@@ -2,38 +2,48 @@
 #include<iostream>
 #include<vector>
 #include<cstring>
-#include<atomic>
+#include<string>
+#include<limits.h>
 #include<unistd.h>
 #include<sys/uio.h>
 #include<assert.h>
 
-#define BUFFER_SIZE 65535
-
+//缓冲区由固定大小的块串成链表，块从本线程的空闲链表里取，用完还回去，从不清零
+//写入时当前块满了就接上新块，不重新分配、不拷贝已有数据；initPtr只重置位置，O(1)
+//可读数据可能跨多个块：writev之类的用peekIov取得各块的iov，解析这类需要连续内存的先linearize
+//一个缓冲区同一时间只属于一个线程，读写位置是普通整数
 class Buffer
 {
 public:
-    Buffer(int initBufferSize = 1024) : m_buffer(initBufferSize), m_readPos(0), m_writePos(0){}
-    ~Buffer() = default;
+    Buffer();
+    ~Buffer();
+
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
 
 public:
-    //可以写入的字节数
+    //最后一块可以直接写入的字节数
     size_t writeableBytes() const;
     //可以读取的字节数
     size_t readableBytes() const;
-    //已经读取的字节数
+    //读位置在当前块里的偏移
     size_t readBytes() const;
 
-    //获取当前的读写指针
+    //获取当前的读写指针，读指针后面只有当前块里的数据是连续的
     const char* curReadPtr() const;
     const char* curWritePtrConst() const;
+    //还没有块时先取一块
     char* curWritePtr();
 
-    //更新读写指针
+    //更新读写指针；读过的块留到下次写入时才回收，在这之前指向它们的数据依然有效
     void updateReadPtr(size_t len);
     void updateReadPtrUntilEnd(const char* end);
     void updateWritePtr(size_t len);
     void initPtr();
+    //连同第一块一起还回去，不再占内存，之后写入时重新取块
+    void releaseMemory();
 
+    //保证最后一块有len字节连续的可写空间
     void ensureWriteable(size_t len);
     //写入数据
     void append(const char* str, size_t len);
@@ -41,18 +51,63 @@ public:
     void append(const void* data, size_t len);
     void append(const Buffer& buffer);
 
+    //把可读数据整理成连续的一段，返回开头；数据已经连续时不拷贝
+    const char* linearize();
+    //可读数据里从offset开始的len字节，每块一个iov追加到iov后面
+    void peekIov(size_t offset, size_t len, std::vector<struct iovec>& iov) const;
+
     ssize_t readFd(int fd, int* Errno);
     ssize_t writeFd(int fd, int* Errno);
 
     std::string alltoStr();
 
+    //块的大小，超过它的连续写入和linearize用单独分配的大块，大块不进空闲链表
+    static constexpr size_t SLAB_SIZE = 4096;
+
 private:
-    char* BeginPtr();
-    const char* BeginPtr() const;
-    void allocateSpace(size_t len);
+    struct Slab
+    {
+        Slab* next;
+        size_t capacity;
+        size_t end;     //块里已经写入的字节数
+        char* data()
+        {
+            return reinterpret_cast<char*>(this + 1);
+        }
+        const char* data() const
+        {
+            return reinterpret_cast<const char*>(this + 1);
+        }
+    };
+
+    //每个线程的空闲块
+    struct SlabPool
+    {
+        ~SlabPool();
+        Slab* head = nullptr;
+        size_t count = 0;
+        bool closed = false;
+    };
+
+    static Slab* acquire(size_t capacity);
+    static void release(Slab* slab);
+    void link(Slab* slab);
+    void reclaim();
+    void releaseConsumed();
+    void releaseAfterHead();
+
+    //readFd一次最多接上的新块数
+    static const int READ_SLABS = 4;
+    //每个线程最多留着的空闲块数
+    static const size_t MAX_POOLED = 256;
 
-    std::vector<char> m_buffer;
-    std::atomic<std::size_t> m_readPos;  //当前读取的位置，看作begin
-    std::atomic<std::size_t> m_writePos; //当前写入的位置，看作end
+    static thread_local SlabPool t_pool;
 
-};
\ No newline at end of file
+    Slab* m_head;       //第一块，可能已经读完，等下次写入时回收
+    Slab* m_read;       //读位置所在的块
+    Slab* m_tail;       //写位置所在的块
+    size_t m_readPos;   //读位置在m_read里的偏移
+    size_t m_readable;
+    size_t m_slabCount;
+    size_t m_bigCount;  //链上的大块数，没有大块时整条链可以一次接到空闲链表上
+};
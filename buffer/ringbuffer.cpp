@@ -0,0 +1,239 @@
+#include<errno.h>
+#include<string.h>
+#include<sys/mman.h>
+#include<algorithm>
+#include"ringbuffer.h"
+
+thread_local RingBuffer::RingPool RingBuffer::t_pool;
+
+//线程退出时释放空闲映射，之后还回来的直接释放
+RingBuffer::RingPool::~RingPool()
+{
+    for(const Mapping& m : free)
+        unmap(m.data, m.capacity);
+    free.clear();
+    bytes = 0;
+    closed = true;
+}
+
+RingBuffer::RingBuffer()
+{
+    m_data = nullptr;
+    m_capacity = 0;
+    m_readPos = 0;
+    m_readable = 0;
+}
+
+RingBuffer::~RingBuffer()
+{
+    release(m_data, m_capacity);
+}
+
+//先占住两倍容量的地址，再把memfd的同一段页映射到前后两半；映射建好后fd就不需要了，不占连接的fd配额
+char* RingBuffer::map(size_t capacity)
+{
+    int fd = memfd_create("ringbuffer", MFD_CLOEXEC);
+    if(fd < 0)
+        return nullptr;
+    char* data = nullptr;
+    if(ftruncate(fd, capacity) == 0)
+    {
+        void* base = mmap(nullptr, capacity * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(base != MAP_FAILED)
+        {
+            data = static_cast<char*>(base);
+            if(mmap(data, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+               mmap(data + capacity, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+            {
+                munmap(base, capacity * 2);
+                data = nullptr;
+            }
+        }
+    }
+    close(fd);
+    return data;
+}
+
+void RingBuffer::unmap(char* data, size_t capacity)
+{
+    if(data)
+        munmap(data, capacity * 2);
+}
+
+RingBuffer::Mapping RingBuffer::acquire(size_t capacity)
+{
+    int best = -1;
+    for(int i = 0; i < static_cast<int>(t_pool.free.size()); i++)
+    {
+        if(t_pool.free[i].capacity >= capacity && (best < 0 || t_pool.free[i].capacity < t_pool.free[best].capacity))
+            best = i;
+    }
+    if(best < 0)
+        return {map(capacity), capacity};
+    Mapping m = t_pool.free[best];
+    t_pool.free[best] = t_pool.free.back();
+    t_pool.free.pop_back();
+    t_pool.bytes -= m.capacity;
+    return m;
+}
+
+//放不下时先释放最小的，大的映射更难得
+void RingBuffer::release(char* data, size_t capacity)
+{
+    if(!data)
+        return;
+    if(t_pool.closed || capacity > MAX_POOLED_BYTES)
+    {
+        unmap(data, capacity);
+        return;
+    }
+    t_pool.free.push_back({data, capacity});
+    t_pool.bytes += capacity;
+    while(t_pool.bytes > MAX_POOLED_BYTES)
+    {
+        auto smallest = std::min_element(t_pool.free.begin(), t_pool.free.end(),
+                                         [](const Mapping& a, const Mapping& b){ return a.capacity < b.capacity; });
+        unmap(smallest->data, smallest->capacity);
+        t_pool.bytes -= smallest->capacity;
+        *smallest = t_pool.free.back();
+        t_pool.free.pop_back();
+    }
+}
+
+bool RingBuffer::available()
+{
+    char* data = map(DEFAULT_CAPACITY);
+    if(!data)
+        return false;
+    //前一半写入的数据要能从后一半读出来
+    data[0] = 'r';
+    bool mirrored = data[DEFAULT_CAPACITY] == 'r';
+    unmap(data, DEFAULT_CAPACITY);
+    return mirrored;
+}
+
+size_t RingBuffer::writeableBytes() const
+{
+    return m_capacity - m_readable;
+}
+
+size_t RingBuffer::readableBytes() const
+{
+    return m_readable;
+}
+
+size_t RingBuffer::capacity() const
+{
+    return m_capacity;
+}
+
+const char* RingBuffer::curReadPtr() const
+{
+    return m_data + m_readPos;
+}
+
+char* RingBuffer::curWritePtr()
+{
+    return m_data + m_readPos + m_readable;
+}
+
+void RingBuffer::updateReadPtr(size_t len)
+{
+    assert(len <= readableBytes());
+    m_readable -= len;
+    m_readPos += len;
+    if(m_readPos >= m_capacity)
+        m_readPos -= m_capacity;
+    //读完时回到开头，下次读socket用的页和上次一样
+    if(m_readable == 0)
+        m_readPos = 0;
+}
+
+void RingBuffer::updateWritePtr(size_t len)
+{
+    assert(len <= writeableBytes());
+    m_readable += len;
+}
+
+void RingBuffer::initPtr()
+{
+    m_readPos = 0;
+    m_readable = 0;
+    if(m_capacity > DEFAULT_CAPACITY)
+    {
+        release(m_data, m_capacity);
+        m_data = nullptr;
+        m_capacity = 0;
+    }
+}
+
+void RingBuffer::releaseMemory()
+{
+    m_readPos = 0;
+    m_readable = 0;
+    release(m_data, m_capacity);
+    m_data = nullptr;
+    m_capacity = 0;
+}
+
+//换成能再放下len字节的映射，按两倍扩大，可读数据拷到新映射的开头
+bool RingBuffer::grow(size_t len)
+{
+    size_t need = m_readable + len;
+    if(need > MAX_CAPACITY)
+        return false;
+    size_t capacity = m_capacity ? m_capacity : DEFAULT_CAPACITY;
+    while(capacity < need)
+        capacity *= 2;
+    capacity = std::min(capacity, MAX_CAPACITY);
+    Mapping m = acquire(capacity);
+    if(!m.data)
+        return false;
+    if(m_readable > 0)
+        memcpy(m.data, curReadPtr(), m_readable);
+    release(m_data, m_capacity);
+    m_data = m.data;
+    m_capacity = m.capacity;
+    m_readPos = 0;
+    return true;
+}
+
+bool RingBuffer::ensureWriteable(size_t len)
+{
+    if(m_data && writeableBytes() >= len)
+        return true;
+    return grow(len);
+}
+
+bool RingBuffer::append(const char* str, size_t len)
+{
+    assert(str != nullptr);
+    if(!ensureWriteable(len))
+        return false;
+    memcpy(curWritePtr(), str, len);
+    updateWritePtr(len);
+    return true;
+}
+
+bool RingBuffer::append(const std::string& str)
+{
+    return append(str.data(), str.size());
+}
+
+//直接读到写位置，可写空间本身就是连续的
+ssize_t RingBuffer::readFd(int fd, int* Errno)
+{
+    if(!ensureWriteable(MIN_READ))
+    {
+        *Errno = ENOMEM;
+        return -1;
+    }
+    const ssize_t len = read(fd, curWritePtr(), writeableBytes());
+    if(len < 0)
+    {
+        *Errno = errno;
+        return len;
+    }
+    updateWritePtr(len);
+    return len;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include<string>
+#include<vector>
+#include<unistd.h>
+#include<assert.h>
+
+//镜像环形缓冲区：同一段物理页（memfd）连续映射两次，从任何位置开始的可读数据在虚拟地址上都是连续的
+//读socket直接读到写位置，解析直接用读位置，绕回开头时不用整理、不用暂存区，也不用拷贝溢出的部分
+//只有放不下时才换成两倍大的映射并拷贝一次；容量超过默认值的映射在initPtr时释放
+//释放的映射留在本线程的空闲列表里给下一个要扩大的缓冲区用，新映射的页第一次写入时缺页的开销比拷贝大得多
+//一个缓冲区同一时间只属于一个线程
+class RingBuffer
+{
+public:
+    RingBuffer();
+    ~RingBuffer();
+
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+
+public:
+    size_t writeableBytes() const;
+    size_t readableBytes() const;
+    size_t capacity() const;
+
+    //读指针后面readableBytes字节、写指针后面writeableBytes字节都是连续的
+    const char* curReadPtr() const;
+    char* curWritePtr();
+
+    void updateReadPtr(size_t len);
+    void updateWritePtr(size_t len);
+    //只重置位置，扩大过的映射释放掉，下次用时重新映射默认大小
+    void initPtr();
+    //映射还回本线程的空闲列表，之后写入时重新取
+    void releaseMemory();
+
+    //保证有len字节连续的可写空间，映射失败时返回false
+    bool ensureWriteable(size_t len);
+    bool append(const char* str, size_t len);
+    bool append(const std::string& str);
+
+    //映射失败时返回-1，Errno为ENOMEM
+    ssize_t readFd(int fd, int* Errno);
+
+    //内核是否支持memfd，服务器启动时检查一次
+    static bool available();
+
+    //默认容量，和原来readFd的栈上暂存区一样大，必须是页大小的倍数
+    static constexpr size_t DEFAULT_CAPACITY = 64 * 1024;
+    //最大容量，要能放下最大的消息体和请求头
+    static constexpr size_t MAX_CAPACITY = 16 * 1024 * 1024;
+    //可写空间少于这个值时先扩大再读，避免一次只读进很少的数据
+    static constexpr size_t MIN_READ = 4096;
+
+    //每个线程留着的空闲映射的总容量
+    static constexpr size_t MAX_POOLED_BYTES = 16 * 1024 * 1024;
+
+private:
+    struct Mapping
+    {
+        char* data;
+        size_t capacity;
+    };
+
+    //每个线程的空闲映射
+    struct RingPool
+    {
+        ~RingPool();
+        std::vector<Mapping> free;
+        size_t bytes = 0;
+        bool closed = false;
+    };
+
+    static char* map(size_t capacity);
+    static void unmap(char* data, size_t capacity);
+    //优先取空闲列表里能放下的最小的映射
+    static Mapping acquire(size_t capacity);
+    static void release(char* data, size_t capacity);
+    bool grow(size_t len);
+
+    static thread_local RingPool t_pool;
+
+    char* m_data;           //两倍容量的虚拟地址，后一半映射到和前一半相同的页
+    size_t m_capacity;
+    size_t m_readPos;       //小于m_capacity
+    size_t m_readable;
+};
@@ -38,6 +38,26 @@ bool Epoller::delFd(int fd)
     return epoll_ctl(m_epollerFd, EPOLL_CTL_DEL, fd, &ev) == 0;
 }
 
+bool Epoller::addFd(int fd, uint32_t events, void* ptr)
+{
+    if(fd < 0)
+        return false;
+    epoll_event ev = {0};
+    ev.data.ptr = ptr;
+    ev.events = events;
+    return epoll_ctl(m_epollerFd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+bool Epoller::modFd(int fd, uint32_t events, void* ptr)
+{
+    if(fd < 0)
+        return false;
+    epoll_event ev = {0};
+    ev.data.ptr = ptr;
+    ev.events = events;
+    return epoll_ctl(m_epollerFd, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
 int Epoller::wait(int timeout)
 {
     return epoll_wait(m_epollerFd, &m_events[0], static_cast<int>(m_events.size()), timeout);
@@ -49,6 +69,12 @@ int Epoller::getEventFd(size_t i) const
     return m_events[i].data.fd;
 }
 
+void* Epoller::getEventPtr(size_t i) const
+{
+    assert(i < m_events.size() && i >= 0);
+    return m_events[i].data.ptr;
+}
+
 uint32_t Epoller::getEvents(size_t i) const
 {
     assert(i < m_events.size() && i >= 0);
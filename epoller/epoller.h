@@ -18,10 +18,15 @@ public:
     bool addFd(int fd, uint32_t events);
     bool modFd(int fd, uint32_t events);
     bool delFd(int fd);
+    //data.ptr直接带上事件对应的对象，就绪时不用再按fd查表
+    bool addFd(int fd, uint32_t events, void* ptr);
+    bool modFd(int fd, uint32_t events, void* ptr);
     //封装epoll_wait,返回就绪fd的数目
     int wait(int timeout = -1);
     //返回就绪fd
     int getEventFd(size_t i) const;
+    //返回就绪事件携带的对象
+    void* getEventPtr(size_t i) const;
     //返回事件表
     uint32_t getEvents(size_t i) const;
 
@@ -0,0 +1,247 @@
+#include"iouring.h"
+
+IoUring::IoUring()
+{
+    m_ringFd = -1;
+    m_sqPtr = m_cqPtr = nullptr;
+    m_sqSize = m_cqSize = m_sqesSize = 0;
+    m_sqes = nullptr;
+    m_sqLocalTail = m_toSubmit = 0;
+    m_bufRing = nullptr;
+    m_bufRingSize = 0;
+    m_bufBase = nullptr;
+    m_bufCount = m_bufSize = 0;
+}
+
+IoUring::~IoUring()
+{
+    if(m_bufBase)
+        munmap(m_bufBase, (size_t)m_bufCount * m_bufSize);
+    if(m_bufRing)
+        munmap(m_bufRing, m_bufRingSize);
+    if(m_sqes)
+        munmap(m_sqes, m_sqesSize);
+    if(m_cqPtr && m_cqPtr != m_sqPtr)
+        munmap(m_cqPtr, m_cqSize);
+    if(m_sqPtr)
+        munmap(m_sqPtr, m_sqSize);
+    if(m_ringFd >= 0)
+        close(m_ringFd);
+}
+
+bool IoUring::init(unsigned entries, unsigned bufCount, unsigned bufSize)
+{
+    assert(entries > 0 && bufCount > 0 && (bufCount & (bufCount - 1)) == 0 && bufCount <= 32768);
+    //只有reactor线程提交请求，内核的task work推迟到wait时统一执行
+    //SINGLE_ISSUER/DEFER_TASKRUN需要6.1以上的内核，同时保证了multishot recv可用
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    params.cq_entries = entries * 4;
+    m_ringFd = syscall(__NR_io_uring_setup, entries, &params);
+    if(m_ringFd < 0)
+        return false;
+    if(!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG))
+        return false;
+
+    //sq和cq共用一次mmap
+    m_sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    m_sqSize = m_cqSize = std::max(m_sqSize, m_cqSize);
+    m_sqPtr = mmap(nullptr, m_sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING);
+    if(m_sqPtr == MAP_FAILED)
+    {
+        m_sqPtr = nullptr;
+        return false;
+    }
+    m_cqPtr = m_sqPtr;
+    m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQES);
+    if(sqes == MAP_FAILED)
+        return false;
+    m_sqes = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(m_sqPtr);
+    m_sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    m_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    m_sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    m_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    m_sqLocalTail = *m_sqTail;
+    char* cq = static_cast<char*>(m_cqPtr);
+    m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    m_cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    m_events.reserve(params.cq_entries);
+
+    //注册provided buffer ring，recv时由内核挑选空闲缓冲区，不需要为每个连接预留接收缓冲区
+    m_bufCount = bufCount;
+    m_bufSize = bufSize;
+    m_bufRingSize = bufCount * sizeof(io_uring_buf);
+    void* ring = mmap(nullptr, m_bufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(ring == MAP_FAILED)
+        return false;
+    m_bufRing = static_cast<io_uring_buf_ring*>(ring);
+    void* base = mmap(nullptr, (size_t)bufCount * bufSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(base == MAP_FAILED)
+        return false;
+    m_bufBase = static_cast<char*>(base);
+
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(m_bufRing);
+    reg.ring_entries = bufCount;
+    reg.bgid = BUF_GROUP;
+    if(syscall(__NR_io_uring_register, m_ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        return false;
+    for(unsigned i = 0; i < bufCount; i++)
+    {
+        addBuffer(i);
+    }
+    return true;
+}
+
+//取一个空闲的sqe，队列满时先把已有的请求提交给内核
+io_uring_sqe* IoUring::getSqe()
+{
+    unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+    if(m_sqLocalTail - head > *m_sqMask)
+    {
+        submit(0, 0);
+        head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+        assert(m_sqLocalTail - head <= *m_sqMask);
+    }
+    unsigned index = m_sqLocalTail & *m_sqMask;
+    io_uring_sqe* sqe = &m_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    m_sqArray[index] = index;
+    m_sqLocalTail++;
+    //更新tail后内核才能看到这个请求
+    __atomic_store_n(m_sqTail, m_sqLocalTail, __ATOMIC_RELEASE);
+    m_toSubmit++;
+    return sqe;
+}
+
+void IoUring::prepAcceptMultishot(int fd, uint64_t userData)
+{
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = userData;
+}
+
+void IoUring::prepRecvMultishot(int fd, uint64_t userData)
+{
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUF_GROUP;
+    sqe->user_data = userData;
+}
+
+void IoUring::prepSendmsg(int fd, const struct msghdr* msg, uint64_t userData)
+{
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+    sqe->user_data = userData;
+}
+
+void IoUring::prepPollAdd(int fd, uint32_t events, uint64_t userData)
+{
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->user_data = userData;
+}
+
+int IoUring::submit(unsigned waitNr, int timeoutMS)
+{
+    unsigned flags = 0;
+    io_uring_getevents_arg arg;
+    __kernel_timespec ts;
+    memset(&arg, 0, sizeof(arg));
+    if(waitNr > 0)
+    {
+        flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        if(timeoutMS >= 0)
+        {
+            ts.tv_sec = timeoutMS / 1000;
+            ts.tv_nsec = (timeoutMS % 1000) * 1000000LL;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+        }
+    }
+    int ret = syscall(__NR_io_uring_enter, m_ringFd, m_toSubmit, waitNr, flags,
+                      waitNr > 0 ? &arg : nullptr, waitNr > 0 ? sizeof(arg) : 0);
+    if(ret >= 0)
+    {
+        m_toSubmit -= std::min<unsigned>(ret, m_toSubmit);
+    }
+    return ret;
+}
+
+int IoUring::wait(int timeoutMS)
+{
+    m_events.clear();
+    int ret = submit(1, timeoutMS);
+    if(ret < 0 && errno != ETIME && errno != EINTR && errno != EBUSY)
+        return -1;
+    //把完成事件拷贝出来并归还cq空间
+    unsigned head = *m_cqHead;
+    unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+    for(; head != tail; head++)
+    {
+        m_events.push_back(m_cqes[head & *m_cqMask]);
+    }
+    __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+    return static_cast<int>(m_events.size());
+}
+
+uint64_t IoUring::getUserData(size_t i) const
+{
+    assert(i < m_events.size());
+    return m_events[i].user_data;
+}
+
+int IoUring::getRes(size_t i) const
+{
+    assert(i < m_events.size());
+    return m_events[i].res;
+}
+
+uint32_t IoUring::getFlags(size_t i) const
+{
+    assert(i < m_events.size());
+    return m_events[i].flags;
+}
+
+const char* IoUring::getBuffer(uint16_t bid) const
+{
+    assert(bid < m_bufCount);
+    return m_bufBase + (size_t)bid * m_bufSize;
+}
+
+void IoUring::recycleBuffer(uint16_t bid)
+{
+    addBuffer(bid);
+}
+
+//把缓冲区放回buffer ring的尾部
+void IoUring::addBuffer(uint16_t bid)
+{
+    assert(bid < m_bufCount);
+    unsigned short tail = m_bufRing->tail;
+    //c++下bufs前面会多出一个空结构体，按io_uring_buf数组直接定位
+    io_uring_buf* buf = reinterpret_cast<io_uring_buf*>(m_bufRing) + (tail & (m_bufCount - 1));
+    buf->addr = reinterpret_cast<uint64_t>(m_bufBase + (size_t)bid * m_bufSize);
+    buf->len = m_bufSize;
+    buf->bid = bid;
+    __atomic_store_n(&m_bufRing->tail, (unsigned short)(tail + 1), __ATOMIC_RELEASE);
+}
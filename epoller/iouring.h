@@ -0,0 +1,84 @@
+#pragma once
+#include<linux/io_uring.h>
+#include<sys/syscall.h>
+#include<sys/mman.h>
+#include<sys/socket.h>
+#include<poll.h>
+#include<unistd.h>
+#include<assert.h>
+#include<vector>
+#include<algorithm>
+#include<errno.h>
+#include<string.h>
+#include<stdint.h>
+
+//io_uring的简单封装，直接使用系统调用，不依赖liburing
+//和Epoller不同，io_uring是完成通知模型：提交accept/recv/send请求，wait返回的是已完成的请求
+class IoUring
+{
+public:
+    IoUring();
+    ~IoUring();
+
+public:
+    //创建ring并注册provided buffer，内核不支持（太旧或被禁用）时返回false
+    bool init(unsigned entries = 1024, unsigned bufCount = 1024, unsigned bufSize = 4096);
+
+    //多次触发的accept，一个请求持续产生新连接
+    void prepAcceptMultishot(int fd, uint64_t userData);
+    //多次触发的recv，数据放在内核从buffer ring里挑选的缓冲区中
+    void prepRecvMultishot(int fd, uint64_t userData);
+    //sendmsg，一个请求发送多段数据，msg在请求完成前必须有效
+    void prepSendmsg(int fd, const struct msghdr* msg, uint64_t userData);
+    //单次的poll，fd上出现events时完成
+    void prepPollAdd(int fd, uint32_t events, uint64_t userData);
+
+    //提交所有请求并等待至少一个完成事件，返回完成事件数，timeout<0一直阻塞
+    int wait(int timeoutMS = -1);
+    uint64_t getUserData(size_t i) const;
+    int getRes(size_t i) const;
+    uint32_t getFlags(size_t i) const;
+
+    //provided buffer的读取和归还
+    const char* getBuffer(uint16_t bid) const;
+    void recycleBuffer(uint16_t bid);
+
+private:
+    io_uring_sqe* getSqe();
+    int submit(unsigned waitNr, int timeoutMS);
+    void addBuffer(uint16_t bid);
+
+    static const uint16_t BUF_GROUP = 0;
+
+    int m_ringFd;
+
+    //提交队列
+    void* m_sqPtr;
+    size_t m_sqSize;
+    unsigned* m_sqHead;
+    unsigned* m_sqTail;
+    unsigned* m_sqMask;
+    unsigned* m_sqArray;
+    io_uring_sqe* m_sqes;
+    size_t m_sqesSize;
+    unsigned m_sqLocalTail;
+    unsigned m_toSubmit;
+
+    //完成队列
+    void* m_cqPtr;
+    size_t m_cqSize;
+    unsigned* m_cqHead;
+    unsigned* m_cqTail;
+    unsigned* m_cqMask;
+    io_uring_cqe* m_cqes;
+
+    //provided buffer ring和对应的内存
+    io_uring_buf_ring* m_bufRing;
+    size_t m_bufRingSize;
+    char* m_bufBase;
+    unsigned m_bufCount;
+    unsigned m_bufSize;
+
+    //本次wait取出的完成事件
+    std::vector<io_uring_cqe> m_events;
+};
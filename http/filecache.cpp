@@ -0,0 +1,161 @@
+#include"filecache.h"
+#include"httpresponse.h"
+
+FileCache::FileCache() : m_shardCapacity(0), m_sendfileThreshold(SIZE_MAX), m_hits(0), m_misses(0)
+{
+}
+
+FileCache* FileCache::instance()
+{
+    static FileCache cache;
+    return &cache;
+}
+
+void FileCache::init(size_t capacity, size_t sendfileThreshold)
+{
+    m_shardCapacity = capacity / SHARD_COUNT;
+    m_sendfileThreshold = sendfileThreshold;
+}
+
+size_t FileCache::hits() const
+{
+    return m_hits;
+}
+
+size_t FileCache::misses() const
+{
+    return m_misses;
+}
+
+int64_t FileCache::nowMS()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+//stat并映射或打开文件，只处理普通文件；没有读权限的文件只记录属性，由调用者返回403
+FilePtr FileCache::load(const std::string& path)
+{
+    struct stat st;
+    if(stat(path.data(), &st) < 0 || !S_ISREG(st.st_mode))
+        return nullptr;
+    std::shared_ptr<CachedFile> file(new CachedFile());
+    file->path = path;
+    file->size = st.st_size;
+    file->mode = st.st_mode;
+    file->ino = st.st_ino;
+    file->mtime = st.st_mtim;
+    file->mimeType = HttpResponse::fileType(path);
+    file->checkedAt = nowMS();
+    if((st.st_mode & S_IROTH) && st.st_size > 0)
+    {
+        int fd = open(path.data(), O_RDONLY | O_CLOEXEC);
+        if(fd >= 0 && static_cast<size_t>(st.st_size) >= m_sendfileThreshold)
+        {
+            file->fd = fd;
+            return file;
+        }
+        if(fd >= 0)
+        {
+            void* ret = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(ret != MAP_FAILED)
+                file->data = static_cast<char*>(ret);
+            close(fd);
+        }
+        if(file->data == nullptr)
+            LOG_WARN("map file %s error", path.data());
+    }
+    return file;
+}
+
+//只保留fd的项不占映射的容量，单独限制数量
+static size_t mappedBytes(const FilePtr& file)
+{
+    return file->data ? file->size : 0;
+}
+
+//放到表头，超出分片容量时从表尾淘汰
+void FileCache::insert(Shard& shard, const FilePtr& file)
+{
+    shard.lru.push_front(file);
+    shard.index[file->path] = shard.lru.begin();
+    shard.bytes += mappedBytes(file);
+    shard.fds += file->fd >= 0;
+    while((shard.bytes > m_shardCapacity || shard.fds > MAX_SHARD_FDS) && !shard.lru.empty())
+    {
+        const FilePtr& victim = shard.lru.back();
+        shard.bytes -= mappedBytes(victim);
+        shard.fds -= victim->fd >= 0;
+        shard.index.erase(victim->path);
+        shard.lru.pop_back();
+    }
+}
+
+void FileCache::erase(Shard& shard, const std::string& path)
+{
+    auto it = shard.index.find(path);
+    if(it == shard.index.end())
+        return;
+    shard.bytes -= mappedBytes(*it->second);
+    shard.fds -= (*it->second)->fd >= 0;
+    shard.lru.erase(it->second);
+    shard.index.erase(it);
+}
+
+FilePtr FileCache::getHot(const std::string& path)
+{
+    Shard& shard = m_shards[std::hash<std::string>()(path) % SHARD_COUNT];
+    std::lock_guard<std::mutex> locker(shard.mutex);
+    auto it = shard.index.find(path);
+    if(it == shard.index.end())
+        return nullptr;
+    const FilePtr& file = *it->second;
+    if(!(file->data || file->size == 0) || nowMS() - file->checkedAt.load(std::memory_order_relaxed) >= CHECK_INTERVAL_MS)
+        return nullptr;
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    m_hits++;
+    return file;
+}
+
+FilePtr FileCache::get(const std::string& path)
+{
+    Shard& shard = m_shards[std::hash<std::string>()(path) % SHARD_COUNT];
+    FilePtr file;
+    {
+        std::lock_guard<std::mutex> locker(shard.mutex);
+        auto it = shard.index.find(path);
+        if(it != shard.index.end())
+        {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            file = *it->second;
+        }
+    }
+    if(file)
+    {
+        //限制stat的频率，同一时刻只有一个线程去检查
+        int64_t now = nowMS();
+        int64_t checked = file->checkedAt.load(std::memory_order_relaxed);
+        if(now - checked < CHECK_INTERVAL_MS || !file->checkedAt.compare_exchange_strong(checked, now))
+        {
+            m_hits++;
+            return file;
+        }
+        struct stat st;
+        if(stat(path.data(), &st) == 0 && st.st_ino == file->ino && st.st_size == static_cast<off_t>(file->size) &&
+           st.st_mode == file->mode && st.st_mtim.tv_sec == file->mtime.tv_sec && st.st_mtim.tv_nsec == file->mtime.tv_nsec)
+        {
+            m_hits++;
+            return file;
+        }
+        LOG_INFO("file %s changed, reload", path.data());
+    }
+    m_misses++;
+    FilePtr fresh = load(path);
+    std::lock_guard<std::mutex> locker(shard.mutex);
+    erase(shard, path);
+    //超过分片容量的映射不缓存，发送完就释放
+    if(fresh && mappedBytes(fresh) <= m_shardCapacity && m_shardCapacity > 0)
+        insert(shard, fresh);
+    return fresh;
+}
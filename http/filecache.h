@@ -0,0 +1,98 @@
+#pragma once
+#include<string>
+#include<list>
+#include<memory>
+#include<mutex>
+#include<atomic>
+#include<unordered_map>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/stat.h>
+#include<sys/mman.h>
+#include"../log/log.h"
+
+//缓存的文件：映射的内存或打开的fd、大小、修改时间、权限和MIME类型
+//小文件映射到内存，应答直接引用映射的内存写出去，不拷贝；大文件只保留fd，用sendfile发送
+//用shared_ptr引用计数，被淘汰或失效后，正在发送它的应答依然持有映射或fd，最后一个引用释放时才munmap/close
+struct CachedFile
+{
+    static const int HEAD_BLOCK_SLOTS = 8;
+
+    CachedFile() : data(nullptr), fd(-1), size(0), mode(0), ino(0), mtime{0, 0}, checkedAt(0)
+    {
+        for(int i = 0; i < HEAD_BLOCK_SLOTS; i++)
+            headBlocks[i] = nullptr;
+    }
+    ~CachedFile()
+    {
+        if(data)
+            munmap(data, size);
+        if(fd >= 0)
+            close(fd);
+        for(int i = 0; i < HEAD_BLOCK_SLOTS; i++)
+            delete headBlocks[i].load();
+    }
+    CachedFile(const CachedFile&) = delete;
+    CachedFile& operator=(const CachedFile&) = delete;
+
+    std::string path;
+    char* data;             //没有读权限、空文件或者大文件时为空
+    int fd;                 //大文件的fd，sendfile带偏移量参数，多个连接共用不影响文件位置
+    size_t size;
+    mode_t mode;
+    ino_t ino;
+    struct timespec mtime;
+    std::string mimeType;
+    mutable std::atomic<int64_t> checkedAt;     //上次确认文件没有变化的时间，毫秒
+    //这个文件的应答头部块，由HttpResponse第一次用到时生成，文件变化后随新的缓存项重新生成
+    mutable std::atomic<const std::string*> headBlocks[HEAD_BLOCK_SLOTS];
+};
+
+typedef std::shared_ptr<const CachedFile> FilePtr;
+
+//所有连接共享的静态文件缓存，按路径分片加锁，每个分片独立做LRU淘汰
+class FileCache
+{
+public:
+    static FileCache* instance();
+
+    //capacity是所有分片映射的字节数上限，0表示不缓存
+    //不小于sendfileThreshold的文件不映射，只保留fd
+    void init(size_t capacity, size_t sendfileThreshold);
+    //返回普通文件的缓存项，文件不存在或不是普通文件时返回空
+    //超过CHECK_INTERVAL_MS没检查过的项先stat一次，文件被修改过就重新加载
+    FilePtr get(const std::string& path);
+    //文件在缓存里、内容已经映射并且最近确认过没有变化时返回缓存项，不读盘也不stat；否则返回空，由get去加载
+    FilePtr getHot(const std::string& path);
+
+    size_t hits() const;
+    size_t misses() const;
+
+private:
+    FileCache();
+    ~FileCache() = default;
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::list<FilePtr> lru;     //表头是最近使用的
+        std::unordered_map<std::string, std::list<FilePtr>::iterator> index;
+        size_t bytes = 0;
+        int fds = 0;
+    };
+
+    FilePtr load(const std::string& path);
+    void insert(Shard& shard, const FilePtr& file);
+    void erase(Shard& shard, const std::string& path);
+    static int64_t nowMS();
+
+    static const int SHARD_COUNT = 16;
+    static const int64_t CHECK_INTERVAL_MS = 1000;
+    static const int MAX_SHARD_FDS = 32;    //每个分片最多缓存的fd数
+
+    Shard m_shards[SHARD_COUNT];
+    size_t m_shardCapacity;
+    size_t m_sendfileThreshold;
+    std::atomic<size_t> m_hits;
+    std::atomic<size_t> m_misses;
+};
@@ -3,11 +3,22 @@
 const char* HttpConnection::srcDir;
 std::atomic<size_t> HttpConnection::userCount;
 bool HttpConnection::isET;
+bool HttpConnection::useRing;
+std::atomic<size_t> HttpConnection::ringFallbacks;
+int HttpConnection::maxRequests;
 
 HttpConnection::HttpConnection()
 {
     m_fd = -1;
     m_addr = {0};
+    m_responseCnt = 0;
+    m_requestCnt = 0;
+    m_isKeepAlive = false;
+    m_deferred = false;
+    m_requestStart = 0;
+    m_idleSince = 0;
+    m_useRing = false;
+    m_uringState = {false, 0, false, false, 0, 0, 0, {}};
     m_isClosed = true;
 }
 
@@ -25,19 +36,34 @@ void HttpConnection::initHttpConn(int fd, const sockaddr_in& addr)
     m_addr = addr;
     m_writeBuffer.initPtr();
     m_readBuffer.initPtr();
+    m_readRing.initPtr();
+    m_useRing = useRing;
+    m_readStage.initPtr();
+    m_request.init();
+    m_output.clear();
+    m_requestCnt = 0;
+    m_isKeepAlive = false;
+    //槽里的对象是复用的，上一个连接可能留下了没应答的请求
+    m_deferred = false;
+    m_requestStart = 0;
+    m_idleSince = 0;
+    m_uringState = {false, 0, false, false, 0, 0, 0, {}};
     m_isClosed = false;
     LOG_INFO("Client[%d](%s:%d) in, userCount:%d", m_fd, getIp(), getPort(), (int)userCount);
 }
 
 void HttpConnection::closeHttpConn()
 {
-    m_response.unmapFile();
+    for(int i = 0; i < m_responseCnt; i++)
+        m_responses[i].releaseFile();
+    m_responseCnt = 0;
+    m_idleSince.store(0, std::memory_order_relaxed);
     if(m_isClosed == false)
     {
         m_isClosed = true;
         userCount--;
         close(m_fd);
-        LOG_INFO("Client[%d](%s:%d) quit, UserCount:%d", m_fd, getIp(), getPort(), (int)userCount);
+        LOG_INFO("Client[%d](%s:%d) quit, requests:%d, UserCount:%d", m_fd, getIp(), getPort(), m_requestCnt, (int)userCount);
     }
 }
 
@@ -62,91 +88,240 @@ int HttpConnection::getPort() const
 }
 
 //将socket的数据读入到缓冲区
+//至少读一次，停在预算处的数据在处理完这些请求、重新注册EPOLLIN后触发下一次读
 ssize_t HttpConnection::readBuffer(int* saveErrno)
 {
+    m_idleSince.store(0, std::memory_order_relaxed);
+    const size_t budget = std::max(READ_BUDGET, m_request.expectedSize());
     ssize_t len = -1;
     do
     {
-        len = m_readBuffer.readFd(m_fd, saveErrno);
+        len = m_useRing ? m_readRing.readFd(m_fd, saveErrno) : m_readBuffer.readFd(m_fd, saveErrno);
+        if(len < 0 && m_useRing && *saveErrno == ENOMEM && fallBackToSlabs(RingBuffer::MIN_READ))
+        {
+            len = m_readBuffer.readFd(m_fd, saveErrno);
+        }
         if(len <= 0)
             break;
-    } while(isET);
+    } while(isET && readBytes() < budget);
     return len;
 }
 
-//把缓冲区的http响应（状态行、头部、内容）和指定的文件从缓冲区写到socket
+//把这一批应答写到socket，内存段一次writev，文件每次sendfile一块
+//发了一块文件之后还有没发的，按写满处理，等下一次可写事件再继续，不让一个大文件长时间占住线程
 ssize_t HttpConnection::writeBuffer(int* saveErrno)
 {
-    ssize_t len = -1;
-    do
+    ssize_t len = 0;
+    while(m_output.bytes() > 0)
     {
-        len = writev(m_fd, m_iov, m_iovCnt);
+        bool file = m_output.atFile();
+        len = m_output.flush(m_fd, saveErrno);
         if(len <= 0)
-        {
-            *saveErrno = errno;
             break;
-        }
-        //传输结束
-        if(m_iov[0].iov_len + m_iov[1].iov_len == 0)
+        if(file && m_output.bytes() > 0)
         {
-            break;
+            *saveErrno = EAGAIN;
+            return -1;
         }
-        //iov[1]也参与了写,更新iov[1]的base和len
-        else if(static_cast<size_t>(len) > m_iov[0].iov_len)
-        {
-            m_iov[1].iov_base = (uint8_t*)m_iov[1].iov_base + (len - m_iov[0].iov_len);
-            m_iov[1].iov_len -= (len - m_iov[0].iov_len);
-            //iov[0]是http状态信息，写完就能重置
-            if(m_iov[0].iov_len)  
-            {
-                m_writeBuffer.initPtr();
-                m_iov[0].iov_len = 0;
-            }
-        }
-        //只有iov[0]参与写，更新
-        else
-        {
-            m_iov[0].iov_base = (uint8_t*)m_iov[0].iov_base + len;
-            m_iov[0].iov_len -= len;
-            m_writeBuffer.updateReadPtr(len);
-        }
-    }while(isET || writeBytes() > 10240);
+    }
     return len;
 }
 
-//接收http请求，返回http应答
-bool HttpConnection::handleHttpConn()
+bool HttpConnection::appendReadBuffer(const char* data, size_t len)
 {
-    m_request.init();
-    //还没有http请求
-    if(m_readBuffer.readableBytes() <= 0)
+    m_idleSince.store(0, std::memory_order_relaxed);
+    if(m_useRing)
     {
+        if(m_readRing.append(data, len))
+            return true;
+        if(!fallBackToSlabs(len))
+            return false;
+    }
+    m_readBuffer.append(data, len);
+    return true;
+}
+
+//镜像映射建不了（每个环形缓冲区占两个映射，进程的映射数到了vm.max_map_count）时不关闭连接，
+//这个连接改用块缓冲区，已经读到的数据搬过去；解析进度是相对请求开头的偏移，搬过去之后依然有效
+//超过RingBuffer::MAX_CAPACITY是请求本身太大，不退回，按原来的出错处理
+bool HttpConnection::fallBackToSlabs(size_t len)
+{
+    if(m_readRing.readableBytes() + len > RingBuffer::MAX_CAPACITY)
         return false;
+    if(ringFallbacks++ == 0)
+        LOG_WARN("Ring buffer map failed (vm.max_map_count?), connections fall back to slab buffers");
+    m_readBuffer.initPtr();
+    if(m_readRing.readableBytes() > 0)
+        m_readBuffer.append(m_readRing.curReadPtr(), m_readRing.readableBytes());
+    m_readRing.releaseMemory();
+    m_useRing = false;
+    return true;
+}
+
+void HttpConnection::stageRead(const char* data, size_t len)
+{
+    m_readStage.append(data, len);
+}
+
+//暂存的数据很少出现，接上之后把块还回去
+bool HttpConnection::unstageRead()
+{
+    size_t len = m_readStage.readableBytes();
+    if(len == 0)
+        return true;
+    bool ok = appendReadBuffer(m_readStage.linearize(), len);
+    m_readStage.releaseMemory();
+    return ok;
+}
+
+struct iovec* HttpConnection::getIov()
+{
+    return m_output.iov();
+}
+
+int HttpConnection::getIovCnt() const
+{
+    return m_output.iovCnt();
+}
+
+bool HttpConnection::hasFileToSend() const
+{
+    return m_output.hasFile();
+}
+
+void HttpConnection::advanceWrite(size_t len)
+{
+    m_output.advance(len);
+}
+
+//这一批应答已经全部发出
+void HttpConnection::finishWrite()
+{
+    m_writeBuffer.initPtr();
+    m_output.clear();
+    for(int i = 0; i < m_responseCnt; i++)
+        m_responses[i].releaseFile();
+    m_responseCnt = 0;
+}
+
+void HttpConnection::releaseIdle()
+{
+    assert(readBytes() == 0 && !m_deferred);
+    finishWrite();
+    m_readBuffer.releaseMemory();
+    m_writeBuffer.releaseMemory();
+    m_readRing.releaseMemory();
+    m_request.releaseMemory();
+    if(m_responses.size() > IDLE_RESPONSES)
+    {
+        m_responses.resize(IDLE_RESPONSES);
+        m_responses.shrink_to_fit();
     }
-    //解析http请求，并构造应答
-    else if(m_request.parse(m_readBuffer))
+    m_output.releaseMemory();
+    m_idleSince.store(TimerManager::nowMS(), std::memory_order_relaxed);
+}
+
+//接收http请求，返回http应答
+//读缓冲区里可能有多个流水线请求，逐个解析并把应答按顺序排在一起，尽量一次writev发出
+//请求没有消息体，目标文件已经映射在缓存里，应答不会阻塞也不需要多少计算
+FilePtr HttpConnection::inlineFile() const
+{
+    return m_request.getBody().empty() ? FileCache::instance()->getHot(m_fullPath) : nullptr;
+}
+
+bool HttpConnection::parseRequest()
+{
+    return m_useRing ? m_request.parse(m_readRing) : m_request.parse(m_readBuffer);
+}
+
+bool HttpConnection::handleHttpConn(bool inlineOnly)
+{
+    //还没有http请求
+    if(readBytes() <= 0 && !m_deferred)
     {
-        LOG_DEBUG("%s", m_request.getPath().c_str());
-        m_response.init(srcDir, m_request.getPath(), m_request.isKeepAlive(), 200);
+        return false;
     }
-    //解析失败，构造失败应答400
-    else
+    finishWrite();
+    m_isKeepAlive = true;
+    AccessLog* accessLog = AccessLog::instance();
+    bool logAccess = accessLog->isOpen();
+    while(m_isKeepAlive && m_responseCnt < MAX_PIPELINE && (m_deferred || readBytes() > 0))
     {
-        m_response.init(srcDir, m_request.getPath(), false, 400);
+        if(m_responseCnt == static_cast<int>(m_responses.size()))
+            m_responses.emplace_back();
+        HttpResponse& response = m_responses[m_responseCnt];
+        //解析http请求，并构造应答；上次停下的请求已经解析完，读缓冲区在这之间没有写入，解析结果依然有效
+        bool parsed = m_deferred;
+        bool keepAlive = false;
+        if(m_deferred && inlineOnly)
+        {
+            break;
+        }
+        m_deferred = false;
+        if(logAccess && m_requestStart == 0)
+            m_requestStart = AccessLog::nowNS();
+        if(parsed || parseRequest())
+        {
+            //请求还不完整，等待剩下的数据，已解析的部分下次不再重复解析
+            if(!m_request.isFinish())
+            {
+                break;
+            }
+            m_fullPath.assign(srcDir).append(m_request.getPath());
+            FilePtr file;
+            if(inlineOnly && !(file = inlineFile()))
+            {
+                m_deferred = true;
+                break;
+            }
+            LOG_DEBUG("%s", m_request.getPath().c_str());
+            //达到请求数上限时这个应答就关闭连接，left是应答之后还能处理的请求数
+            int left = maxRequests > 0 ? maxRequests - m_requestCnt - 1 : 0;
+            keepAlive = m_request.isKeepAlive() && (maxRequests <= 0 || left > 0);
+            response.init(srcDir, m_fullPath, keepAlive, 200, left, std::move(file));
+        }
+        //解析失败，构造失败应答400，之后的数据无法定位请求边界，发完就关闭连接
+        else
+        {
+            m_fullPath.assign(srcDir).append("/400.html");
+            response.init(srcDir, m_fullPath, false, 400);
+        }
+        size_t dynamic = m_writeBuffer.readableBytes();
+        response.makeResponse(m_writeBuffer);
+        std::string_view head = response.head();
+        std::string_view canned = response.cannedBody();
+        m_output.addBlock(head.data(), head.size());
+        m_output.addBuffer(dynamic, m_writeBuffer.readableBytes() - dynamic);
+        m_output.addBlock(canned.data(), canned.size());
+        //缓存里映射的小文件直接指向映射的内存，不拷贝；发完之前应答一直持有文件的引用
+        if(response.file() && response.fileLen() > 0)
+            m_output.addBlock(response.file(), response.fileLen());
+        if(response.fileFd() >= 0)
+            m_output.addFile(response.fileFd(), 0, response.fileLen());
+        m_isKeepAlive = keepAlive;
+        m_responseCnt++;
+        m_requestCnt++;
+        //流水线里下一个请求的数据已经在缓冲区里，从这个请求结束时算起
+        if(logAccess)
+        {
+            int64_t now = AccessLog::nowNS();
+            if(m_request.isFinish())
+                accessLog->append(m_addr, m_request.method(), m_request.target(), m_request.version(), response.code(),
+                                  response.bodyLen(), m_requestStart, now, accessLog->isCombined() ? m_request.getHeader("Referer") : "",
+                                  accessLog->isCombined() ? m_request.getHeader("User-Agent") : "");
+            else
+                accessLog->append(m_addr, "", "", "", response.code(), response.bodyLen(), m_requestStart, now, "", "");
+            m_requestStart = now;
+        }
     }
-
-    m_response.makeResponse(m_writeBuffer);
-    //状态信息
-    m_iov[0].iov_base = const_cast<char*>(m_writeBuffer.curReadPtr());
-    m_iov[0].iov_len = m_writeBuffer.readableBytes();
-    m_iovCnt = 1;
-    //文件
-    if(m_response.fileLen() > 0 && m_response.file())
+    if(readBytes() == 0 && !m_deferred)
+        m_requestStart = 0;
+    if(m_responseCnt == 0)
     {
-        m_iov[1].iov_base = m_response.file();
-        m_iov[1].iov_len = m_response.fileLen();
-        m_iovCnt = 2;
+        m_isKeepAlive = false;
+        return false;
     }
-    LOG_DEBUG("filesize:%d, %d  to %d", m_response.fileLen() , m_iovCnt, writeBytes());
+    m_output.build(m_writeBuffer);
+    LOG_DEBUG("responses:%d, iov:%d, to %zu", m_responseCnt, m_output.totalIovCnt(), writeBytes());
     return true;
-}
\ No newline at end of file
+}
@@ -1,13 +1,21 @@
 #pragma once
 #include<arpa/inet.h>
 #include<sys/uio.h>
+#include<sys/sendfile.h>
 #include<iostream>
 #include<sys/types.h>
 #include<assert.h>
+#include<deque>
+#include<algorithm>
+#include<vector>
 #include"../buffer/buffer.h"
+#include"../buffer/ringbuffer.h"
 #include"../log/log.h"
+#include"../log/accesslog.h"
 #include"httprequest.h"
 #include"httpresponse.h"
+#include"outputqueue.h"
+#include"../timer/timer.h"
 
 class HttpConnection
 {
@@ -19,43 +27,154 @@ public:
     //处理http连接
     void initHttpConn(int fd, const sockaddr_in& addr);
     void closeHttpConn();
-    bool handleHttpConn();
+    //解析读缓冲区里所有完整的请求（流水线），按顺序生成应答，返回是否有应答要发送
+    //inlineOnly时只处理能从内存直接应答的请求：遇到要读盘、用sendfile发送或者带消息体的请求就停下，
+    //这个请求保留为已解析状态（hasDeferred），下次不带inlineOnly调用时从它继续
+    bool handleHttpConn(bool inlineOnly = false);
 
-    //读写socket
+    //读写socket；ET模式下读缓冲区超过READ_BUDGET就不再继续读，剩下的留在socket里等这些请求处理完
     ssize_t readBuffer(int* Errno);
+    //发送这一批应答，直到发完、socket写满（返回-1，Errno为EAGAIN）或者出错，LT和ET模式一样
     ssize_t writeBuffer(int* Errno);
 
+    //io_uring模式：recv完成后把数据放入读缓冲区（读缓冲区放不下时返回false），send全部完成后重置写状态
+    bool appendReadBuffer(const char* data, size_t len);
+    //io_uring模式下连接在线程池里处理时，reactor线程收到的数据先暂存，交回reactor线程后再接到读缓冲区后面
+    void stageRead(const char* data, size_t len);
+    bool unstageRead();
+    //还没发送的iov，已经发送了len字节后用advanceWrite跳过
+    //getIovCnt只算到下一个sendfile发送的文件之前，最多IOV_MAX个，hasFileToSend表示这一批里还有这样的文件
+    struct iovec* getIov();
+    int getIovCnt() const;
+    bool hasFileToSend() const;
+    void advanceWrite(size_t len);
+    void finishWrite();
+
     //获取数据
     const char* getIp() const;
     int getPort() const;
     int getFd() const;
     sockaddr_in getAddr() const;
 
-    int writeBytes() const
+    size_t writeBytes() const
+    {
+        return m_output.bytes();
+    }
+
+    size_t readBytes() const
+    {
+        return m_useRing ? m_readRing.readableBytes() : m_readBuffer.readableBytes();
+    }
+
+    //这一批的应答数
+    int responseCount() const
+    {
+        return m_responseCnt;
+    }
+
+    //这个连接上处理过的请求数，关闭时写进日志，用来确认长连接确实被复用
+    int requestCount() const
+    {
+        return m_requestCnt;
+    }
+
+    //应答发完、没有未处理的数据时调用：缓冲区还给本线程的空闲链表，流水线留下的应答对象和数组也释放
+    //下次读到数据时再取，空闲的长连接只占槽本身
+    void releaseIdle();
+
+    //开始空闲的时间（毫秒），不空闲时为0
+    int64_t idleSince() const
+    {
+        return m_idleSince.load(std::memory_order_relaxed);
+    }
+
+    //有一个已经解析、等待在线程池里应答的请求
+    bool hasDeferred() const
     {
-        return m_iov[0].iov_len +  m_iov[1].iov_len;
+        return m_deferred;
     }
 
+    //最后一个应答是否保持连接，遇到要关闭连接的请求后不再处理后面的请求
     bool isKeepAlive() const
     {
-        return m_request.isKeepAlive();
+        return m_isKeepAlive;
+    }
+
+    //io_uring模式下由reactor维护：recv是否在途、在途的send数、是否等待关闭，以及在途sendmsg的参数
+    //working表示连接正在线程池里执行task，result和error是执行的结果，交回reactor线程后读取
+    struct UringState
+    {
+        bool recving;
+        int sending;
+        bool closing;
+        bool working;
+        int task;
+        ssize_t result;
+        int error;
+        struct msghdr msg;
+    };
+    UringState& uringState()
+    {
+        return m_uringState;
+    }
+
+    //超时计时器的节点，由所属reactor的时间轮管理
+    TimerNode* timerNode()
+    {
+        return &m_timerNode;
     }
 
     static bool isET;
+    //读缓冲区用镜像环形缓冲区，大的消息体和流水线请求不用整理成连续的
+    static bool useRing;
+    //镜像映射失败后退回块缓冲区的连接数
+    static std::atomic<size_t> ringFallbacks;
     static const char* srcDir;
     static std::atomic<size_t> userCount;
+    //每个连接最多处理的请求数，最后一个请求的应答带Connection: close，0表示不限制
+    static int maxRequests;
+    //一次最多处理的流水线请求数，剩下的等这批应答发完再处理
+    static const int MAX_PIPELINE = 16;
+    //每个连接读进来还没处理的数据的上限，正在接收的消息体不受限制
+    static constexpr size_t READ_BUDGET = 256 * 1024;
+    //空闲时保留的应答对象数
+    static const size_t IDLE_RESPONSES = 1;
 
 private:
+    bool fallBackToSlabs(size_t len);
+    //能在reactor线程直接应答时返回缓存里的文件，否则返回空
+    FilePtr inlineFile() const;
+    bool parseRequest();
+
     int m_fd;
     struct sockaddr_in m_addr;
     bool m_isClosed;
 
-    int m_iovCnt;
-    struct iovec m_iov[2];
+    //一批应答按顺序排成的段：头部块、写缓冲区里的动态头部、小文件映射的内存或内置的错误内容、大文件
+    OutputQueue m_output;
 
     Buffer m_readBuffer;
+    RingBuffer m_readRing;  //m_useRing时代替m_readBuffer
+    //连接开始时取useRing；镜像映射建不了时这个连接退回m_readBuffer
+    bool m_useRing;
     Buffer m_writeBuffer;
+    //io_uring模式下在线程池里处理期间收到的数据
+    Buffer m_readStage;
 
     HttpRequest m_request;
-    HttpResponse m_response;
+    //当前请求的完整路径（srcDir + 请求路径），每个请求重新赋值，容量保留，不再每次申请临时字符串
+    std::string m_fullPath;
+    //deque扩容时不移动已有元素，应答里映射的文件指针不会被复制；容量保留下次复用
+    std::deque<HttpResponse> m_responses;
+    int m_responseCnt;
+    int m_requestCnt;
+    bool m_isKeepAlive;
+    bool m_deferred;
+    //访问日志里请求开始处理的时间，0表示还没有开始的请求
+    int64_t m_requestStart;
+    //reactor线程挑选要关闭的空闲连接时读取
+    std::atomic<int64_t> m_idleSince;
+
+    UringState m_uringState;
+    TimerNode m_timerNode;
 };
@@ -4,86 +4,167 @@ const std::unordered_set<std::string> HttpRequest::DEFAULT_HTML{
     "/index","/welcome","/video","/picture"
 };
 
+//不区分大小写比较
+static bool equalsIgnoreCase(std::string_view a, std::string_view b)
+{
+    if(a.size() != b.size())
+        return false;
+    for(size_t i = 0; i < a.size(); i++)
+    {
+        if(tolower(static_cast<unsigned char>(a[i])) != tolower(static_cast<unsigned char>(b[i])))
+            return false;
+    }
+    return true;
+}
+
+//逗号分隔的token列表（如Connection头部）里是否有token，不区分大小写
+static bool hasToken(std::string_view list, std::string_view token)
+{
+    while(!list.empty())
+    {
+        size_t comma = list.find(',');
+        std::string_view item = list.substr(0, comma);
+        while(!item.empty() && (item.front() == ' ' || item.front() == '\t'))
+            item.remove_prefix(1);
+        while(!item.empty() && (item.back() == ' ' || item.back() == '\t'))
+            item.remove_suffix(1);
+        if(equalsIgnoreCase(item, token))
+            return true;
+        if(comma == std::string_view::npos)
+            break;
+        list.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
 //初始化字段和容器
 void HttpRequest::init()
 {
-    m_method = m_path = m_version = m_body = "";
     m_state = REQUEST_LINE;
-    m_header.clear();
-    m_post.clear();
+    m_base = nullptr;
+    m_lineOff = m_scanOff = 0;
+    m_bodyOff = m_bodyLen = 0;
+    m_method = m_target = m_version = {0, 0};
+    m_fields.clear();
+    m_path.clear();
+    m_isKeepAlive = false;
+}
+
+bool HttpRequest::isFinish() const
+{
+    return m_state == FINISH;
+}
+
+size_t HttpRequest::expectedSize() const
+{
+    return m_state == BODY ? m_bodyOff + m_bodyLen : 0;
+}
+
+void HttpRequest::releaseMemory()
+{
+    init();
+    if(m_fields.capacity() > IDLE_FIELDS)
+        std::vector<Field>().swap(m_fields);
+    m_path.shrink_to_fit();
 }
 
-//查看头部的connection和m_version是否符合
 bool HttpRequest::isKeepAlive() const
 {
-    if(m_header.count("Connection"))
-        return m_header.find("Connection")->second == "keep-alive" && m_version == "1.1";
-    return false;
+    return m_isKeepAlive;
 }
 
-//用正则表达式匹配请求行，格式是方法、路径、版本，eg: GET /qq/abc.html HTTP/1.1
-bool HttpRequest::parseRequestLine(const std::string& line)
+std::string_view HttpRequest::view(const Span& span) const
 {
-    //第一个^表示开始，$表示结尾，([^ ]*)表示非空字符组
-    std::regex pattern("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");
-    std::smatch submatch;
-    if(regex_match(line, submatch, pattern))
-    {
-        m_method = submatch[1];//0是完整结果，所以从1开始
-        m_path = submatch[2];
-        m_version = submatch[3];
-        m_state = HEADERS; //状态转移至头部
-        return true;
-    }
-    LOG_ERROR("RequestLine Error");
-    return false;
+    if(span.len == 0)
+        return std::string_view();
+    return std::string_view(m_base + span.offset, span.len);
 }
 
-//用正则表达式匹配头部，格式是key: value，eg: Host: www.baidu.com
-void HttpRequest::parseHeader(const std::string& line)
+//请求行，格式是方法、路径、版本，eg: GET /qq/abc.html HTTP/1.1
+bool HttpRequest::parseRequestLine(const char* begin, const char* end)
 {
-    //先匹配:前的非:字符，然后再匹配:后面的任意字符
-    std::regex pattern("^([^:]*): ?(.*)$");
-    std::smatch submatch;
-    if(regex_match(line, submatch, pattern))
+    //方法是token
+    const char* p = HttpScan::skipToken(begin, end);
+    if(p == begin || p == end || *p != ' ')
     {
-        m_header[submatch[1]] = submatch[2];
+        LOG_ERROR("RequestLine Error");
+        return false;
     }
-    else
+    m_method = {static_cast<uint32_t>(begin - m_base), static_cast<uint32_t>(p - begin)};
+
+    //请求目标，直到下一个空格，找行尾时已经确认了这一行没有控制字符
+    const char* target = ++p;
+    p = static_cast<const char*>(memchr(target, ' ', end - target));
+    if(p == nullptr || p == target || memchr(target, '\t', p - target) != nullptr)
     {
-        m_state = BODY;//状态转移至消息体
+        LOG_ERROR("RequestLine Error");
+        return false;
     }
+    m_target = {static_cast<uint32_t>(target - m_base), static_cast<uint32_t>(p - target)};
+
+    //版本，HTTP/x.y，也接受HTTP/x
+    p++;
+    size_t len = end - p;
+    if(len < 6 || memcmp(p, "HTTP/", 5) != 0 || !isdigit(p[5]) ||
+       !(len == 6 || (len == 8 && p[6] == '.' && isdigit(p[7]))))
+    {
+        LOG_ERROR("RequestLine Error");
+        return false;
+    }
+    m_version = {static_cast<uint32_t>(p + 5 - m_base), static_cast<uint32_t>(len - 5)};
+    return true;
 }
 
-//消息体的数据没有固定格式，全部保存到m_body里，在m_post里解析
-void HttpRequest::parseBody(const std::string& line)
+//头部，格式是key: value，eg: Host: www.baidu.com，value前后的空白不算
+bool HttpRequest::parseHeader(const char* begin, const char* end)
 {
-    m_body = line;
-    parsePost();
-    m_state = FINISH;
-    LOG_DEBUG("Body:%s, len:%d", line.c_str(), line.size());
+    const char* p = HttpScan::skipToken(begin, end);
+    //名字和冒号之间不允许有空白
+    if(p == begin || p == end || *p != ':')
+        return false;
+    if(m_fields.size() >= MAX_HEADER_COUNT)
+        return false;
+    const char* value = p + 1;
+    while(value < end && (*value == ' ' || *value == '\t'))
+        value++;
+    const char* valueEnd = end;
+    while(valueEnd > value && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t'))
+        valueEnd--;
+    Field field;
+    field.name = {static_cast<uint32_t>(begin - m_base), static_cast<uint32_t>(p - begin)};
+    field.value = {static_cast<uint32_t>(value - m_base), static_cast<uint32_t>(valueEnd - value)};
+    m_fields.push_back(field);
+    return true;
 }
 
-//解析m_post数据，格式为key=value，每条数据用&隔开
-void HttpRequest::parsePost()
+//由Content-Length确定消息体长度，不支持分块传输
+bool HttpRequest::parseBodyLength()
 {
-    if(m_method == "POST" && m_header["Content-Type"]  == "application/x-www-form-urlencoded")
+    m_bodyLen = 0;
+    if(!getHeader("Transfer-Encoding").empty())
+        return false;
+    std::string_view len = getHeader("Content-Length");
+    if(len.empty())
+        return true;
+    for(char c : len)
     {
-        std::regex pattern("(?!&)(.*?)=(.*?)(?=&|$)");
-        std::smatch submatch;
-        std::string::const_iterator beg = m_body.begin();
-        std::string::const_iterator end = m_body.end();
-        while(std::regex_search(beg, end, submatch, pattern))
-        {
-            m_post[submatch[1]] = submatch[2];
-            beg = submatch[0].second;
-        }
+        if(!isdigit(static_cast<unsigned char>(c)))
+            return false;
+        m_bodyLen = m_bodyLen * 10 + (c - '0');
+        if(m_bodyLen > MAX_BODY_SIZE)
+            return false;
     }
+    return true;
 }
 
-//给请求的路径加上html
+//由请求目标得到文件路径，去掉查询参数，给默认页面加上html
 void HttpRequest::parsePath()
 {
+    std::string_view target = view(m_target);
+    size_t query = target.find('?');
+    if(query != std::string_view::npos)
+        target = target.substr(0, query);
+    m_path.assign(target.data(), target.size());
     if(m_path == "/")
     {
         m_path = "/index.html";
@@ -98,41 +179,159 @@ void HttpRequest::parsePath()
 //主解析函数
 bool HttpRequest::parse(Buffer& buff)
 {
-    const char* CRLF = "\r\n";
+    size_t consumed = 0;
     if(buff.readableBytes() <= 0)
         return false;
-    while(buff.readableBytes() && m_state != FINISH)
+    //请求跨块时先整理成连续的，解析器用相对请求开头的偏移记录进度，数据搬动后依然有效
+    const char* begin = buff.linearize();
+    if(!parse(begin, begin + buff.readableBytes(), consumed))
+        return false;
+    //请求完整，后移read指针
+    if(consumed > 0)
+        buff.updateReadPtr(consumed);
+    return true;
+}
+
+//镜像映射里的可读数据总是连续的，不用整理
+bool HttpRequest::parse(RingBuffer& buff)
+{
+    size_t consumed = 0;
+    if(buff.readableBytes() <= 0)
+        return false;
+    const char* begin = buff.curReadPtr();
+    if(!parse(begin, begin + buff.readableBytes(), consumed))
+        return false;
+    if(consumed > 0)
+        buff.updateReadPtr(consumed);
+    //知道消息体长度后一次扩大到能放下整个请求，不用一路翻倍拷贝；扩大失败时留给readFd处理
+    else if(expectedSize() > buff.capacity())
+        buff.ensureWriteable(expectedSize() - buff.readableBytes());
+    return true;
+}
+
+bool HttpRequest::parse(const char* begin, const char* end, size_t& consumed)
+{
+    consumed = 0;
+    //上一个请求已经解析完，开始新的请求
+    if(m_state == FINISH)
+        init();
+    //缓冲区可能被整理过，重新定位请求的开头
+    m_base = begin;
+    size_t size = end - begin;
+    while(m_state != FINISH)
     {
-        //在缓冲区里查找crlf
-        const char* lineEnd = std::search(buff.curReadPtr(), buff.curWritePtrConst(), CRLF, CRLF + 2);
-        //获取缓冲区的数据
-        std::string line(buff.curReadPtr(), lineEnd);
+        if(m_state == BODY)
+        {
+            //等待剩余的消息体
+            if(size < m_bodyOff + m_bodyLen)
+                return true;
+            m_state = FINISH;
+            break;
+        }
+        if(m_lineOff > MAX_HEADER_SIZE)
+        {
+            LOG_ERROR("Request header too large");
+            return false;
+        }
+        //从上次扫描停下的位置继续找行尾，遇到的第一个控制字符必须是\r\n里的\r
+        //所以找到行尾时这一行的字符也检查完了
+        const char* lineBegin = begin + m_lineOff;
+        const char* lineEnd = HttpScan::findCtl(begin + m_scanOff, end);
+        if(lineEnd < end && (*lineEnd != '\r' || (lineEnd + 1 < end && lineEnd[1] != '\n')))
+        {
+            LOG_ERROR("Invalid character in request header");
+            return false;
+        }
+        if(lineEnd + 1 >= end)
+        {
+            //最后一个字节可能是\r，下次从它开始找
+            m_scanOff = lineEnd - begin;
+            if(size > MAX_HEADER_SIZE)
+            {
+                LOG_ERROR("Request header too large");
+                return false;
+            }
+            return true;
+        }
         switch(m_state)
         {
             case REQUEST_LINE:
-                if(!parseRequestLine(line))
+                if(!parseRequestLine(lineBegin, lineEnd))
                     return false;
-                parsePath();
+                m_state = HEADERS;
                 break;
             case HEADERS:
-                parseHeader(line);
-                if(buff.readableBytes() <= 2)//只剩换crlf了，是get方法
-                    m_state = FINISH;
-                break;
-            case BODY:
-                parseBody(line);
+                //空行，头部结束
+                if(lineEnd == lineBegin)
+                {
+                    m_bodyOff = lineEnd + 2 - begin;
+                    if(!parseBodyLength())
+                        return false;
+                    m_state = m_bodyLen > 0 ? BODY : FINISH;
+                }
+                else if(!parseHeader(lineBegin, lineEnd))
+                {
+                    return false;
+                }
                 break;
             default:
                 break;
         }
-        if(lineEnd == buff.curWritePtr())
-            break;
-        buff.updateReadPtrUntilEnd(lineEnd + 2);//后移read指针
+        m_lineOff = m_scanOff = lineEnd + 2 - begin;
     }
-    LOG_DEBUG("[%s], [%s], [%s]", m_method.c_str(), m_path.c_str(), m_version.c_str());
+    parsePath();
+    //HTTP/1.1及以后默认保持连接，除非Connection里有close；HTTP/1.0要有keep-alive才保持
+    std::string_view connection = getHeader("Connection");
+    std::string_view version = view(m_version);
+    if(hasToken(connection, "close"))
+        m_isKeepAlive = false;
+    else if(version[0] > '1' || (version[0] == '1' && version.size() == 3 && version[2] >= '1'))
+        m_isKeepAlive = true;
+    else
+        m_isKeepAlive = hasToken(connection, "keep-alive");
+    consumed = m_bodyOff + m_bodyLen;
+    LOG_DEBUG("[%.*s], [%s], [%.*s]", (int)m_method.len, m_base + m_method.offset, m_path.c_str(),
+              (int)m_version.len, m_base + m_version.offset);
     return true;
 }
 
+std::string_view HttpRequest::getHeader(std::string_view key) const
+{
+    for(const Field& field : m_fields)
+    {
+        if(equalsIgnoreCase(view(field.name), key))
+            return view(field.value);
+    }
+    return std::string_view();
+}
+
+std::string_view HttpRequest::getBody() const
+{
+    if(m_bodyLen == 0)
+        return std::string_view();
+    return std::string_view(m_base + m_bodyOff, m_bodyLen);
+}
+
+//在表单格式的消息体里查找key，格式为key=value，每条数据用&隔开
+std::string_view HttpRequest::findPost(std::string_view key) const
+{
+    if(view(m_method) != "POST" || getHeader("Content-Type") != "application/x-www-form-urlencoded")
+        return std::string_view();
+    std::string_view body = getBody();
+    while(!body.empty())
+    {
+        size_t amp = body.find('&');
+        std::string_view pair = body.substr(0, amp);
+        size_t eq = pair.find('=');
+        if(eq != std::string_view::npos && pair.substr(0, eq) == key)
+            return pair.substr(eq + 1);
+        if(amp == std::string_view::npos)
+            break;
+        body.remove_prefix(amp + 1);
+    }
+    return std::string_view();
+}
+
 //以下函数用于测试
 
 std::string HttpRequest::getPath() const
@@ -147,26 +346,22 @@ std::string& HttpRequest::getPath()
 
 std::string HttpRequest::getMethod() const
 {
-    return m_method;
+    return std::string(view(m_method));
 }
 
 std::string HttpRequest::getVersion() const
 {
-    return m_version;
+    return std::string(view(m_version));
 }
 
 std::string HttpRequest::getPost(const std::string& key) const
 {
     assert(!key.empty());
-    if(m_post.count(key))
-        return m_post.find(key)->second;
-    return "";    
+    return std::string(findPost(key));
 }
 
 std::string HttpRequest::getPost(const char* key) const
 {
     assert(key != nullptr);
-    if(m_post.count(key))
-        return m_post.find(key)->second;
-    return "";    
+    return std::string(findPost(key));
 }
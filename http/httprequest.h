@@ -1,23 +1,36 @@
 #pragma once
 #include<string>
-#include<unordered_map>
+#include<string_view>
+#include<vector>
 #include<unordered_set>
-#include<regex>
+#include<stdint.h>
 #include"../buffer/buffer.h"
+#include"../buffer/ringbuffer.h"
 #include"../log/log.h"
+#include"httpscan.h"
 
 class HttpRequest
 {
 public:
     enum PARSE_STATE{REQUEST_LINE, HEADERS, BODY, FINISH};
-    
+
 public:
     HttpRequest() {init();}
     ~HttpRequest() = default;
 
 public:
     void init();
+    //增量解析：数据不完整时返回true且isFinish()为false，下次调用从上次停下的位置继续；格式错误返回false
+    //请求完整后从buff里取走这个请求。解析结果指向buff里的数据，在下次往buff写入数据前有效
     bool parse(Buffer& buff);
+    bool parse(RingBuffer& buff);
+    //在[begin, end)上解析，begin是请求的开头，consumed返回完整请求的长度（不完整时为0）
+    bool parse(const char* begin, const char* end, size_t& consumed);
+    bool isFinish() const;
+    //消息体长度已知、还没收完时返回整个请求的长度，否则返回0
+    size_t expectedSize() const;
+    //连接空闲时调用：重置状态，头部很多时留下的数组释放掉
+    void releaseMemory();
 
     std::string getPath() const;
     std::string& getPath();
@@ -25,22 +38,65 @@ public:
     std::string getVersion() const;
     std::string getPost(const std::string& key) const;
     std::string getPost(const char* key) const;
+    //头部字段，名字不区分大小写，不存在时返回空
+    std::string_view getHeader(std::string_view key) const;
+    std::string_view getBody() const;
 
+    //按版本和Connection头部判断请求后是否保持连接
     bool isKeepAlive() const;
 
+    //请求行的原始内容，version不带"HTTP/"，和getHeader一样在下次往buff写入数据前有效
+    std::string_view method() const
+    {
+        return view(m_method);
+    }
+    std::string_view target() const
+    {
+        return view(m_target);
+    }
+    std::string_view version() const
+    {
+        return view(m_version);
+    }
+
 private:
-    bool parseRequestLine(const std::string& line);
-    void parseHeader(const std::string& line);
-    void parseBody(const std::string& line);
+    //请求里的一段数据，用相对请求开头的偏移表示，缓冲区整理（数据搬到数组前面）后依然有效
+    struct Span
+    {
+        uint32_t offset;
+        uint32_t len;
+    };
+    struct Field
+    {
+        Span name;
+        Span value;
+    };
 
+    bool parseRequestLine(const char* begin, const char* end);
+    bool parseHeader(const char* begin, const char* end);
+    bool parseBodyLength();
     void parsePath();
-    void parsePost();
+
+    std::string_view view(const Span& span) const;
+    std::string_view findPost(std::string_view key) const;
+
+    static const size_t MAX_HEADER_SIZE = 16384;    //请求行和头部的最大长度
+    static const size_t MAX_HEADER_COUNT = 100;
+    static const size_t IDLE_FIELDS = 32;           //空闲时保留的头部数组容量
+    static const size_t MAX_BODY_SIZE = 8 * 1024 * 1024;
 
     PARSE_STATE m_state;
-    std::string m_method, m_path, m_version, m_body;    //都是字符串
-    std::unordered_map<std::string, std::string> m_header;    //k：v类型的对
-    std::unordered_map<std::string, std::string> m_post;
+    const char* m_base;     //当前请求的开头
+    size_t m_lineOff;       //当前行的开头
+    size_t m_scanOff;       //下次查找行尾的位置，已经扫描过的数据不再重复扫描
+    size_t m_bodyOff;
+    size_t m_bodyLen;
+
+    Span m_method, m_target, m_version;
+    std::vector<Field> m_fields;    //头部字段，clear后保留容量，重复使用不再申请内存
+    std::string m_path;             //解析完成后由target生成的文件路径，同样重复使用
+    bool m_isKeepAlive;
 
     static const std::unordered_set<std::string> DEFAULT_HTML;
 
-};
\ No newline at end of file
+};
@@ -35,42 +35,68 @@ const std::unordered_map<int, std::string> HttpResponse::CODE_PATH = {
     { 404, "/404.html" },
 };
 
+int HttpResponse::keepAliveTimeout;
+
+const int HttpResponse::BLOCK_CODES[CachedFile::HEAD_BLOCK_SLOTS / 2] = {200, 400, 403, 404};
+
 HttpResponse::HttpResponse()
 {
     m_code = -1;
-    m_path = m_srcDir = "";
+    m_path = nullptr;
+    m_srcDir = nullptr;
     m_isKeepAlive = false;
-    m_mmFile = nullptr;
-    m_mmFileStat = {0};
+    m_keepAliveMax = 0;
+    m_head = nullptr;
+    m_canned = nullptr;
 }
 
 HttpResponse::~HttpResponse()
 {
-    unmapFile();
 }
 
-void HttpResponse::init(const std::string& srcDir, std::string& path, bool isKeepAlive, int code)
+void HttpResponse::init(const char* srcDir, std::string& path, bool isKeepAlive, int code, int keepAliveMax, FilePtr file)
 {
-    assert(srcDir != "");
-    if(m_mmFile)
-        unmapFile();
+    assert(srcDir && *srcDir);
+    m_file = std::move(file);
+    m_head = nullptr;
+    m_canned = nullptr;
     m_srcDir = srcDir;
-    m_path = path;
+    m_path = &path;
     m_isKeepAlive = isKeepAlive;
+    m_keepAliveMax = keepAliveMax;
     m_code = code;
-    m_mmFileStat = {0};
+}
+
+std::string_view HttpResponse::head() const
+{
+    return m_head ? std::string_view(*m_head) : std::string_view();
+}
+
+std::string_view HttpResponse::cannedBody() const
+{
+    return m_canned ? std::string_view(m_canned->body) : std::string_view();
 }
 
 //返回文件映射的内存区域
-char* HttpResponse::file()
+const char* HttpResponse::file() const
+{
+    return m_file ? m_file->data : nullptr;
+}
+
+int HttpResponse::fileFd() const
 {
-    return m_mmFile;
+    return m_file ? m_file->fd : -1;
 }
 
 //返回文件大小
 size_t HttpResponse::fileLen() const
 {
-    return m_mmFileStat.st_size;
+    return m_file ? m_file->size : 0;
+}
+
+size_t HttpResponse::bodyLen() const
+{
+    return fileLen() + cannedBody().size();
 }
 
 //4开头的http状态，无法满足，返回对应html网页
@@ -78,95 +104,119 @@ void HttpResponse::errorHtml()
 {
     if(CODE_PATH.count(m_code))
     {
-        m_path = CODE_PATH.find(m_code)->second;
-        stat((m_srcDir + m_path).data(), &m_mmFileStat);
+        m_path->assign(m_srcDir).append(CODE_PATH.find(m_code)->second);
+        m_file = FileCache::instance()->get(*m_path);
     }
 }
 
 //添加状态行，eg: HTTP/1.1 200 ok
-void HttpResponse::addStateLine(Buffer& buff)
+void HttpResponse::addStateLine(std::string& head, int code) const
 {
-    std::string status;
-    if(CODE_STATUS.count(m_code))
-    {
-        status = CODE_STATUS.find(m_code)->second;
-    }
-    else    //其他状态均返回bad request
-    {
-        m_code = 400;
-        status = CODE_STATUS.find(m_code)->second;
-    }
-    buff.append("HTTP/1.1 " + std::to_string(m_code) + " " + status + "\r\n");
+    head += "HTTP/1.1 ";
+    head += std::to_string(code);
+    head += " ";
+    head += CODE_STATUS.find(code)->second;
+    head += "\r\n";
 }
 
-//http响应头，包括Connection和Content-type字段
-void HttpResponse::addResponseHeader(Buffer& buff)
+//http响应头，包括Connection、Content-type和Content-length字段
+void HttpResponse::addResponseHeader(std::string& head, const std::string& mimeType, size_t contentLength) const
 {
-    buff.append("Connection: ");
-    if(m_isKeepAlive)
+    head += m_isKeepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+    head += "Content-type: " + mimeType + "\r\n";
+    head += "Content-length: " + std::to_string(contentLength) + "\r\n";
+}
+
+//每个应答都不同的头部：Keep-Alive、Date和结尾的空行，Date每秒只格式化一次
+//Keep-Alive里的max是连接剩下的请求数，每个应答不同，不能放在缓存的头部块里
+void HttpResponse::addDynamicHeader(Buffer& buff) const
+{
+    if(m_isKeepAlive && (keepAliveTimeout > 0 || m_keepAliveMax > 0))
     {
-        buff.append("keep-alive\r\n");
-        buff.append("keep-alive: max=6, timeout=120\r\n");
+        char keepAlive[64];
+        int len;
+        if(keepAliveTimeout > 0 && m_keepAliveMax > 0)
+            len = snprintf(keepAlive, sizeof(keepAlive), "Keep-Alive: timeout=%d, max=%d\r\n", keepAliveTimeout, m_keepAliveMax);
+        else if(keepAliveTimeout > 0)
+            len = snprintf(keepAlive, sizeof(keepAlive), "Keep-Alive: timeout=%d\r\n", keepAliveTimeout);
+        else
+            len = snprintf(keepAlive, sizeof(keepAlive), "Keep-Alive: max=%d\r\n", m_keepAliveMax);
+        buff.append(keepAlive, len);
     }
-    else
+    static thread_local time_t last = 0;
+    static thread_local char date[64];
+    static thread_local size_t dateLen = 0;
+    time_t now = time(nullptr);
+    if(now != last)
     {
-        buff.append("close\r\n");
+        struct tm tm;
+        gmtime_r(&now, &tm);
+        dateLen = strftime(date, sizeof(date), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n\r\n", &tm);
+        last = now;
     }
-    buff.append("Content-type: " + getFileType() + "\r\n");
+    buff.append(date, dateLen);
 }
 
-//回应的内容（文件），进行mmap把文件从磁盘映射到内存，减少系统调用
-void HttpResponse::addResponseContent(Buffer& buff)
+//文件的头部块，第一次用到时生成，多个线程同时生成时只保留一个
+const std::string* HttpResponse::headerBlock()
 {
-    int srcFd = open((m_srcDir + m_path).data(), O_RDONLY);
-    if(srcFd < 0)
-    {
-        errorContent(buff, "File Not Found");
-        return;
-    }
-    LOG_DEBUG("file path %s", (m_srcDir + m_path).data());
-    //将文件srcFd映射到mmRet
-    int* mmRet = (int*)mmap(0, m_mmFileStat.st_size, PROT_READ, MAP_PRIVATE, srcFd, 0);
-    if(*mmRet == -1)
+    int slot = -1;
+    for(int i = 0; i < CachedFile::HEAD_BLOCK_SLOTS / 2; i++)
     {
-        errorContent(buff, "File Not Found");
-        return;
+        if(BLOCK_CODES[i] == m_code)
+            slot = i * 2 + m_isKeepAlive;
     }
-    m_mmFile = (char*)mmRet;
-    close(srcFd);
-    buff.append("Content-length: " + std::to_string(m_mmFileStat.st_size) + "\r\n\r\n");
+    assert(slot >= 0);
+    const std::string* block = m_file->headBlocks[slot].load(std::memory_order_acquire);
+    if(block)
+        return block;
+    std::string* head = new std::string();
+    addStateLine(*head, m_code);
+    addResponseHeader(*head, m_file->mimeType, m_file->size);
+    if(m_file->headBlocks[slot].compare_exchange_strong(block, head, std::memory_order_acq_rel))
+        return head;
+    delete head;
+    return block;
 }
 
-//4开头的状态返回的内容
-void HttpResponse::errorContent(Buffer& buff, std::string message)
+//错误页面也没法发送时的内置应答，静态生成，所有线程共用
+const HttpResponse::Canned* HttpResponse::cannedResponse()
 {
-    std::string body;
-    std::string status;
-    body += "<html><title>Error</title>";
-    body += "<body bgcolor=\"ffffff\"";
-    if(CODE_STATUS.count(m_code))
+    static const Canned* table = []()
     {
-        status = CODE_STATUS.find(m_code)->second;
-    }
-    else
+        static Canned canned[CachedFile::HEAD_BLOCK_SLOTS];
+        HttpResponse response;
+        for(int i = 0; i < CachedFile::HEAD_BLOCK_SLOTS; i++)
+        {
+            int code = BLOCK_CODES[i / 2];
+            Canned& c = canned[i];
+            c.body += "<html><title>Error</title>";
+            c.body += "<body bgcolor=\"ffffff\">";
+            c.body += std::to_string(code) + " : " + CODE_STATUS.find(code)->second + "\n";
+            c.body += "<p>File Not Found</p>";
+            c.body += "<hr><em>WebServer</em></body></html>";
+            response.m_isKeepAlive = i % 2;
+            response.addStateLine(c.head, code);
+            response.addResponseHeader(c.head, "text/html", c.body.size());
+        }
+        return canned;
+    }();
+    //内置应答只有错误码，原来的200按找不到文件处理
+    if(m_code == 200)
+        m_code = 404;
+    for(int i = 0; i < CachedFile::HEAD_BLOCK_SLOTS / 2; i++)
     {
-        status = "Bad Request";
+        if(BLOCK_CODES[i] == m_code)
+            return &table[i * 2 + m_isKeepAlive];
     }
-    body += std::to_string(m_code) + " : " + status + "\n";
-    body += "<p>" + message + "</p>";
-    body += "<hr><em>WebServer</em></body></html>";
-
-    buff.append("Content-length: " + std::to_string(body.size()) + "\r\n\r\n");
-    buff.append(body);
+    return &table[2 + m_isKeepAlive];
 }
 
-void HttpResponse::unmapFile()
+void HttpResponse::releaseFile()
 {
-    if(m_mmFile)
-    {
-        munmap(m_mmFile, m_mmFileStat.st_size);
-        m_mmFile = nullptr;
-    }
+    m_file.reset();
+    m_head = nullptr;
+    m_canned = nullptr;
 }
 
 int HttpResponse::code() const
@@ -175,15 +225,15 @@ int HttpResponse::code() const
 }
 
 //文件类型
-std::string HttpResponse::getFileType()
+std::string HttpResponse::fileType(const std::string& path)
 {
-    std::string::size_type index = m_path.find_last_of('.');
+    std::string::size_type index = path.find_last_of('.');
     //没有后缀，返回空白文件
     if(index == std::string::npos)
     {
         return "text/plain";
     }
-    std::string suffix = m_path.substr(index);
+    std::string suffix = path.substr(index);
     if(SUFFIX_TYPE.count(suffix))
     {
         return SUFFIX_TYPE.find(suffix)->second;
@@ -191,15 +241,17 @@ std::string HttpResponse::getFileType()
     return "text/plain";
 }
 
-//判断需求文件能否满足，构造http应答
+//判断需求文件能否满足，选出头部块，动态头部写入buff
 void HttpResponse::makeResponse(Buffer& buff)
 {
     //找不到指定文件，或者目标是目录
-    if(stat((m_srcDir + m_path).data(), &m_mmFileStat) < 0 || S_ISDIR(m_mmFileStat.st_mode))
+    if(!m_file)
+        m_file = FileCache::instance()->get(*m_path);
+    if(!m_file)
     {
         m_code = 404;
     }
-    else if(!(m_mmFileStat.st_mode & S_IROTH))
+    else if(!(m_file->mode & S_IROTH))
     {
         m_code = 403;
     }
@@ -208,7 +260,22 @@ void HttpResponse::makeResponse(Buffer& buff)
         m_code = 200;
     }
     errorHtml();
-    addStateLine(buff);
-    addResponseHeader(buff);
-    addResponseContent(buff);
+    //其他状态均返回bad request
+    if(!CODE_STATUS.count(m_code))
+    {
+        m_code = 400;
+    }
+    //文件能发送就用它的头部块，否则用内置的错误应答
+    if(m_file && (m_file->data || m_file->fd >= 0 || m_file->size == 0))
+    {
+        m_head = headerBlock();
+    }
+    else
+    {
+        m_file.reset();
+        m_canned = cannedResponse();
+        m_head = &m_canned->head;
+    }
+    LOG_DEBUG("file path %s, code %d", m_path->c_str(), m_code);
+    addDynamicHeader(buff);
 }
@@ -1,13 +1,19 @@
 #pragma once
+#include<stdio.h>
 #include<unordered_map>
+#include<string_view>
 #include<fcntl.h>
 #include<unistd.h>
+#include<time.h>
 #include<sys/stat.h>
 #include<sys/mman.h>
 #include<assert.h>
 #include"../buffer/buffer.h"
 #include"../log/log.h"
+#include"filecache.h"
 
+//应答分成三部分：不可变的头部块、写入缓冲区的动态头部（Keep-Alive、Date和空行）、内容
+//头部块按(文件, 状态码, 是否长连接)生成一次后缓存在文件项里，发送时用iov直接指向它
 class HttpResponse
 {
 public:
@@ -15,34 +21,64 @@ public:
     ~HttpResponse();
 
 public:
-    void init(const std::string& srcDir, std::string& path, bool isKeepAlive = false, int code = -1);
+    //path是以srcDir开头的完整路径，由连接提供并重复使用，不拷贝；makeResponse返回前有效，出错时改成错误页面的路径
+    //file是已经从缓存里取到的文件（FileCache::getHot），为空时makeResponse再去取
+    //keepAliveMax是这个连接还能处理的请求数，写进Keep-Alive头部，0表示不限制
+    void init(const char* srcDir, std::string& path, bool isKeepAlive = false, int code = -1, int keepAliveMax = 0,
+              FilePtr file = nullptr);
+    //确定状态码、头部块和内容，把动态头部写入buff
     void makeResponse(Buffer& buff);
-    char* file();
+    //状态行和固定的头部，不含结尾的空行，releaseFile之前有效
+    std::string_view head() const;
+    //找不到错误页面时使用的内置内容，没有时为空
+    std::string_view cannedBody() const;
+    //小文件映射的内存，大文件为空
+    const char* file() const;
+    //大文件的fd，用sendfile发送，没有时为-1
+    int fileFd() const;
     size_t fileLen() const;
-    void unmapFile();
-    void errorContent(Buffer& buff, std::string message);
+    //消息体的长度，文件或内置的错误内容
+    size_t bodyLen() const;
+    //释放对缓存文件的引用
+    void releaseFile();
     int code() const;
 
+    //由文件后缀得到MIME类型
+    static std::string fileType(const std::string& path);
+
+    //Keep-Alive头部里的空闲超时（秒），和连接的超时计时器一致，0表示不发送
+    static int keepAliveTimeout;
+
 private:
-    void addStateLine(Buffer& buff);
-    void addResponseHeader(Buffer& buff);
-    void addResponseContent(Buffer& buff);
+    //内置的错误应答，每个状态码和是否长连接一份
+    struct Canned
+    {
+        std::string head;
+        std::string body;
+    };
 
+    void addStateLine(std::string& head, int code) const;
+    void addResponseHeader(std::string& head, const std::string& mimeType, size_t contentLength) const;
+    void addDynamicHeader(Buffer& buff) const;
+    const std::string* headerBlock();
+    const Canned* cannedResponse();
     void errorHtml();
-    std::string getFileType();
 
     //http状态码
     int m_code;
     //http是否保持
     bool m_isKeepAlive;
-    //解析得到的路径
-    std::string m_path;
+    int m_keepAliveMax;
+    //完整路径，指向连接的路径缓冲区
+    std::string* m_path;
     //根目录
-    std::string m_srcDir;
+    const char* m_srcDir;
 
-    //文件映射的区域
-    char* m_mmFile;
-    struct stat m_mmFileStat;
+    //要发送的文件，由FileCache共享，发送完之前一直持有
+    FilePtr m_file;
+    //头部块，属于m_file或者内置的错误应答
+    const std::string* m_head;
+    const Canned* m_canned;
 
     //文件后缀到文件夹的映射
     static const std::unordered_map<std::string, std::string> SUFFIX_TYPE;
@@ -50,4 +86,6 @@ private:
     static const std::unordered_map<int, std::string> CODE_STATUS;
     //状态码到对应html文件名的映射
     static const std::unordered_map<int, std::string> CODE_PATH;
+    //有预先生成头部块的状态码，下标和是否长连接一起决定CachedFile::headBlocks的槽位
+    static const int BLOCK_CODES[CachedFile::HEAD_BLOCK_SLOTS / 2];
 };
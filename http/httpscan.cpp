@@ -0,0 +1,254 @@
+#include"httpscan.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include<immintrin.h>
+#define HTTPSCAN_X86 1
+#endif
+
+//token字符表，见RFC 7230 3.2.6
+const bool HttpScan::TOKEN_MAP[256] = {
+    //0x00-0x1f 控制字符
+    0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,
+    //  ! " # $ % & ' ( ) * + , - . /
+    0,1,0,1,1,1,1,1, 0,0,1,1,0,1,1,0,
+    //0-9 : ; < = > ?
+    1,1,1,1,1,1,1,1, 1,1,0,0,0,0,0,0,
+    //@ A-O
+    0,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,
+    //P-Z [ \ ] ^ _
+    1,1,1,1,1,1,1,1, 1,1,1,0,0,0,1,1,
+    //` a-o
+    1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,
+    //p-z { | } ~ DEL
+    1,1,1,1,1,1,1,1, 1,1,1,0,1,0,1,0,
+    //0x80-0xff
+    0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,
+};
+
+static inline bool isCtl(unsigned char c)
+{
+    return (c < 0x20 && c != '\t') || c == 0x7f;
+}
+
+const char* HttpScan::findCtlScalar(const char* begin, const char* end)
+{
+    while(begin < end && !isCtl(static_cast<unsigned char>(*begin)))
+        begin++;
+    return begin;
+}
+
+const char* HttpScan::skipTokenScalar(const char* begin, const char* end)
+{
+    while(begin < end && isToken(static_cast<unsigned char>(*begin)))
+        begin++;
+    return begin;
+}
+
+#ifdef HTTPSCAN_X86
+
+//非token字符的区间，pcmpestri一次最多比较8个区间
+//'{'到0xff合成一个区间，其中的'|'和'~'是token字符，命中后逐字节确认
+alignas(16) static const char TOKEN_STOP_RANGES[] = "\x00 \"\"(),,//:@[]{\xff";
+
+//16个字节里控制字符的位置掩码，只用到SSE2，内联进AVX2函数时生成VEX编码，避免SSE/AVX切换的开销
+static inline __attribute__((always_inline)) int ctlMask16(const char* p)
+{
+    const __m128i ctlMax = _mm_set1_epi8(0x1f);
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    //无符号比较c <= 0x1f：max(c, 0x1f) == 0x1f
+    __m128i ctl = _mm_cmpeq_epi8(_mm_max_epu8(v, ctlMax), ctlMax);
+    ctl = _mm_andnot_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')), ctl);
+    ctl = _mm_or_si128(ctl, _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7f)));
+    return _mm_movemask_epi8(ctl);
+}
+
+__attribute__((target("sse4.2")))
+static const char* findCtlSse42(const char* begin, const char* end)
+{
+    while(end - begin >= 16)
+    {
+        int mask = ctlMask16(begin);
+        if(mask)
+            return begin + __builtin_ctz(mask);
+        begin += 16;
+    }
+    return HttpScan::findCtlScalar(begin, end);
+}
+
+__attribute__((target("sse4.2")))
+static const char* skipTokenSse42(const char* begin, const char* end)
+{
+    const __m128i ranges = _mm_load_si128(reinterpret_cast<const __m128i*>(TOKEN_STOP_RANGES));
+    while(end - begin >= 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+        int i = _mm_cmpestri(ranges, 16, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+        if(i == 16)
+        {
+            begin += 16;
+            continue;
+        }
+        begin += i;
+        if(!HttpScan::isToken(static_cast<unsigned char>(*begin)))
+            return begin;
+        begin++;
+    }
+    return HttpScan::skipTokenScalar(begin, end);
+}
+
+__attribute__((target("avx2")))
+static const char* findCtlAvx2(const char* begin, const char* end)
+{
+    const __m256i ctlMax = _mm256_set1_epi8(0x1f);
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i del = _mm256_set1_epi8(0x7f);
+    while(end - begin >= 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+        __m256i ctl = _mm256_cmpeq_epi8(_mm256_max_epu8(v, ctlMax), ctlMax);
+        ctl = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, tab), ctl);
+        ctl = _mm256_or_si256(ctl, _mm256_cmpeq_epi8(v, del));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(ctl));
+        if(mask)
+            return begin + __builtin_ctz(mask);
+        begin += 32;
+    }
+    if(end - begin >= 16)
+    {
+        int mask = ctlMask16(begin);
+        if(mask)
+            return begin + __builtin_ctz(mask);
+        begin += 16;
+    }
+    return HttpScan::findCtlScalar(begin, end);
+}
+
+//token判断用两个16字节的查找表：低4位选表项，高4位选比特位
+//low[l]的第h位表示字符(h << 4 | l)是不是token，只覆盖0x00-0x7f；两个128位通道各放一份
+struct TokenNibbleTable
+{
+    alignas(32) unsigned char low[32];
+    alignas(32) unsigned char high[32];
+
+    TokenNibbleTable()
+    {
+        for(int i = 0; i < 32; i++)
+        {
+            low[i] = 0;
+            high[i] = (i & 0x0f) < 8 ? 1 << (i & 0x0f) : 0;
+        }
+        for(int c = 0; c < 128; c++)
+        {
+            if(HttpScan::isToken(c))
+            {
+                low[c & 0x0f] |= 1 << (c >> 4);
+                low[(c & 0x0f) + 16] |= 1 << (c >> 4);
+            }
+        }
+    }
+};
+static const TokenNibbleTable TOKEN_NIBBLE;
+
+__attribute__((target("avx2")))
+static const char* skipTokenAvx2(const char* begin, const char* end)
+{
+    const __m256i lowTable = _mm256_load_si256(reinterpret_cast<const __m256i*>(TOKEN_NIBBLE.low));
+    const __m256i highBits = _mm256_load_si256(reinterpret_cast<const __m256i*>(TOKEN_NIBBLE.high));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    while(end - begin >= 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+        __m256i row = _mm256_shuffle_epi8(lowTable, v);
+        //0x80以上的字节高4位>=8，highBits里对应0，结果一定不是token
+        __m256i bit = _mm256_shuffle_epi8(highBits, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+        __m256i token = _mm256_cmpeq_epi8(_mm256_and_si256(row, bit), bit);
+        token = _mm256_andnot_si256(_mm256_cmpeq_epi8(bit, _mm256_setzero_si256()), token);
+        unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(token));
+        if(mask)
+            return begin + __builtin_ctz(mask);
+        begin += 32;
+    }
+    if(end - begin >= 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+        __m128i row = _mm_shuffle_epi8(_mm256_castsi256_si128(lowTable), v);
+        __m128i bit = _mm_shuffle_epi8(_mm256_castsi256_si128(highBits),
+                                       _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0f)));
+        __m128i token = _mm_cmpeq_epi8(_mm_and_si128(row, bit), bit);
+        token = _mm_andnot_si128(_mm_cmpeq_epi8(bit, _mm_setzero_si128()), token);
+        unsigned mask = ~static_cast<unsigned>(_mm_movemask_epi8(token)) & 0xffff;
+        if(mask)
+            return begin + __builtin_ctz(mask);
+        begin += 16;
+    }
+    return HttpScan::skipTokenScalar(begin, end);
+}
+
+#endif
+
+HttpScan::ISA HttpScan::detect()
+{
+#ifdef HTTPSCAN_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return AVX2;
+    if(__builtin_cpu_supports("sse4.2"))
+        return SSE42;
+#endif
+    return SCALAR;
+}
+
+void HttpScan::force(ISA isa)
+{
+    m_isa = isa;
+    m_findCtl = findCtlScalar;
+    m_skipToken = skipTokenScalar;
+#ifdef HTTPSCAN_X86
+    if(isa == AVX2)
+    {
+        m_findCtl = findCtlAvx2;
+        m_skipToken = skipTokenAvx2;
+    }
+    else if(isa == SSE42)
+    {
+        m_findCtl = findCtlSse42;
+        m_skipToken = skipTokenSse42;
+    }
+#else
+    m_isa = SCALAR;
+#endif
+}
+
+HttpScan::ISA HttpScan::isa()
+{
+    return m_isa;
+}
+
+const char* HttpScan::isaName()
+{
+    switch(m_isa)
+    {
+        case AVX2:
+            return "avx2";
+        case SSE42:
+            return "sse4.2";
+        default:
+            return "scalar";
+    }
+}
+
+//静态初始化时选择实现
+HttpScan::ISA HttpScan::m_isa = HttpScan::SCALAR;
+HttpScan::ScanFunc HttpScan::m_findCtl = HttpScan::findCtlScalar;
+HttpScan::ScanFunc HttpScan::m_skipToken = HttpScan::skipTokenScalar;
+
+struct HttpScanInit
+{
+    HttpScanInit()
+    {
+        HttpScan::force(HttpScan::detect());
+    }
+};
+static HttpScanInit s_scanInit;
@@ -0,0 +1,45 @@
+#pragma once
+#include<stddef.h>
+
+//请求解析用的字节扫描，一次比较16/32个字节
+//运行时按CPU支持的指令集选择AVX2、SSE4.2或者逐字节的实现
+class HttpScan
+{
+public:
+    enum ISA{SCALAR, SSE42, AVX2};
+
+    //返回第一个控制字符（HTAB除外）或DEL的位置，没有则返回end
+    //\r也是控制字符，所以找行尾的同时检查了这一行里有没有非法字符
+    static const char* findCtl(const char* begin, const char* end)
+    {
+        return m_findCtl(begin, end);
+    }
+
+    //跳过token字符，返回第一个非token字符的位置
+    static const char* skipToken(const char* begin, const char* end)
+    {
+        return m_skipToken(begin, end);
+    }
+
+    static bool isToken(unsigned char c)
+    {
+        return TOKEN_MAP[c];
+    }
+
+    //当前使用的实现，启动时按detect()的结果选择，force用于测试和基准对比
+    static ISA detect();
+    static ISA isa();
+    static const char* isaName();
+    static void force(ISA isa);
+
+    static const char* findCtlScalar(const char* begin, const char* end);
+    static const char* skipTokenScalar(const char* begin, const char* end);
+
+private:
+    typedef const char* (*ScanFunc)(const char*, const char*);
+
+    static ISA m_isa;
+    static ScanFunc m_findCtl;
+    static ScanFunc m_skipToken;
+    static const bool TOKEN_MAP[256];
+};
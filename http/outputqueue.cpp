@@ -0,0 +1,180 @@
+#include<errno.h>
+#include<assert.h>
+#include<sys/sendfile.h>
+#include<algorithm>
+#include"outputqueue.h"
+
+OutputQueue::OutputQueue()
+{
+    m_iovIdx = 0;
+    m_fileCnt = 0;
+    m_bytes = 0;
+}
+
+//写缓冲区里相邻的段合并
+void OutputQueue::add(const char* data, size_t offset, size_t len, int fd)
+{
+    if(len == 0)
+        return;
+    if(data == nullptr && fd < 0 && !m_segments.empty())
+    {
+        Segment& last = m_segments.back();
+        if(last.data == nullptr && last.fd < 0 && last.offset + last.len == offset)
+        {
+            last.len += len;
+            return;
+        }
+    }
+    m_segments.push_back({data, offset, len, fd});
+}
+
+void OutputQueue::addBuffer(size_t offset, size_t len)
+{
+    add(nullptr, offset, len, -1);
+}
+
+void OutputQueue::addBlock(const char* data, size_t len)
+{
+    assert(data || len == 0);
+    add(data, 0, len, -1);
+}
+
+void OutputQueue::addFile(int fd, off_t offset, size_t len)
+{
+    assert(fd >= 0);
+    add(nullptr, offset, len, fd);
+}
+
+void OutputQueue::build(const Buffer& buffer)
+{
+    m_iov.clear();
+    m_fileSeg.clear();
+    m_iovIdx = 0;
+    m_fileCnt = 0;
+    m_bytes = 0;
+    for(const Segment& seg : m_segments)
+    {
+        if(seg.fd >= 0)
+        {
+            m_iov.push_back({nullptr, seg.len});
+            m_fileSeg.push_back({seg.fd, static_cast<off_t>(seg.offset)});
+            m_fileCnt++;
+        }
+        else if(seg.data)
+        {
+            m_iov.push_back({const_cast<char*>(seg.data), seg.len});
+            m_fileSeg.push_back({-1, 0});
+        }
+        else
+        {
+            buffer.peekIov(seg.offset, seg.len, m_iov);
+            m_fileSeg.resize(m_iov.size(), {-1, 0});
+        }
+        m_bytes += seg.len;
+    }
+}
+
+void OutputQueue::clear()
+{
+    m_segments.clear();
+    m_iov.clear();
+    m_fileSeg.clear();
+    m_iovIdx = 0;
+    m_fileCnt = 0;
+    m_bytes = 0;
+}
+
+void OutputQueue::releaseMemory()
+{
+    clear();
+    if(m_segments.capacity() > IDLE_ENTRIES || m_iov.capacity() > IDLE_ENTRIES)
+    {
+        std::vector<Segment>().swap(m_segments);
+        std::vector<struct iovec>().swap(m_iov);
+        std::vector<FileSeg>().swap(m_fileSeg);
+    }
+}
+
+struct iovec* OutputQueue::iov()
+{
+    return m_iov.data() + m_iovIdx;
+}
+
+int OutputQueue::iovCnt() const
+{
+    int end = std::min<int>(m_iov.size(), m_iovIdx + IOV_MAX);
+    int i = m_iovIdx;
+    while(i < end && m_fileSeg[i].fd < 0)
+        i++;
+    return i - m_iovIdx;
+}
+
+int OutputQueue::totalIovCnt() const
+{
+    return m_iov.size();
+}
+
+bool OutputQueue::hasFile() const
+{
+    return m_fileCnt > 0;
+}
+
+bool OutputQueue::atFile() const
+{
+    return m_iovIdx < static_cast<int>(m_iov.size()) && m_fileSeg[m_iovIdx].fd >= 0;
+}
+
+ssize_t OutputQueue::flush(int fd, int* Errno)
+{
+    if(atFile())
+        return sendFile(fd, Errno);
+    ssize_t len = writev(fd, iov(), iovCnt());
+    if(len < 0)
+    {
+        *Errno = errno;
+        return len;
+    }
+    advance(len);
+    return len;
+}
+
+ssize_t OutputQueue::sendFile(int fd, int* Errno)
+{
+    FileSeg& seg = m_fileSeg[m_iovIdx];
+    off_t offset = seg.offset;
+    ssize_t len = sendfile(fd, seg.fd, &offset, std::min(m_iov[m_iovIdx].iov_len, SENDFILE_CHUNK));
+    if(len > 0)
+    {
+        advance(len);
+    }
+    else
+    {
+        *Errno = len == 0 ? EIO : errno;
+        len = -1;
+    }
+    return len;
+}
+
+//跳过已经发送的len字节，发完的iov整个跳过，发了一部分的调整base（文件是偏移）和len
+void OutputQueue::advance(size_t len)
+{
+    assert(len <= m_bytes);
+    m_bytes -= len;
+    while(len > 0 && m_iovIdx < static_cast<int>(m_iov.size()))
+    {
+        struct iovec& iov = m_iov[m_iovIdx];
+        FileSeg& seg = m_fileSeg[m_iovIdx];
+        if(len < iov.iov_len)
+        {
+            if(seg.fd >= 0)
+                seg.offset += len;
+            else
+                iov.iov_base = static_cast<char*>(iov.iov_base) + len;
+            iov.iov_len -= len;
+            break;
+        }
+        len -= iov.iov_len;
+        m_fileCnt -= seg.fd >= 0;
+        m_iovIdx++;
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include<sys/types.h>
+#include<sys/uio.h>
+#include<limits.h>
+#include<vector>
+#include"../buffer/buffer.h"
+
+//一批应答的输出队列，按顺序排列任意多个段，段有三种：
+//  写缓冲区里的一段：用偏移表示，应答全部生成完之后才转换成iov，在这之前写缓冲区可以继续接上新块
+//  共享的内存块：缓存里的头部块、映射的小文件、内置的错误内容，不拷贝，发送完之前由持有者保证有效
+//  文件的一段：用sendfile发送，数据不经过用户态
+//build之后flush每次只做一个系统调用：下一个文件段之前的内存段用一个writev（最多IOV_MAX个），
+//轮到文件段时sendfile最多SENDFILE_CHUNK字节；写了一部分时游标停在段中间，下次从那里继续
+class OutputQueue
+{
+public:
+    OutputQueue();
+
+public:
+    void addBuffer(size_t offset, size_t len);
+    void addBlock(const char* data, size_t len);
+    void addFile(int fd, off_t offset, size_t len);
+    //把段转换成iov，写缓冲区里的段按块拆开
+    void build(const Buffer& buffer);
+    //清空所有段，准备下一批
+    void clear();
+    //空闲时释放流水线留下的大数组
+    void releaseMemory();
+
+    //发送下一部分，返回写入的字节数；出错时返回-1并设置Errno，文件被截断时Errno为EIO
+    ssize_t flush(int fd, int* Errno);
+    //已经发送了len字节（io_uring的sendmsg完成后调用）
+    void advance(size_t len);
+
+    //还没发送的iov，iovCnt只算到下一个文件段之前，最多IOV_MAX个
+    struct iovec* iov();
+    int iovCnt() const;
+    int totalIovCnt() const;
+    //剩下的段里有文件
+    bool hasFile() const;
+    //下一个要发送的是文件段
+    bool atFile() const;
+    //剩余要发送的字节数
+    size_t bytes() const
+    {
+        return m_bytes;
+    }
+
+    //每次最多sendfile的字节数，避免一个大文件长时间占住线程
+    static constexpr size_t SENDFILE_CHUNK = 512 * 1024;
+    //空闲时保留的数组容量
+    static const size_t IDLE_ENTRIES = 16;
+
+private:
+    struct Segment
+    {
+        const char* data;   //为空时是写缓冲区或文件里的一段
+        size_t offset;
+        size_t len;
+        int fd;             //不为-1时是文件
+    };
+
+    //文件段的iov_base为空，m_fileSeg里记录对应的fd和偏移，内存段的fd为-1
+    struct FileSeg
+    {
+        int fd;
+        off_t offset;
+    };
+
+    void add(const char* data, size_t offset, size_t len, int fd);
+    ssize_t sendFile(int fd, int* Errno);
+
+    std::vector<Segment> m_segments;
+    std::vector<struct iovec> m_iov;
+    std::vector<FileSeg> m_fileSeg;
+    int m_iovIdx;           //第一个没发完的iov
+    int m_fileCnt;          //还没发完的文件段数
+    size_t m_bytes;
+};
@@ -0,0 +1,356 @@
+#include<string.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<errno.h>
+#include<assert.h>
+#include<sys/stat.h>
+#include<arpa/inet.h>
+#include<algorithm>
+#include"accesslog.h"
+
+thread_local AccessLog::ThreadState AccessLog::t_state;
+
+//method、target、version、referer、userAgent
+const size_t AccessLog::MAX_FIELD[5] = {16, 2048, 16, 512, 512};
+
+AccessLog::ThreadState::~ThreadState()
+{
+    if(ring)
+        ring->closed.store(true, std::memory_order_release);
+}
+
+AccessLog::AccessLog()
+{
+    m_format = COMBINED;
+    m_maxBytes = 0;
+    m_rotateSeconds = 0;
+    m_ringSize = 0;
+    m_isOpen = false;
+    m_dropped = 0;
+    m_written = 0;
+    m_fd = -1;
+    m_fileBytes = 0;
+    m_openedAt = 0;
+    m_batchRecords = 0;
+    m_stampSecond = -1;
+    m_isClosed = false;
+    m_wakeup = false;
+}
+
+AccessLog::~AccessLog()
+{
+    if(m_writeThread && m_writeThread->joinable())
+    {
+        {
+            std::lock_guard<std::mutex> locker(m_mutex);
+            m_isClosed = true;
+        }
+        m_cond.notify_one();
+        m_writeThread->join();
+    }
+    for(LogRing* ring : m_rings)
+    {
+        delete ring;
+    }
+    if(m_fd >= 0)
+    {
+        close(m_fd);
+    }
+}
+
+AccessLog* AccessLog::instance()
+{
+    static AccessLog inst;
+    return &inst;
+}
+
+bool AccessLog::init(const char* path, int format, size_t maxBytes, int rotateSeconds, size_t bufferSize)
+{
+    if(m_writeThread)
+        return true;
+    m_path = path;
+    m_current = m_path + "/access.log";
+    m_format = format;
+    m_maxBytes = maxBytes;
+    m_rotateSeconds = rotateSeconds;
+    //每个线程的缓冲区取2的幂，至少放得下一条最长的记录
+    m_ringSize = MAX_RECORD;
+    while(m_ringSize < bufferSize)
+        m_ringSize <<= 1;
+    m_raw.reset(new char[m_ringSize]);
+    m_batch.reserve(BATCH_SIZE + MAX_RECORD * 2);
+    if(!openFile())
+        return false;
+    m_writeThread.reset(new std::thread([this]{ run(); }));
+    m_isOpen = true;
+    return true;
+}
+
+bool AccessLog::openFile()
+{
+    m_fd = open(m_current.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if(m_fd < 0)
+    {
+        mkdir(m_path.c_str(), 0777);
+        m_fd = open(m_current.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    }
+    if(m_fd < 0)
+        return false;
+    struct stat st;
+    m_fileBytes = fstat(m_fd, &st) == 0 ? st.st_size : 0;
+    m_openedAt = time(nullptr);
+    return true;
+}
+
+//当前文件改名为带时间的名字，再新建一个，只在后台线程里做
+void AccessLog::rotate(time_t now)
+{
+    struct tm t;
+    localtime_r(&now, &t);
+    char name[64];
+    strftime(name, sizeof(name), "/access-%Y%m%d-%H%M%S", &t);
+    std::string target = m_path + name + ".log";
+    //同一秒里切分多次时加序号
+    for(int i = 1; access(target.c_str(), F_OK) == 0; i++)
+    {
+        target = m_path + name + "-" + std::to_string(i) + ".log";
+    }
+    close(m_fd);
+    rename(m_current.c_str(), target.c_str());
+    openFile();
+}
+
+//请求线程：只拷贝字段，不格式化，不加锁
+void AccessLog::append(const struct sockaddr_in& addr, std::string_view method, std::string_view target, std::string_view version,
+                       int status, size_t bytes, int64_t startNS, int64_t endNS, std::string_view referer, std::string_view userAgent)
+{
+    char data[MAX_RECORD];
+    Record record;
+    record.status = status;
+    record.ip = addr.sin_addr.s_addr;
+    record.bytes = bytes;
+    record.timeNS = endNS;
+    record.durationUS = endNS > startNS ? (endNS - startNS) / 1000 : 0;
+    std::string_view fields[5] = {method, target, version, referer, userAgent};
+    size_t len = sizeof(Record);
+    for(int i = 0; i < 5; i++)
+    {
+        record.lens[i] = std::min(fields[i].size(), MAX_FIELD[i]);
+        memcpy(data + len, fields[i].data(), record.lens[i]);
+        len += record.lens[i];
+    }
+    record.size = len;
+    memcpy(data, &record, sizeof(Record));
+
+    LogRing* ring = localRing();
+    if(!ring->push(data, len))
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        flush();
+    }
+    else if(ring->used() > ring->capacity() / 2 && !m_wakeup.load(std::memory_order_relaxed))
+    {
+        flush();
+    }
+}
+
+LogRing* AccessLog::localRing()
+{
+    ThreadState& state = t_state;
+    if(!state.ring)
+    {
+        state.ring = new LogRing(m_ringSize);
+        std::lock_guard<std::mutex> locker(m_mutex);
+        m_rings.push_back(state.ring);
+    }
+    return state.ring;
+}
+
+void AccessLog::flush()
+{
+    if(!m_wakeup.exchange(true))
+    {
+        {
+            std::lock_guard<std::mutex> locker(m_mutex);
+        }
+        m_cond.notify_one();
+    }
+}
+
+//字段里的引号、反斜杠和控制字符转义成\xHH，空字段写成-
+void AccessLog::appendQuoted(std::string_view text)
+{
+    m_batch += '"';
+    if(text.empty())
+        m_batch += '-';
+    for(unsigned char c : text)
+    {
+        if(c == '"' || c == '\\' || c < 0x20 || c >= 0x7f)
+        {
+            char hex[5];
+            snprintf(hex, sizeof(hex), "\\x%02x", c);
+            m_batch += hex;
+        }
+        else
+        {
+            m_batch += c;
+        }
+    }
+    m_batch += '"';
+}
+
+//host - - [time] "request" status bytes ["referer" "user-agent"] durationUS
+void AccessLog::formatRecord(const char* data)
+{
+    Record record;
+    memcpy(&record, data, sizeof(Record));
+    std::string_view fields[5];
+    const char* p = data + sizeof(Record);
+    for(int i = 0; i < 5; i++)
+    {
+        fields[i] = std::string_view(p, record.lens[i]);
+        p += record.lens[i];
+    }
+
+    //时间前缀每秒只格式化一次
+    time_t second = record.timeNS / 1000000000;
+    if(second != m_stampSecond)
+    {
+        struct tm t;
+        localtime_r(&second, &t);
+        strftime(m_stamp, sizeof(m_stamp), "[%d/%b/%Y:%H:%M:%S %z]", &t);
+        m_stampSecond = second;
+    }
+
+    char ip[INET_ADDRSTRLEN];
+    struct in_addr addr;
+    addr.s_addr = record.ip;
+    inet_ntop(AF_INET, &addr, ip, sizeof(ip));
+    m_batch += ip;
+    m_batch += " - - ";
+    m_batch += m_stamp;
+    m_batch += ' ';
+    //请求行解析失败
+    if(fields[0].empty())
+    {
+        m_batch += "\"-\"";
+    }
+    else
+    {
+        std::string line;
+        line.reserve(fields[0].size() + fields[1].size() + fields[2].size() + 2);
+        line.append(fields[0]).append(" ").append(fields[1]);
+        if(!fields[2].empty())
+            line.append(" HTTP/").append(fields[2]);
+        appendQuoted(line);
+    }
+    char num[48];
+    int n;
+    if(record.bytes > 0)
+        n = snprintf(num, sizeof(num), " %u %llu", record.status, static_cast<unsigned long long>(record.bytes));
+    else
+        n = snprintf(num, sizeof(num), " %u -", record.status);
+    m_batch.append(num, n);
+    if(m_format == COMBINED)
+    {
+        m_batch += ' ';
+        appendQuoted(fields[3]);
+        m_batch += ' ';
+        appendQuoted(fields[4]);
+    }
+    n = snprintf(num, sizeof(num), " %u\n", record.durationUS);
+    m_batch.append(num, n);
+    m_batchRecords++;
+}
+
+//一次write写出整批，写之前检查是否要切分
+void AccessLog::writeBatch()
+{
+    //上次切分后没能打开新文件，这一批再试一次，还不行就丢掉
+    if(m_fd < 0 && !openFile())
+    {
+        m_dropped.fetch_add(m_batchRecords, std::memory_order_relaxed);
+        m_batch.clear();
+        m_batchRecords = 0;
+        return;
+    }
+    time_t now = time(nullptr);
+    bool bySize = m_maxBytes > 0 && m_fileBytes > 0 && m_fileBytes + m_batch.size() > m_maxBytes;
+    bool byTime = m_rotateSeconds > 0 && m_fileBytes > 0 && now - m_openedAt >= m_rotateSeconds;
+    if(bySize || byTime)
+        rotate(now);
+    if(m_batch.empty())
+        return;
+
+    const char* data = m_batch.data();
+    size_t len = m_batch.size();
+    while(len > 0)
+    {
+        ssize_t n = ::write(m_fd, data, len);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            break;
+        }
+        data += n;
+        len -= n;
+    }
+    m_fileBytes += m_batch.size() - len;
+    m_written.fetch_add(m_batchRecords, std::memory_order_relaxed);
+    m_batch.clear();
+    m_batchRecords = 0;
+}
+
+//取出各线程缓冲区里的记录，格式化到批量缓冲区，够大了就写
+void AccessLog::collect()
+{
+    for(LogRing* ring : m_snapshot)
+    {
+        size_t len = ring->drain(m_raw.get(), m_ringSize);
+        for(size_t pos = 0; pos < len;)
+        {
+            uint16_t size;
+            memcpy(&size, m_raw.get() + pos, 2);
+            formatRecord(m_raw.get() + pos);
+            pos += size;
+            if(m_batch.size() >= BATCH_SIZE)
+                writeBatch();
+        }
+    }
+    writeBatch();
+}
+
+void AccessLog::run()
+{
+    std::unique_lock<std::mutex> locker(m_mutex);
+    while(true)
+    {
+        m_cond.wait_for(locker, std::chrono::milliseconds(FLUSH_INTERVAL_MS), [this]
+        {
+            return m_isClosed || m_wakeup.load();
+        });
+        bool closing = m_isClosed;
+        m_wakeup = false;
+        m_snapshot = m_rings;
+        locker.unlock();
+
+        collect();
+
+        locker.lock();
+        for(auto it = m_rings.begin(); it != m_rings.end();)
+        {
+            if((*it)->closed.load(std::memory_order_acquire) && (*it)->used() == 0)
+            {
+                delete *it;
+                it = m_rings.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        if(closing)
+            break;
+    }
+}
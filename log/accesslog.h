@@ -0,0 +1,128 @@
+#pragma once
+#include<mutex>
+#include<thread>
+#include<atomic>
+#include<vector>
+#include<memory>
+#include<string>
+#include<string_view>
+#include<condition_variable>
+#include<time.h>
+#include<netinet/in.h>
+#include"logring.h"
+
+//访问日志：每个请求一行，Common Log Format或Combined Log Format，末尾多一列处理时间（微秒）
+//请求线程只把原始字段拷进本线程的环形缓冲区，后台线程格式化成文本，攒成大块一次write
+//按大小或时间切分：当前文件是access.log，切分时改名为access-年月日-时分秒.log，再新建access.log
+class AccessLog
+{
+public:
+    enum FORMAT{COMMON, COMBINED};
+
+    static AccessLog* instance();
+    //maxBytes为0时不按大小切分，rotateSeconds为0时不按时间切分；bufferSize是每个线程的缓冲区大小
+    //文件打不开时返回false，不启动后台线程
+    bool init(const char* path = "./log", int format = COMBINED, size_t maxBytes = 64 << 20, int rotateSeconds = 86400,
+              size_t bufferSize = 256 << 10);
+    bool isOpen() const
+    {
+        return m_isOpen.load(std::memory_order_relaxed);
+    }
+    //COMMON格式不需要referer和user-agent，调用方可以不去找这两个头部
+    bool isCombined() const
+    {
+        return m_format == COMBINED;
+    }
+
+    //一个请求的应答生成后调用，bytes是应答消息体的长度，时间都是CLOCK_REALTIME的ns
+    //请求行解析失败时method和target为空
+    void append(const struct sockaddr_in& addr, std::string_view method, std::string_view target, std::string_view version,
+                int status, size_t bytes, int64_t startNS, int64_t endNS, std::string_view referer, std::string_view userAgent);
+    //唤醒后台线程，马上写出去
+    void flush();
+
+    //缓冲区满、或者切分后文件打不开被丢掉的请求数
+    uint64_t dropped() const
+    {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+    //已经写进文件的请求数
+    uint64_t written() const
+    {
+        return m_written.load(std::memory_order_relaxed);
+    }
+
+    static int64_t nowNS()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+private:
+    AccessLog();
+    ~AccessLog();
+
+    //缓冲区里一条记录的定长部分，后面依次是method、target、version、referer、userAgent
+    struct Record
+    {
+        uint16_t size;
+        uint16_t status;
+        uint32_t ip;            //网络字节序
+        uint64_t bytes;
+        int64_t timeNS;         //应答生成的时间
+        uint32_t durationUS;
+        uint16_t lens[5];
+    };
+
+    struct ThreadState
+    {
+        ~ThreadState();
+        LogRing* ring = nullptr;
+    };
+
+    LogRing* localRing();
+    void run();
+    void collect();
+    void formatRecord(const char* data);
+    void appendQuoted(std::string_view text);
+    void writeBatch();
+    bool openFile();
+    void rotate(time_t now);
+
+    static const size_t MAX_RECORD = 4096;
+    //每个字段最多记录的长度，超出的截掉
+    static const size_t MAX_FIELD[5];
+    static const size_t BATCH_SIZE = 1 << 20;
+    static constexpr int FLUSH_INTERVAL_MS = 100;
+
+    static thread_local ThreadState t_state;
+
+    std::string m_path;
+    std::string m_current;
+    int m_format;
+    size_t m_maxBytes;
+    int m_rotateSeconds;
+    size_t m_ringSize;
+    std::atomic<bool> m_isOpen;
+    std::atomic<uint64_t> m_dropped;
+    std::atomic<uint64_t> m_written;
+
+    //以下只由后台线程访问
+    int m_fd;               //切分后打开失败时为-1，下一批再重试
+    size_t m_fileBytes;
+    time_t m_openedAt;
+    std::unique_ptr<char[]> m_raw;
+    std::string m_batch;
+    uint64_t m_batchRecords;
+    time_t m_stampSecond;
+    char m_stamp[40];
+
+    std::vector<LogRing*> m_rings;
+    std::vector<LogRing*> m_snapshot;
+    std::unique_ptr<std::thread> m_writeThread;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    bool m_isClosed;
+    std::atomic<bool> m_wakeup;
+};
@@ -1,33 +1,62 @@
+#include<string.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<errno.h>
+#include<algorithm>
 #include"log.h"
 
+thread_local Log::ThreadState Log::t_state;
+
+//日志消息类型头，都是9个字节
+static const char* const LEVEL_TITLE[] = {"[debug]: ", "[info]:  ", "[warn]:  ", "[error]: "};
+
+//线程退出时标记自己的缓冲区，由后台线程取空后释放
+Log::ThreadState::~ThreadState()
+{
+    if(ring)
+        ring->closed.store(true, std::memory_order_release);
+}
+
 Log::Log()
 {
-    m_lineCount = 0;
+    m_path = nullptr;
+    m_suffix = nullptr;
     m_today = 0;
+    m_isOpen = false;
+    m_level = 1;
+    m_rateLimit = 0;
     m_isAsync = false;
+    m_isBinary = false;
+    m_dropped = 0;
+    m_reportedDrops = 0;
+    m_segmentSize = 0;
+    m_compress = false;
+    m_writtenFormats = 0;
+    m_ringSize = 0;
+    m_batchSize = 0;
+    m_batchLen = 0;
     m_writeThread = nullptr;
-    m_bq = nullptr;
-    m_fp = nullptr;
+    m_isClosed = false;
+    m_wakeup = false;
 }
 
 Log::~Log()
 {
     if(m_writeThread && m_writeThread->joinable())
     {
-        //取走队列剩余数据
-        while(!m_bq->empty())
+        //后台线程退出前会把缓冲区剩下的行写完
         {
-            m_bq->flush();
+            std::lock_guard<std::mutex> locker(m_mutex);
+            m_isClosed = true;
         }
-        m_bq->close();
+        m_cond.notify_one();
         m_writeThread->join();
     }
-    if(m_fp)
+    for(LogRing* ring : m_rings)
     {
-        std::lock_guard<std::mutex> locker(m_mutex);
-        flush();
-        fclose(m_fp);
+        delete ring;
     }
+    m_sink.close();
 }
 
 Log* Log::instance()
@@ -36,185 +65,413 @@ Log* Log::instance()
     return &inst;
 }
 
-int Log::getLevel()
+void Log::setLevel(int level)
 {
-    std::lock_guard<std::mutex> locker(m_mutex);
-    return m_level;
+    m_level.store(level, std::memory_order_relaxed);
+    if(isOpen())
+        s_threshold.store(level, std::memory_order_relaxed);
 }
 
-void Log::setLevel(int level)
+//判断是否异步，打开当天的日志文件
+void Log::init(int level, const char* path, const char* suffix, int maxCapacity, bool binary, size_t segmentSize, bool compress)
 {
-    std::lock_guard<std::mutex> locker(m_mutex);
     m_level = level;
+    m_isBinary = binary;
+
+    //有容量说明是异步的，每个线程的缓冲区大小取2的幂
+    if(maxCapacity > 0 && !m_writeThread)
+    {
+        m_ringSize = 1;
+        while(m_ringSize < static_cast<size_t>(maxCapacity) * AVG_LINE)
+            m_ringSize <<= 1;
+        //批量缓冲区至少能放下一个线程缓冲区的全部内容
+        m_batchSize = std::max(MIN_BATCH, m_ringSize);
+        m_batch.reset(new char[m_batchSize]);
+    }
+
+    time_t timer = time(nullptr);
+    struct tm t;
+    localtime_r(&timer, &t);
+    {
+        std::lock_guard<std::mutex> locker(m_fileMtx);
+        //重新init时目录和后缀可能变了，先结束原来的文件
+        m_sink.close();
+        m_path = path;
+        m_suffix = suffix;
+        //换段只能用后台线程按段大小建好的段，每段至少放得下两批，一次写入不会因为段太小被丢掉
+        m_segmentSize = std::max(segmentSize, 2 * std::max(m_batchSize, LINE_SIZE));
+        m_compress = compress;
+        openFile(t);
+    }
+
+    if(maxCapacity > 0)
+    {
+        if(!m_writeThread)
+            m_writeThread.reset(new std::thread(flushLogThread));
+        m_isAsync = true;
+    }
+    else
+    {
+        m_isAsync = false;
+    }
+    m_isOpen = true;
+    s_threshold = level;
 }
 
-bool Log::isOpen()
+//日志文件名的日期前缀，tm的年份从1900开始算，月份从0开始算
+static void datePrefix(char* prefix, size_t size, const struct tm& t)
 {
-    std::lock_guard<std::mutex> locker(m_mutex);
-    return m_isOpen;
+    snprintf(prefix, size, "%04d_%02d_%02d", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
 }
 
-//判断是否异步，设置当前时间
-void Log::init(int level, const char* path, const char* suffix, int maxCapacity)
+//让MmapSink的后台线程提前建好第二天的第一段，换日期时请求线程不用建文件
+void Log::prepareNextDay(const struct tm& t)
 {
-    m_isOpen = true;
-    m_level = level;
-    //有阻塞队列说明是异步的
-    if(maxCapacity > 0)
+    struct tm next = t;
+    next.tm_mday++;
+    next.tm_hour = 12;
+    next.tm_isdst = -1;
+    mktime(&next);
+    char prefix[LOG_NAME_LEN];
+    datePrefix(prefix, sizeof(prefix), next);
+    m_sink.prepare(prefix);
+}
+
+//启动时按日期打开日志，当天已经有的段不覆盖，接着往后写，调用方持有m_fileMtx
+void Log::openFile(const struct tm& t)
+{
+    char prefix[LOG_NAME_LEN];
+    datePrefix(prefix, sizeof(prefix), t);
+    m_sink.open(m_path, prefix, m_suffix, m_segmentSize, m_compress);
+    m_today = t.tm_mday;
+    startSegment();
+    prepareNextDay(t);
+}
+
+//二进制日志每一段都从会话记录开始，后面重新写出全部格式，调用方持有m_fileMtx
+void Log::startSegment()
+{
+    if(m_isBinary)
     {
-        m_isAsync = true;
-        if(!m_bq)
-        {
-            //新建阻塞队列
-            std::unique_ptr<BlockQueue<std::string>> newQueue(new BlockQueue<std::string>);
-            m_bq = move(newQueue);
+        char record[LogBinary::HEADER_SIZE + sizeof(LogBinary::SESSION_MAGIC)];
+        memcpy(record + LogBinary::HEADER_SIZE, LogBinary::SESSION_MAGIC, sizeof(LogBinary::SESSION_MAGIC));
+        LogBinary::putHeader(record, sizeof(record), LogBinary::SESSION_ID, LogBinary::nowNS());
+        m_formatRecords.assign(record, sizeof(record));
+        m_writtenFormats = 0;
+    }
+}
 
-            //新建写线程
-            std::unique_ptr<std::thread> newThread(new std::thread(flushLogThread));
-            m_writeThread = move(newThread);
-        }
+//登记一个调用点，同一个调用点被几个线程同时第一次调用时只登记一次
+uint16_t Log::registerSite(LogBinary::Site& site, int level, const char* format, const char* signature)
+{
+    std::lock_guard<std::mutex> locker(m_formatMtx);
+    uint16_t id = site.id.load(std::memory_order_relaxed);
+    if(id == 0)
+    {
+        assert(m_formats.size() + LogBinary::FIRST_SITE_ID <= UINT16_MAX);
+        id = m_formats.size() + LogBinary::FIRST_SITE_ID;
+        m_formats.push_back({level, format, signature});
+        site.bounded = LogBinary::boundedStrings(format);
+        site.id.store(id, std::memory_order_release);
+    }
+    return id;
+}
+
+//被限速略掉的行数，记在调用点的文件和行号上
+void Log::reportSuppressed(const char* file, int line, uint32_t count)
+{
+    const char* format = "%s:%d: %u log lines suppressed by rate limit";
+    if(isBinary())
+    {
+        static LogBinary::Site site;
+        writeBinary(site, 2, format, file, line, count);
     }
     else
     {
-        m_isAsync = false;
+        write(2, format, file, line, count);
     }
+}
 
-    m_lineCount = 0;
-    time_t timer = time(nullptr);
-    struct tm* systime = localtime(&timer);
-    struct tm t = *systime;
-    m_path = path;
-    m_suffix = suffix;
-    char filename[LOG_NAME_LEN] = {0};
-    //记录日志日期，tm的年份从1900开始算，月份从0开始算
-    snprintf(filename, LOG_NAME_LEN - 1, "%s/%04d_%02d_%02d%s", m_path, t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, m_suffix);
-    m_today = t.tm_mday;
+//把还没写进当前文件的格式编码成记录，调用方持有m_fileMtx
+void Log::appendFormats()
+{
+    std::lock_guard<std::mutex> locker(m_formatMtx);
+    for(; m_writtenFormats < m_formats.size(); m_writtenFormats++)
+    {
+        const Format& f = m_formats[m_writtenFormats];
+        uint16_t id = m_writtenFormats + LogBinary::FIRST_SITE_ID;
+        uint8_t level = f.level;
+        uint8_t argc = f.signature.size();
+        size_t size = LogBinary::HEADER_SIZE + 4 + argc + f.format.size();
+        size_t offset = m_formatRecords.size();
+        m_formatRecords.resize(offset + size);
+        char* record = &m_formatRecords[offset];
+        char* p = record + LogBinary::HEADER_SIZE;
+        LogBinary::put(p, &id, 2);
+        LogBinary::put(p, &level, 1);
+        LogBinary::put(p, &argc, 1);
+        LogBinary::put(p, f.signature.data(), argc);
+        LogBinary::put(p, f.format.data(), f.format.size());
+        LogBinary::putHeader(record, size, LogBinary::FORMAT_ID, 0);
+    }
+}
 
+//日志文件不是今天时先换文件，再拷进当前段；调用方持有m_fileMtx
+//换文件、换段都只用MmapSink后台线程建好的段：第二天的段还没建好时接着写原来的文件，
+//当前段写满而下一段还没建好时丢掉这些行并计入m_dropped，之后成功写入时补一行说明
+void Log::writeFile(const char* data, size_t len)
+{
+    time_t timer = time(nullptr);
+    struct tm t;
+    localtime_r(&timer, &t);
+    //新的一天新的日志
+    if(m_today != t.tm_mday)
     {
-        std::lock_guard<std::mutex> locker(m_mutex);
-        m_buffer.initPtr();
-        //文件已打开，刷新并关闭
-        if(m_fp)
-        {
-            flush();
-            fclose(m_fp);
-        }
-        m_fp = fopen(filename, "a");//追加
-        if(m_fp == nullptr)
+        char prefix[LOG_NAME_LEN];
+        datePrefix(prefix, sizeof(prefix), t);
+        if(m_sink.reopen(prefix))
         {
-            mkdir(m_path, 0777);//新建并设置权限
-            m_fp = fopen(filename, "a");
+            m_today = t.tm_mday;
+            startSegment();
+            prepareNextDay(t);
         }
-        assert(m_fp);
+    }
+    if(!writeSegment(data, len))
+    {
+        m_dropped.fetch_add(countRecords(data, len), std::memory_order_relaxed);
+        return;
+    }
+    uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+    if(dropped != m_reportedDrops)
+    {
+        char notice[LINE_SIZE];
+        if(writeSegment(notice, dropNotice(notice, dropped - m_reportedDrops)))
+            m_reportedDrops = dropped;
     }
 }
 
-void Log::write(int level, const char* format, ...)
+//拷进当前段，当前段放不下时MmapSink换到它预先建好的下一段，没有建好的段时返回false
+bool Log::writeSegment(const char* data, size_t len)
 {
+    if(!m_isBinary)
+        return m_sink.append(data, len);
+
+    //二进制日志先写出这批记录可能用到的新格式；要换段时新段从会话记录和全部格式开始
+    //换不了段时格式记录留着，下次连同会话记录写进当前段，解码时重新读一遍格式表
+    appendFormats();
+    if(m_formatRecords.size() + len > m_sink.remaining())
+    {
+        startSegment();
+        appendFormats();
+        if(!m_sink.next(m_formatRecords.size() + len))
+            return false;
+    }
+    m_sink.append(m_formatRecords.data(), m_formatRecords.size());
+    m_sink.append(data, len);
+    m_formatRecords.clear();
+    return true;
+}
+
+//丢掉的数据里有多少行：文本数换行，二进制按记录头里的长度逐条跳
+uint64_t Log::countRecords(const char* data, size_t len) const
+{
+    if(!m_isBinary)
+        return std::count(data, data + len, '\n');
+    uint64_t count = 0;
+    for(size_t pos = 0; pos + LogBinary::HEADER_SIZE <= len; count++)
+    {
+        uint16_t size;
+        memcpy(&size, data + pos, 2);
+        if(size < LogBinary::HEADER_SIZE)
+            break;
+        pos += size;
+    }
+    return count;
+}
+
+//说明丢了多少行的一行（二进制是一条记录），buf至少LINE_SIZE字节
+size_t Log::dropNotice(char* buf, unsigned long count)
+{
+    const char* format = "%lu log lines dropped, log buffer full or no log segment ready";
+    if(m_isBinary)
+    {
+        static LogBinary::Site site;
+        uint16_t id = site.id.load(std::memory_order_acquire);
+        if(id == 0)
+            id = registerSite(site, 2, format, LogBinary::Signature<unsigned long>::value);
+        return LogBinary::encode(buf, LINE_SIZE, id, 0, count);
+    }
+    return formatNotice(buf, 2, format, count);
+}
+
+//格式化一行：缓存的时间前缀+微秒+类型头+内容+换行，超长的内容截断
+size_t Log::formatLine(char* line, int level, const char* format, va_list valist)
+{
+    ThreadState& state = t_state;
     struct timeval now = {0, 0};
     gettimeofday(&now, nullptr);
-    time_t tsec = now.tv_sec;
-    struct tm *systime = localtime(&tsec);
-    struct tm t = *systime;
+    //同一秒内不再调用localtime
+    if(now.tv_sec != state.second)
+    {
+        struct tm t;
+        localtime_r(&now.tv_sec, &t);
+        state.stampLen = snprintf(state.stamp, sizeof(state.stamp), "%d-%02d-%02d %02d:%02d:%02d.",
+            t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec);
+        state.second = now.tv_sec;
+    }
+    size_t n = state.stampLen;
+    memcpy(line, state.stamp, n);
+    long usec = now.tv_usec;
+    for(int i = 5; i >= 0; i--)
+    {
+        line[n + i] = '0' + usec % 10;
+        usec /= 10;
+    }
+    line[n + 6] = ' ';
+    n += 7;
+
+    memcpy(line + n, LEVEL_TITLE[(level >= 0 && level <= 3) ? level : 1], 9);
+    n += 9;
+
+    //留一个字节给换行
+    int m = vsnprintf(line + n, LINE_SIZE - n - 1, format, valist);
+    if(m > 0)
+        n += std::min(static_cast<size_t>(m), LINE_SIZE - n - 2);
+    line[n++] = '\n';
+    return n;
+}
+
+void Log::write(int level, const char* format, ...)
+{
+    char line[LINE_SIZE];
     va_list valist;
+    va_start(valist, format);
+    size_t len = formatLine(line, level, format, valist);
+    va_end(valist);
+    append(line, len);
+}
 
-    //日志文件不是今天，或者文件已写满，需新建日志文件
-    if(m_today != t.tm_mday || (m_lineCount && (m_lineCount % MAX_LINES == 0)))
+//同步方式直接写文件，异步方式放进本线程的缓冲区
+void Log::append(const char* data, size_t len)
+{
+    if(!m_isAsync.load(std::memory_order_relaxed))
     {
-        std::unique_lock<std::mutex> locker(m_mutex);
-        locker.unlock();
-        char newfile[LOG_NAME_LEN];
-        char tail[36] = {0};
-        snprintf(tail, 36, "%04d_%02d_%02d", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
-
-        //新的一天新的日志
-        if(m_today != t.tm_mday)
-        {
-            snprintf(newfile, LOG_NAME_LEN - 72, "%s%s%s", m_path, tail, m_suffix);
-            m_today = t.tm_mday;
-            m_lineCount = 0;
-        }
-        //今天的日志已满
-        else
-        {
-            snprintf(newfile, LOG_NAME_LEN - 72, "%s%s-%d%s", m_path, tail, (m_lineCount / MAX_LINES), m_suffix);           
-        }
+        std::lock_guard<std::mutex> locker(m_fileMtx);
+        writeFile(data, len);
+        return;
+    }
 
-        locker.lock();
+    LogRing* ring = localRing();
+    if(!ring->push(data, len))
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
         flush();
-        fclose(m_fp);
-        m_fp = fopen(newfile, "a");
-        assert(m_fp);
+        return;
     }
-
+    //过半就提前叫醒后台线程，不等定时
+    if(ring->used() > ring->capacity() / 2 && !m_wakeup.load(std::memory_order_relaxed))
     {
-        std::unique_lock<std::mutex> locker(m_mutex);
-        m_lineCount++;
-        int n = snprintf(m_buffer.curWritePtr(), 128, "%d-%02d-%02d %02d:%02d:%02d.%06ld ", t.tm_year + 1900,
-        t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec, now.tv_usec);
-        m_buffer.updateWritePtr(n);
-        appendTitle(level);
-
-        va_start(valist, format);
-        int m = vsnprintf(m_buffer.curWritePtr(), m_buffer.writeableBytes(), format, valist);
-        va_end(valist);
+        flush();
+    }
+}
 
-        m_buffer.updateWritePtr(m);
-        m_buffer.append("\n\0", 2);
+//第一次写日志的线程新建自己的缓冲区并登记
+LogRing* Log::localRing()
+{
+    ThreadState& state = t_state;
+    if(!state.ring)
+    {
+        state.ring = new LogRing(m_ringSize);
+        std::lock_guard<std::mutex> locker(m_mutex);
+        m_rings.push_back(state.ring);
+    }
+    return state.ring;
+}
 
-        //异步日志，从阻塞队列取
-        if(m_isAsync && m_bq && !m_bq->full())
-        {
-            m_bq->push_back(m_buffer.alltoStr());
-        }
-        //同步方式
-        else
+//唤醒写线程
+void Log::flush()
+{
+    if(m_isAsync && !m_wakeup.exchange(true))
+    {
+        //拿一下锁，避免后台线程检查完条件、还没睡下时漏掉通知
         {
-            fputs(m_buffer.curReadPtr(), m_fp);
+            std::lock_guard<std::mutex> locker(m_mutex);
         }
-        m_buffer.initPtr();
+        m_cond.notify_one();
     }
 }
 
-//添加日志消息类型头
-void Log::appendTitle(int level)
+//把各线程缓冲区里的行收集到批量缓冲区，满了或收完就写文件
+void Log::collect()
 {
-    switch(level)
+    for(LogRing* ring : m_snapshot)
     {
-        case 0:
-            m_buffer.append("[debug]: ", 9);
-            break;
-        case 1:
-            m_buffer.append("[info]:  ", 9);
-            break;
-        case 2:
-            m_buffer.append("[warn]:  ", 9);
-            break;
-        case 3:
-            m_buffer.append("[error]: ", 9);
-            break;
-        default:
-            m_buffer.append("[info]:  ", 9);
-            break;
+        size_t n = ring->drain(m_batch.get() + m_batchLen, m_batchSize - m_batchLen);
+        //放不下就先写出去，空的批量缓冲区一定放得下一个线程的缓冲区
+        if(n == 0 && ring->used() > 0)
+        {
+            writeBatch();
+            n = ring->drain(m_batch.get(), m_batchSize);
+        }
+        m_batchLen += n;
     }
+    writeBatch();
 }
 
-//唤醒写线程
-void Log::flush()
+//后台线程自己生成的一行
+size_t Log::formatNotice(char* line, int level, const char* format, ...)
 {
-    if(m_isAsync)
-        m_bq->flush();
-    fflush(m_fp);
+    va_list valist;
+    va_start(valist, format);
+    size_t len = formatLine(line, level, format, valist);
+    va_end(valist);
+    return len;
 }
 
-//把队列中的数据写入日志
+//整批一次拷进文件，没有新的行但有丢掉的行要说明时也写，说明由writeFile补上
+void Log::writeBatch()
+{
+    if(m_batchLen == 0 && m_dropped.load(std::memory_order_relaxed) == m_reportedDrops)
+        return;
+    {
+        std::lock_guard<std::mutex> locker(m_fileMtx);
+        writeFile(m_batch.get(), m_batchLen);
+    }
+    m_batchLen = 0;
+}
+
+//定时或被唤醒后收集一轮，退出的线程的缓冲区取空后释放
 void Log::asyncWrite()
 {
-    std::string str = "";
-    while(m_bq->pop(str))
+    std::unique_lock<std::mutex> locker(m_mutex);
+    while(true)
     {
-        std::lock_guard<std::mutex> locker(m_mutex);
-        fputs(str.c_str(), m_fp);
+        m_cond.wait_for(locker, std::chrono::milliseconds(FLUSH_INTERVAL_MS), [this]
+        {
+            return m_isClosed || m_wakeup.load();
+        });
+        bool closing = m_isClosed;
+        m_wakeup = false;
+        m_snapshot = m_rings;
+        locker.unlock();
+
+        collect();
+
+        locker.lock();
+        for(auto it = m_rings.begin(); it != m_rings.end();)
+        {
+            if((*it)->closed.load(std::memory_order_acquire) && (*it)->used() == 0)
+            {
+                delete *it;
+                it = m_rings.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        if(closing)
+            break;
     }
 }
 
@@ -222,4 +479,4 @@ void Log::asyncWrite()
 void Log::flushLogThread()
 {
     Log::instance()->asyncWrite();
-}
\ No newline at end of file
+}
@@ -1,61 +1,222 @@
 #pragma once
 #include<mutex>
 #include<thread>
+#include<atomic>
+#include<vector>
+#include<memory>
+#include<condition_variable>
 #include<string>
+#include<time.h>
 #include<sys/time.h>
 #include<sys/stat.h>
 #include<stdarg.h>
 #include<assert.h>
-#include"blockqueue.h"
-#include"../buffer/buffer.h"
+#include"logring.h"
+#include"logbinary.h"
+#include"mmapsink.h"
 
+//每个写日志的线程有自己的环形缓冲区，写一行只格式化到本线程的缓冲区，不加锁
+//后台线程定期把所有缓冲区里攒下的行拷到一块大的批量缓冲区，腾出空间后一次write写到文件
+//线程的缓冲区满了就丢掉这一行并计数，请求线程不会因为磁盘慢而阻塞；丢了多少行由后台线程写到日志里
+//maxCapacity为0时同步写，每行直接拷进文件
+//文件是MmapSink的段：按日期命名，写满segmentSize字节换下一段，写满的段由它的后台线程压缩成.gz
+//binary模式下调用点不格式化，只记下格式id和原始参数，由离线工具logdecoder还原成文本
+//级别检查是一次relaxed的原子读；低于LOG_MIN_LEVEL的调用点编译时就去掉；setRateLimit后每个调用点每秒最多写这么多行，默认不限
 class Log
 {
 public:
-    void init(int level = 1, const char* path = "./log", const char* suffix = ".log", int maxCapacity = 1024);
+    //每个调用点一个，限制这个调用点每秒写的行数，超出的只计数，这个调用点下一秒再写时补一行说明略掉了多少
+    struct RateLimit
+    {
+        std::atomic<int64_t> second{-1};
+        std::atomic<uint32_t> count{0};
+        std::atomic<uint32_t> suppressed{0};
+    };
+
+    void init(int level = 1, const char* path = "./log", const char* suffix = ".log", int maxCapacity = 1024, bool binary = false,
+              size_t segmentSize = 16 << 20, bool compress = true);
     static Log*  instance();
     static void flushLogThread();
 
     void write(int level, const char* format, ...);
+    //二进制记录：只拷参数，格式串在第一次调用时登记一次
+    template<typename... Args>
+    void writeBinary(LogBinary::Site& site, int level, const char* format, const Args&... args)
+    {
+        uint16_t id = site.id.load(std::memory_order_acquire);
+        if(id == 0)
+            id = registerSite(site, level, format, LogBinary::Signature<Args...>::value);
+        char record[LINE_SIZE];
+        append(record, LogBinary::encode(record, LINE_SIZE, id, site.bounded, args...));
+    }
+    //唤醒后台线程，马上把缓冲区里的行写出去
     void flush();
 
-    int getLevel();
+    int getLevel() const
+    {
+        return m_level.load(std::memory_order_relaxed);
+    }
     void setLevel(int level);
-    bool isOpen();
+    //日志打开并且level不低于当前级别；静态的，关掉的语句连instance()都不调用
+    static bool isEnabled(int level)
+    {
+        return s_threshold.load(std::memory_order_relaxed) <= level;
+    }
+    //每个调用点每秒最多写的行数，0表示不限
+    void setRateLimit(uint32_t linesPerSecond)
+    {
+        m_rateLimit.store(linesPerSecond, std::memory_order_relaxed);
+    }
+    //这一行是否在调用点的限额内；并发时计数有少量误差
+    bool allow(RateLimit& limit, const char* file, int line)
+    {
+        uint32_t max = m_rateLimit.load(std::memory_order_relaxed);
+        if(max == 0)
+            return true;
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        int64_t second = limit.second.load(std::memory_order_relaxed);
+        if(ts.tv_sec != second && limit.second.compare_exchange_strong(second, ts.tv_sec, std::memory_order_relaxed))
+        {
+            limit.count.store(0, std::memory_order_relaxed);
+            uint32_t suppressed = limit.suppressed.exchange(0, std::memory_order_relaxed);
+            if(suppressed > 0)
+                reportSuppressed(file, line, suppressed);
+        }
+        if(limit.count.fetch_add(1, std::memory_order_relaxed) < max)
+            return true;
+        limit.suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    bool isOpen() const
+    {
+        return m_isOpen.load(std::memory_order_relaxed);
+    }
+    bool isBinary() const
+    {
+        return m_isBinary.load(std::memory_order_relaxed);
+    }
+    //缓冲区满被丢掉的行数
+    uint64_t dropped() const
+    {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
 
 private:
     Log();
     ~Log();
-    void appendTitle(int level);
+
+    //线程自己的状态：缓冲区和缓存的时间前缀，同一秒内的行只重新填微秒
+    struct ThreadState
+    {
+        ~ThreadState();
+        LogRing* ring = nullptr;
+        time_t second = -1;
+        int stampLen = 0;
+        char stamp[32];
+    };
+
+    //二进制日志里一个调用点的格式
+    struct Format
+    {
+        int level;
+        std::string format;
+        std::string signature;
+    };
+
+    LogRing* localRing();
+    void append(const char* data, size_t len);
+    uint16_t registerSite(LogBinary::Site& site, int level, const char* format, const char* signature);
+    void appendFormats();
+    void reportSuppressed(const char* file, int line, uint32_t count);
+    size_t formatLine(char* line, int level, const char* format, va_list valist);
     void asyncWrite();
+    void collect();
+    size_t formatNotice(char* line, int level, const char* format, ...);
+    void writeBatch();
+    void writeFile(const char* data, size_t len);
+    bool writeSegment(const char* data, size_t len);
+    uint64_t countRecords(const char* data, size_t len) const;
+    size_t dropNotice(char* buf, unsigned long count);
+    void openFile(const struct tm& t);
+    void prepareNextDay(const struct tm& t);
+    void startSegment();
 
 private:
     static const int LOG_PATH_LEN = 256;
     static const int LOG_NAME_LEN = 256;
-    static const int MAX_LINES = 50000;
+    //一行最长的字节数，超出的部分截掉
+    static constexpr size_t LINE_SIZE = 1024;
+    //每个线程的缓冲区按一行平均这么多字节乘maxCapacity分配
+    static const size_t AVG_LINE = 256;
+    static constexpr size_t MIN_BATCH = 1 << 20;
+    static constexpr int FLUSH_INTERVAL_MS = 100;
+    //日志关闭时的s_threshold，比所有级别都高
+    static const int LEVEL_OFF = 4;
+
+    static thread_local ThreadState t_state;
+    //打开时等于m_level，关闭时是LEVEL_OFF，调用点只读这一个变量
+    static inline std::atomic<int> s_threshold{LEVEL_OFF};
 
     const char* m_path;
     const char* m_suffix;
 
-    int m_lineCount;
     int m_today;
-    bool m_isOpen;
-    int m_level;
-    bool m_isAsync;
-    Buffer m_buffer;
+    std::atomic<bool> m_isOpen;
+    std::atomic<int> m_level;
+    std::atomic<uint32_t> m_rateLimit;
+    std::atomic<bool> m_isAsync;
+    std::atomic<bool> m_isBinary;
+    std::atomic<uint64_t> m_dropped;
+    uint64_t m_reportedDrops;
+
+    //日志文件，换文件和写文件都在m_fileMtx下
+    MmapSink m_sink;
+    size_t m_segmentSize;
+    bool m_compress;
+    std::mutex m_fileMtx;
+
+    //二进制日志的格式表，写文件前把新登记的格式先写出去，换段后全部重写一遍，每段都能单独解码
+    std::vector<Format> m_formats;
+    std::mutex m_formatMtx;
+    size_t m_writtenFormats;
+    std::string m_formatRecords;
+
+    //所有线程的缓冲区，登记和摘除在m_mutex下
+    size_t m_ringSize;
+    std::vector<LogRing*> m_rings;
+    std::vector<LogRing*> m_snapshot;
+    std::unique_ptr<char[]> m_batch;
+    size_t m_batchSize;
+    size_t m_batchLen;
 
-    FILE* m_fp;
-    std::unique_ptr<BlockQueue<std::string>> m_bq;
     std::unique_ptr<std::thread> m_writeThread;
     std::mutex m_mutex;
+    std::condition_variable m_cond;
+    bool m_isClosed;
+    std::atomic<bool> m_wakeup;
 };
 
+//编译时的最低级别，比如make CXXFLAGS+=-DLOG_MIN_LEVEL=1去掉所有LOG_DEBUG，参数也不会求值
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
 #define LOG_BASE(level, format, ...) \
     do {\
-        Log* log = Log::instance();\
-        if (log->isOpen() && log->getLevel() <= level) {\
-            log->write(level, format, ##__VA_ARGS__); \
-            log->flush();\
+        if constexpr (level >= LOG_MIN_LEVEL) {\
+            if (Log::isEnabled(level)) {\
+                Log* log = Log::instance();\
+                static Log::RateLimit limit;\
+                if (log->allow(limit, __FILE__, __LINE__)) {\
+                    if (log->isBinary()) {\
+                        static LogBinary::Site site;\
+                        log->writeBinary(site, level, format, ##__VA_ARGS__);\
+                    } else {\
+                        log->write(level, format, ##__VA_ARGS__); \
+                    }\
+                }\
+            }\
         }\
     } while(0);
 
@@ -63,4 +224,4 @@ private:
 #define LOG_DEBUG(format, ...) do {LOG_BASE(0, format, ##__VA_ARGS__)} while(0);
 #define LOG_INFO(format, ...) do {LOG_BASE(1, format, ##__VA_ARGS__)} while(0);
 #define LOG_WARN(format, ...) do {LOG_BASE(2, format, ##__VA_ARGS__)} while(0);
-#define LOG_ERROR(format, ...) do {LOG_BASE(3, format, ##__VA_ARGS__)} while(0);
\ No newline at end of file
+#define LOG_ERROR(format, ...) do {LOG_BASE(3, format, ##__VA_ARGS__)} while(0);
@@ -0,0 +1,206 @@
+#pragma once
+#include<atomic>
+#include<type_traits>
+#include<stdint.h>
+#include<string.h>
+#include<time.h>
+
+//二进制日志的记录格式，Log和离线解码工具共用
+//每条记录：2字节记录总长 + 2字节id + 8字节时间(CLOCK_REALTIME的ns) + 内容，都按本机字节序
+//id为SESSION_ID：一次打开文件的开头，解码时清空格式表，之后重新给出所有格式
+//id为FORMAT_ID：格式定义，内容是2字节格式id、1字节级别、1字节参数个数、每个参数的类型、格式串
+//其他id：一次日志调用，内容是按格式定义里的类型依次存放的原始参数，字符串是2字节长度加内容
+namespace LogBinary
+{
+    static const uint16_t SESSION_ID = 0;
+    static const uint16_t FORMAT_ID = 1;
+    static const uint16_t FIRST_SITE_ID = 2;
+    static const size_t HEADER_SIZE = 12;
+    static const char SESSION_MAGIC[] = "wslog1";
+
+    //参数类型：i/u 4字节有/无符号整数，l/U 8字节，d double，s 字符串，p 指针
+    template<typename T, typename D = typename std::decay<T>::type>
+    struct ArgTraits
+    {
+        static const bool IS_SIGNED = std::is_signed<D>::value;
+        static constexpr char TAG =
+            (std::is_same<D, char*>::value || std::is_same<D, const char*>::value) ? 's' :
+            std::is_pointer<D>::value ? 'p' :
+            std::is_floating_point<D>::value ? 'd' :
+            (std::is_integral<D>::value || std::is_enum<D>::value) ?
+                (sizeof(D) <= 4 ? (IS_SIGNED ? 'i' : 'u') : (IS_SIGNED ? 'l' : 'U')) : 0;
+        //字符串只算长度字段
+        static constexpr size_t SIZE = TAG == 's' ? 2 : (TAG == 'i' || TAG == 'u') ? 4 : 8;
+    };
+
+    template<typename... Args>
+    struct Signature
+    {
+        static constexpr char value[sizeof...(Args) + 1] = {ArgTraits<Args>::TAG..., '\0'};
+        static constexpr size_t FIXED_SIZE = (HEADER_SIZE + ... + ArgTraits<Args>::SIZE);
+    };
+
+    //一个日志调用点，宏里的静态变量，第一次写的时候登记格式得到id
+    struct Site
+    {
+        std::atomic<uint16_t> id{0};
+        //第几个参数是用前一个整数参数当长度的字符串（%.*s），这种字符串不一定以0结尾
+        uint64_t bounded = 0;
+    };
+
+    //format里的一个转换说明[begin, end)，不含%%
+    struct Spec
+    {
+        size_t begin;
+        size_t end;
+        int stars;              //宽度和精度里的*个数，各占一个int参数
+        bool starPrecision;     //精度是*
+        char conv;
+    };
+
+    //从pos开始找下一个转换说明，找不到返回false
+    inline bool nextSpec(const char* format, size_t& pos, Spec& spec)
+    {
+        while(format[pos])
+        {
+            if(format[pos] != '%')
+            {
+                pos++;
+                continue;
+            }
+            if(format[pos + 1] == '%')
+            {
+                pos += 2;
+                continue;
+            }
+            spec.begin = pos++;
+            spec.stars = 0;
+            spec.starPrecision = false;
+            bool precision = false;
+            while(format[pos] && strchr("-+ #0123456789.*hlLqjzt", format[pos]))
+            {
+                if(format[pos] == '.')
+                    precision = true;
+                else if(format[pos] == '*')
+                {
+                    spec.stars++;
+                    spec.starPrecision = precision;
+                }
+                pos++;
+            }
+            if(!format[pos])
+                return false;
+            spec.conv = format[pos++];
+            spec.end = pos;
+            return true;
+        }
+        return false;
+    }
+
+    //按格式串找出%.*s对应的参数位置
+    inline uint64_t boundedStrings(const char* format)
+    {
+        uint64_t mask = 0;
+        size_t pos = 0;
+        int index = 0;
+        Spec spec;
+        while(nextSpec(format, pos, spec))
+        {
+            index += spec.stars;
+            if(spec.conv == 's' && spec.starPrecision && index < 64)
+                mask |= 1ull << index;
+            index++;
+        }
+        return mask;
+    }
+
+    inline int64_t nowNS()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    inline void put(char*& p, const void* src, size_t len)
+    {
+        memcpy(p, src, len);
+        p += len;
+    }
+
+    inline void putHeader(char* record, uint16_t size, uint16_t id, int64_t timeNS)
+    {
+        memcpy(record, &size, 2);
+        memcpy(record + 2, &id, 2);
+        memcpy(record + 4, &timeNS, 8);
+    }
+
+    //room是留给字符串内容的空间，放不下的部分截掉
+    template<typename T>
+    inline void encodeArg(char*& p, size_t& room, const T& value, int64_t bound)
+    {
+        constexpr char tag = ArgTraits<T>::TAG;
+        static_assert(tag != 0, "unsupported log argument type");
+        if constexpr(tag == 's')
+        {
+            const char* s = value;
+            if(!s)
+                s = "(null)";
+            size_t limit = (bound >= 0 && static_cast<size_t>(bound) < room) ? bound : room;
+            uint16_t len = strnlen(s, limit);
+            put(p, &len, 2);
+            put(p, s, len);
+            room -= len;
+        }
+        else if constexpr(tag == 'p')
+        {
+            uint64_t v = reinterpret_cast<uintptr_t>(value);
+            put(p, &v, 8);
+        }
+        else if constexpr(tag == 'd')
+        {
+            double v = value;
+            put(p, &v, 8);
+        }
+        else if constexpr(tag == 'i' || tag == 'u')
+        {
+            uint32_t v = static_cast<uint32_t>(value);
+            put(p, &v, 4);
+        }
+        else
+        {
+            uint64_t v = static_cast<uint64_t>(value);
+            put(p, &v, 8);
+        }
+    }
+
+    //整数参数可能是后面%.*s的长度
+    template<typename T>
+    inline int64_t intValue(const T& value, int64_t last)
+    {
+        if constexpr(std::is_integral<typename std::decay<T>::type>::value)
+            return static_cast<int64_t>(value);
+        else
+            return last;
+    }
+
+    inline void encodeArgs(char*&, size_t&, uint64_t, int, int64_t) {}
+
+    template<typename T, typename... Rest>
+    inline void encodeArgs(char*& p, size_t& room, uint64_t bounded, int index, int64_t last, const T& value, const Rest&... rest)
+    {
+        encodeArg(p, room, value, (index < 64 && (bounded >> index) & 1) ? last : -1);
+        encodeArgs(p, room, bounded, index + 1, intValue(value, last), rest...);
+    }
+
+    //编码一条记录到record，capacity至少是所有定长部分的大小，返回记录长度
+    template<typename... Args>
+    inline size_t encode(char* record, size_t capacity, uint16_t id, uint64_t bounded, const Args&... args)
+    {
+        static_assert(Signature<Args...>::FIXED_SIZE <= 512, "too many log arguments");
+        size_t room = capacity - Signature<Args...>::FIXED_SIZE;
+        char* p = record + HEADER_SIZE;
+        encodeArgs(p, room, bounded, 0, -1, args...);
+        putHeader(record, p - record, id, nowNS());
+        return p - record;
+    }
+}
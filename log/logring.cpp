@@ -0,0 +1,45 @@
+#include<string.h>
+#include<assert.h>
+#include<algorithm>
+#include"logring.h"
+
+LogRing::LogRing(size_t capacity) : closed(false),
+    m_data(new char[capacity]), m_mask(capacity - 1), m_head(0), m_tail(0)
+{
+    assert(capacity > 0 && (capacity & m_mask) == 0);
+}
+
+bool LogRing::push(const char* data, size_t len)
+{
+    size_t head = m_head.load(std::memory_order_relaxed);
+    size_t tail = m_tail.load(std::memory_order_acquire);
+    if(capacity() - (head - tail) < len)
+        return false;
+    //一条记录可能跨过缓冲区末尾，分两段拷
+    size_t offset = head & m_mask;
+    size_t first = std::min(len, capacity() - offset);
+    memcpy(m_data.get() + offset, data, first);
+    memcpy(m_data.get(), data + first, len - first);
+    m_head.store(head + len, std::memory_order_release);
+    return true;
+}
+
+size_t LogRing::drain(char* dst, size_t room)
+{
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    size_t head = m_head.load(std::memory_order_acquire);
+    size_t len = head - tail;
+    if(len == 0 || len > room)
+        return 0;
+    size_t offset = tail & m_mask;
+    size_t first = std::min(len, capacity() - offset);
+    memcpy(dst, m_data.get() + offset, first);
+    memcpy(dst + first, m_data.get(), len - first);
+    m_tail.store(head, std::memory_order_release);
+    return len;
+}
+
+size_t LogRing::used() const
+{
+    return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include<atomic>
+#include<memory>
+#include<stddef.h>
+#include<stdint.h>
+
+//单生产者单消费者的字节环形缓冲区，生产者是写日志的线程，消费者是后台线程
+//里面总是完整的记录，生产者写完一整条才移动m_head
+class LogRing
+{
+public:
+    explicit LogRing(size_t capacity);
+    bool push(const char* data, size_t len);
+    //把[tail, head)拷到dst，返回拷贝的字节数；放不下room时不拷，返回0
+    size_t drain(char* dst, size_t room);
+    size_t used() const;
+    size_t capacity() const
+    {
+        return m_mask + 1;
+    }
+
+    //写日志的线程已经退出，后台线程取空后释放
+    std::atomic<bool> closed;
+
+private:
+    std::unique_ptr<char[]> m_data;
+    size_t m_mask;
+    alignas(64) std::atomic<size_t> m_head;
+    alignas(64) std::atomic<size_t> m_tail;
+};
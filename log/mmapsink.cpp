@@ -0,0 +1,446 @@
+#include<string.h>
+#include<stdlib.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<dirent.h>
+#include<zlib.h>
+#include<algorithm>
+#include"mmapsink.h"
+
+MmapSink::MmapSink()
+{
+    m_segmentSize = 0;
+    m_compress = false;
+    m_index = 0;
+    m_spareReady = false;
+    m_nextIndex = 0;
+    m_nextReady = false;
+    m_isClosed = false;
+}
+
+MmapSink::~MmapSink()
+{
+    close();
+}
+
+std::string MmapSink::segmentPath(const std::string& prefix, int index) const
+{
+    if(index == 0)
+        return m_dir + "/" + prefix + m_suffix;
+    return m_dir + "/" + prefix + "-" + std::to_string(index) + m_suffix;
+}
+
+//返回这个前缀下一个可用的序号；压缩到一半的临时文件删掉，没压缩的段交给后台线程收尾
+int MmapSink::scanSegments(const std::string& prefix)
+{
+    DIR* dir = opendir(m_dir.c_str());
+    if(!dir)
+        return 0;
+    int next = 0;
+    std::deque<Segment> leftovers;
+    while(struct dirent* entry = readdir(dir))
+    {
+        std::string name = entry->d_name;
+        if(name.compare(0, prefix.size(), prefix) != 0)
+            continue;
+        std::string rest = name.substr(prefix.size());
+        int kind = 0;   //0是段本身，1是.gz，2是.gz.tmp
+        for(const char* tail : {".gz", ".gz.tmp"})
+        {
+            size_t len = strlen(tail);
+            if(rest.size() > len && rest.compare(rest.size() - len, len, tail) == 0)
+            {
+                rest.resize(rest.size() - len);
+                kind = len == 3 ? 1 : 2;
+                break;
+            }
+        }
+        //剩下的应该是suffix或者-序号+suffix
+        if(rest.size() < m_suffix.size() || rest.compare(rest.size() - m_suffix.size(), m_suffix.size(), m_suffix) != 0)
+            continue;
+        rest.resize(rest.size() - m_suffix.size());
+        int index = 0;
+        if(!rest.empty())
+        {
+            if(rest[0] != '-' || rest.size() == 1 || rest.find_first_not_of("0123456789", 1) != std::string::npos)
+                continue;
+            index = atoi(rest.c_str() + 1);
+        }
+        next = std::max(next, index + 1);
+        if(kind == 2)
+        {
+            unlink((m_dir + "/" + name).c_str());
+        }
+        else if(kind == 0)
+        {
+            Segment seg;
+            seg.path = m_dir + "/" + name;
+            seg.compress = m_compress;
+            seg.leftover = true;
+            leftovers.push_back(seg);
+        }
+    }
+    closedir(dir);
+    if(!leftovers.empty())
+    {
+        {
+            std::lock_guard<std::mutex> locker(m_mutex);
+            m_jobs.insert(m_jobs.end(), leftovers.begin(), leftovers.end());
+        }
+        m_cond.notify_one();
+    }
+    return next;
+}
+
+//建文件、分配好磁盘空间、映射并预先把页面读进来，之后写的时候不会再缺页分配块
+bool MmapSink::create(Segment& seg, size_t size) const
+{
+    seg.fd = ::open(seg.path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(seg.fd < 0)
+    {
+        mkdir(m_dir.c_str(), 0777);
+        seg.fd = ::open(seg.path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(seg.fd < 0)
+            return false;
+    }
+    //不支持fallocate的文件系统退回到ftruncate，文件是稀疏的
+    if(fallocate(seg.fd, 0, 0, size) != 0 && ftruncate(seg.fd, size) != 0)
+    {
+        ::close(seg.fd);
+        unlink(seg.path.c_str());
+        seg.fd = -1;
+        return false;
+    }
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, seg.fd, 0);
+    if(data == MAP_FAILED)
+    {
+        ::close(seg.fd);
+        unlink(seg.path.c_str());
+        seg.fd = -1;
+        return false;
+    }
+    seg.data = static_cast<char*>(data);
+    seg.size = size;
+    seg.used = 0;
+    return true;
+}
+
+void MmapSink::open(const std::string& dir, const std::string& prefix, const std::string& suffix, size_t segmentSize, bool compress)
+{
+    close();
+    m_dir = dir;
+    m_suffix = suffix;
+    m_segmentSize = segmentSize;
+    m_compress = compress;
+    m_isClosed = false;
+    m_thread.reset(new std::thread([this]{ run(); }));
+    m_prefix = prefix;
+    m_index = scanSegments(prefix);
+    m_cur.path = segmentPath(m_prefix, m_index);
+    if(!create(m_cur, m_segmentSize))
+        m_cur = Segment();
+    {
+        std::lock_guard<std::mutex> locker(m_mutex);
+        m_sparePath = segmentPath(m_prefix, m_index + 1);
+    }
+    m_cond.notify_one();
+}
+
+void MmapSink::prepare(const std::string& prefix)
+{
+    {
+        std::lock_guard<std::mutex> locker(m_mutex);
+        if(m_nextPrefix == prefix)
+            return;
+        //之前要求的别的前缀用不上了，建好的删掉，正在建的由后台线程建好后删掉
+        if(m_nextReady)
+        {
+            m_nextSeg.discard = true;
+            m_jobs.push_back(m_nextSeg);
+            m_nextSeg = Segment();
+            m_nextReady = false;
+        }
+        m_nextPrefix = prefix;
+    }
+    m_cond.notify_one();
+}
+
+//换前缀时当前段按写满处理，旧前缀的备用段删掉，改为准备新前缀的下一段
+bool MmapSink::reopen(const std::string& prefix)
+{
+    std::unique_lock<std::mutex> locker(m_mutex);
+    if(!m_nextReady || m_nextPrefix != prefix)
+    {
+        locker.unlock();
+        prepare(prefix);
+        return false;
+    }
+    Segment seg = m_nextSeg;
+    m_nextSeg = Segment();
+    m_nextReady = false;
+    m_nextPrefix.clear();
+    if(m_spareReady)
+    {
+        m_spare.discard = true;
+        m_jobs.push_back(m_spare);
+        m_spare = Segment();
+        m_spareReady = false;
+    }
+    m_prefix = prefix;
+    m_index = m_nextIndex;
+    m_sparePath = segmentPath(m_prefix, m_index + 1);
+    locker.unlock();
+    m_cond.notify_one();
+    if(m_cur.data)
+        retire(m_cur, m_compress, false);
+    m_cur = seg;
+    return true;
+}
+
+//只用后台线程建好的段，不在调用线程里建文件；上次没建成时再要求一次
+bool MmapSink::next(size_t minSize)
+{
+    std::unique_lock<std::mutex> locker(m_mutex);
+    if(!m_spareReady || m_spare.size < minSize)
+    {
+        if(!m_spareReady && m_sparePath.empty())
+        {
+            m_sparePath = segmentPath(m_prefix, m_index + 1);
+            locker.unlock();
+            m_cond.notify_one();
+        }
+        return false;
+    }
+    Segment seg = m_spare;
+    m_spare = Segment();
+    m_spareReady = false;
+    m_index++;
+    m_sparePath = segmentPath(m_prefix, m_index + 1);
+    locker.unlock();
+    m_cond.notify_one();
+    if(m_cur.data)
+        retire(m_cur, m_compress, false);
+    m_cur = seg;
+    return true;
+}
+
+bool MmapSink::append(const char* data, size_t len)
+{
+    if(len > remaining() && !next(len))
+        return false;
+    if(len == 0)
+        return true;
+    memcpy(m_cur.data + m_cur.used, data, len);
+    m_cur.used += len;
+    return true;
+}
+
+//把段交给后台线程收尾
+void MmapSink::retire(Segment& seg, bool compress, bool discard)
+{
+    seg.compress = compress;
+    seg.discard = discard;
+    {
+        std::lock_guard<std::mutex> locker(m_mutex);
+        m_jobs.push_back(seg);
+    }
+    m_cond.notify_one();
+    seg = Segment();
+}
+
+//截到实际长度，需要时压缩，解除映射并关闭
+void MmapSink::finish(Segment& seg)
+{
+    if(seg.discard)
+    {
+        munmap(seg.data, seg.size);
+        ::close(seg.fd);
+        unlink(seg.path.c_str());
+        return;
+    }
+    if(seg.leftover && !mapLeftover(seg))
+        return;
+    if(ftruncate(seg.fd, seg.used) != 0)
+    {
+        //截不掉时文件末尾留着0，不影响前面的内容
+    }
+    bool compressed = seg.compress && seg.used > 0 && compress(seg);
+    munmap(seg.data, seg.size);
+    ::close(seg.fd);
+    if(compressed || seg.used == 0)
+        unlink(seg.path.c_str());
+}
+
+//上次留下的段不知道写到哪里，整个映射进来，末尾的0压缩后几乎不占空间
+//已经压缩过（删原文件前退出了）或者全是0的直接删掉
+bool MmapSink::mapLeftover(Segment& seg)
+{
+    if(access((seg.path + ".gz").c_str(), F_OK) == 0)
+    {
+        unlink(seg.path.c_str());
+        return false;
+    }
+    seg.fd = ::open(seg.path.c_str(), O_RDWR | O_CLOEXEC);
+    if(seg.fd < 0)
+        return false;
+    struct stat st = {};
+    if(fstat(seg.fd, &st) != 0 || st.st_size == 0)
+    {
+        ::close(seg.fd);
+        if(st.st_size == 0)
+            unlink(seg.path.c_str());
+        return false;
+    }
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, seg.fd, 0);
+    if(data == MAP_FAILED)
+    {
+        ::close(seg.fd);
+        return false;
+    }
+    seg.data = static_cast<char*>(data);
+    seg.size = seg.used = st.st_size;
+    bool empty = std::all_of(seg.data, seg.data + seg.size, [](char c){ return c == 0; });
+    if(empty || !seg.compress)
+    {
+        munmap(seg.data, seg.size);
+        ::close(seg.fd);
+        if(empty)
+            unlink(seg.path.c_str());
+        return false;
+    }
+    return true;
+}
+
+//直接从映射的内存压缩，先写临时文件，写完再改名，压缩到一半退出时不会留下坏的.gz
+bool MmapSink::compress(const Segment& seg)
+{
+    std::string tmp = seg.path + ".gz.tmp";
+    char mode[8];
+    snprintf(mode, sizeof(mode), "wb%d", COMPRESS_LEVEL);
+    gzFile gz = gzopen(tmp.c_str(), mode);
+    if(!gz)
+        return false;
+    bool ok = true;
+    for(size_t offset = 0; offset < seg.used && ok;)
+    {
+        unsigned chunk = std::min<size_t>(seg.used - offset, 1 << 20);
+        ok = gzwrite(gz, seg.data + offset, chunk) == static_cast<int>(chunk);
+        offset += chunk;
+    }
+    ok = gzclose(gz) == Z_OK && ok;
+    if(ok)
+        ok = rename(tmp.c_str(), (seg.path + ".gz").c_str()) == 0;
+    if(!ok)
+        unlink(tmp.c_str());
+    return ok;
+}
+
+void MmapSink::run()
+{
+    std::unique_lock<std::mutex> locker(m_mutex);
+    while(true)
+    {
+        m_cond.wait(locker, [this]
+        {
+            return m_isClosed || !m_jobs.empty() || (!m_sparePath.empty() && !m_spareReady) ||
+                   (!m_nextPrefix.empty() && !m_nextReady);
+        });
+        //先准备下一段，写的一方可能马上要用
+        if(!m_sparePath.empty() && !m_spareReady && !m_isClosed)
+        {
+            Segment seg;
+            seg.path = m_sparePath;
+            locker.unlock();
+            bool ok = create(seg, m_segmentSize);
+            locker.lock();
+            if(ok && m_sparePath == seg.path)
+            {
+                m_spare = seg;
+                m_spareReady = true;
+            }
+            else
+            {
+                if(ok)
+                {
+                    seg.discard = true;
+                    m_jobs.push_back(seg);
+                }
+                if(m_sparePath == seg.path)
+                    m_sparePath.clear();
+            }
+            continue;
+        }
+        //下一个前缀的第一段，扫描目录确定序号，顺便把这个前缀上次留下的段交给自己收尾
+        if(!m_nextPrefix.empty() && !m_nextReady && !m_isClosed)
+        {
+            std::string prefix = m_nextPrefix;
+            locker.unlock();
+            int index = scanSegments(prefix);
+            Segment seg;
+            seg.path = segmentPath(prefix, index);
+            bool ok = create(seg, m_segmentSize);
+            locker.lock();
+            if(ok && m_nextPrefix == prefix)
+            {
+                m_nextSeg = seg;
+                m_nextIndex = index;
+                m_nextReady = true;
+            }
+            else
+            {
+                if(ok)
+                {
+                    seg.discard = true;
+                    m_jobs.push_back(seg);
+                }
+                if(m_nextPrefix == prefix)
+                    m_nextPrefix.clear();
+            }
+            continue;
+        }
+        if(!m_jobs.empty())
+        {
+            Segment seg = m_jobs.front();
+            m_jobs.pop_front();
+            locker.unlock();
+            finish(seg);
+            locker.lock();
+            continue;
+        }
+        if(m_isClosed)
+            break;
+    }
+}
+
+void MmapSink::close()
+{
+    if(!m_thread)
+        return;
+    if(m_cur.data)
+        retire(m_cur, false, false);
+    {
+        std::lock_guard<std::mutex> locker(m_mutex);
+        if(m_spareReady)
+        {
+            m_spare.discard = true;
+            m_jobs.push_back(m_spare);
+            m_spare = Segment();
+            m_spareReady = false;
+        }
+        if(m_nextReady)
+        {
+            m_nextSeg.discard = true;
+            m_jobs.push_back(m_nextSeg);
+            m_nextSeg = Segment();
+            m_nextReady = false;
+        }
+        m_sparePath.clear();
+        m_nextPrefix.clear();
+        m_isClosed = true;
+    }
+    m_cond.notify_one();
+    m_thread->join();
+    m_thread.reset();
+}
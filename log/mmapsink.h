@@ -0,0 +1,95 @@
+#pragma once
+#include<mutex>
+#include<thread>
+#include<deque>
+#include<string>
+#include<memory>
+#include<condition_variable>
+
+//日志文件按段写：每段是预先分配好大小的文件，映射到内存后直接memcpy追加，不再每次调用write
+//段写满（或者调用方要求换段）后交给后台线程：截到实际长度、解除映射、关闭，需要时压缩成.gz再删掉原文件
+//后台线程还会提前建好下一段并预先映射好页，以及prepare要求的下一个前缀（比如第二天）的第一段
+//换段和换前缀只取后台线程建好的段，只是换一下指针；还没建好时返回false，调用方接着写当前段或者丢掉这次写入
+//除了启动时的open，调用方不会等文件打开、关闭、目录扫描和压缩
+//第一段的文件名是prefix+suffix，之后是prefix-序号+suffix；重启后接着已有的最大序号往后写
+//进程没正常退出时当前段和预先建好的段末尾是0，下次用同一个前缀打开时由后台线程压缩或删掉，读的一方遇到0就算结束
+//只有一个线程写，或者调用方自己加锁；一个目录只由一个进程写
+class MmapSink
+{
+public:
+    MmapSink();
+    ~MmapSink();
+
+    MmapSink(const MmapSink&) = delete;
+    MmapSink& operator=(const MmapSink&) = delete;
+
+    //segmentSize是每段的大小，compress为true时写满的段压缩成.gz；第一段在调用线程里建，只在启动时调用
+    void open(const std::string& dir, const std::string& prefix, const std::string& suffix, size_t segmentSize, bool compress);
+    //让后台线程扫描目录，提前建好prefix的第一个没用过的序号的段
+    void prepare(const std::string& prefix);
+    //换到prepare建好的前缀（比如日期变了）；还没建好时返回false并要求后台线程去建，当前段不变
+    bool reopen(const std::string& prefix);
+    //当前段写满，换到后台线程建好的下一段；还没建好或者放不下minSize字节时返回false，当前段不变
+    bool next(size_t minSize = 0);
+    //当前段剩余的空间；一次写入超过剩余空间时append自动换段，调用方要在新段开头写东西时自己先next
+    size_t remaining() const
+    {
+        return m_cur.size - m_cur.used;
+    }
+    //放不下又没法换段时丢掉这次写入，返回false
+    bool append(const char* data, size_t len);
+    bool isOpen() const
+    {
+        return m_cur.data != nullptr;
+    }
+    //结束当前段，等后台线程处理完已经交给它的段
+    void close();
+
+private:
+    struct Segment
+    {
+        std::string path;
+        int fd = -1;
+        char* data = nullptr;
+        size_t size = 0;
+        size_t used = 0;
+        bool compress = false;  //收尾时压缩
+        bool discard = false;   //没用上的段，收尾时删掉
+        bool leftover = false;  //上次没正常退出留下的段，还没映射
+    };
+
+    std::string segmentPath(const std::string& prefix, int index) const;
+    int scanSegments(const std::string& prefix);
+    bool create(Segment& seg, size_t size) const;
+    void retire(Segment& seg, bool compress, bool discard);
+    void finish(Segment& seg);
+    bool mapLeftover(Segment& seg);
+    bool compress(const Segment& seg);
+    void run();
+
+    //写满后压缩用的级别，日志多的时候后台线程要跟得上
+    static const int COMPRESS_LEVEL = 1;
+
+    std::string m_dir;
+    std::string m_prefix;
+    std::string m_suffix;
+    size_t m_segmentSize;
+    bool m_compress;
+    int m_index;
+    Segment m_cur;
+
+    //后台线程：待收尾的段、预先建好的下一段；m_sparePath不为空表示要它建这个文件
+    std::deque<Segment> m_jobs;
+    std::string m_sparePath;
+    Segment m_spare;
+    bool m_spareReady;
+    //prepare要求的前缀和建好的第一段，m_nextIndex是这一段的序号
+    std::string m_nextPrefix;
+    Segment m_nextSeg;
+    int m_nextIndex;
+    bool m_nextReady;
+    bool m_isClosed;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::unique_ptr<std::thread> m_thread;
+};
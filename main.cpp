@@ -1,21 +1,117 @@
 #include<unistd.h>
+#include<stdlib.h>
+#include<string.h>
 #include<iostream>
 #include"server/webserver.h"
 
-int main()
+int main(int argc, char* argv[])
 {
     int port = 8081;
     int trigMode = 3;
-    int timeout = 60000;
+    int timeout = 60000;    //连接的空闲超时（毫秒），0表示不超时
     bool optLinger = false; 
     int threadNumber = 4;
+    int maxThreadNumber = 0;    //线程池最多的线程数，0表示核数的两倍
     bool openLog = false;
     int logLevel = 1;
     int logSize = 1024;
-    WebServer server(port, trigMode, timeout, optLinger, threadNumber, openLog, logLevel, logSize);
+    int logRate = 0;        //每个日志调用点每秒最多写的行数，0表示不限
+    bool binaryLog = false; //二进制日志，用logdecoder转成文本
+    int accessLog = -1;     //访问日志的格式，-1不记录
+    int reactorNumber = 0;  //0:单reactor+线程池，n:n个reactor线程
+    int ioMode = Reactor::IO_EPOLL;
+    int fileCacheMB = 64;   //静态文件缓存的容量
+    int sendfileKB = 64;    //不小于这个大小的文件用sendfile发送
+    int poolMode = WebServer::POOL_STEAL;
+    bool pinCpu = false;    //线程池的线程绑定到核上
+    //读缓冲区用镜像环形缓冲区；每个在用的缓冲区占两个映射，进程的映射数上限vm.max_map_count默认65530，
+    //大约3.2万个同时有数据的连接就会用完，之后映射失败的连接退回块缓冲区，连接很多时调大这个上限
+    bool ringBuffer = false;
+    int memoryMB = 0;       //进程RSS的上限，超过时关闭空闲最久的连接，0表示不限制
+    int maxRequests = 1000; //每个长连接最多处理的请求数，0表示不限制
+
+    //命令行参数，便于在同一台机器上对比不同的模型
+    int opt;
+    while((opt = getopt(argc, argv, "p:t:T:r:i:c:s:w:al:bR:A:mM:k:n:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 't':
+                threadNumber = atoi(optarg);
+                break;
+            case 'T':
+                maxThreadNumber = atoi(optarg);
+                break;
+            case 'r':
+                reactorNumber = atoi(optarg);
+                if(reactorNumber < 0)
+                    reactorNumber = std::thread::hardware_concurrency();
+                break;
+            case 'i':
+                ioMode = (strcmp(optarg, "uring") == 0) ? Reactor::IO_URING : Reactor::IO_EPOLL;
+                break;
+            case 'c':
+                fileCacheMB = atoi(optarg);
+                break;
+            case 's':
+                sendfileKB = atoi(optarg);
+                break;
+            case 'w':
+                if(strcmp(optarg, "queue") == 0)
+                    poolMode = WebServer::POOL_QUEUE;
+                else if(strcmp(optarg, "affine") == 0)
+                    poolMode = WebServer::POOL_AFFINE;
+                else
+                    poolMode = WebServer::POOL_STEAL;
+                break;
+            case 'a':
+                pinCpu = true;
+                break;
+            case 'l':
+                openLog = true;
+                logLevel = atoi(optarg);
+                break;
+            case 'b':
+                binaryLog = true;
+                break;
+            case 'R':
+                logRate = atoi(optarg);
+                break;
+            case 'm':
+                ringBuffer = true;
+                break;
+            case 'M':
+                memoryMB = atoi(optarg);
+                break;
+            case 'k':
+                timeout = atoi(optarg) * 1000;
+                break;
+            case 'n':
+                maxRequests = atoi(optarg);
+                break;
+            case 'A':
+                accessLog = (strcmp(optarg, "common") == 0) ? AccessLog::COMMON : AccessLog::COMBINED;
+                break;
+            default:
+                std::cout << "usage: " << argv[0] << " [-p port] [-t minThreads] [-T maxThreads] [-r reactors] [-i epoll|uring] [-c cacheMB] [-s sendfileKB] [-w steal|queue|affine] [-a] [-l logLevel] [-b] [-R logLinesPerSec] [-A common|combined] [-m] [-M memoryMB] [-k keepAliveSec] [-n maxRequests]" << std::endl;
+                return 1;
+        }
+    }
+    if(maxThreadNumber <= 0)
+        maxThreadNumber = 2 * std::thread::hardware_concurrency();
+    Log::instance()->setRateLimit(std::max(logRate, 0));
+    WebServer server(port, trigMode, timeout, optLinger, threadNumber, openLog, logLevel, logSize, binaryLog, accessLog, reactorNumber, ioMode, fileCacheMB, sendfileKB, poolMode, pinCpu, maxThreadNumber, ringBuffer, memoryMB, maxRequests);
+    if(server.isClosed())
+    {
+        std::cerr << "Server init error" << std::endl;
+        return 1;
+    }
     std::cout << "port is " << port << std::endl;
     server.start();
     return 0;
 }
 
-//http://localhost:8081/index.html
\ No newline at end of file
+//http://localhost:8081/index.html
@@ -0,0 +1,22 @@
+#include"connectionslab.h"
+
+ConnectionSlab::ConnectionSlab(size_t capacity) : m_capacity(capacity), m_constructed(capacity, 0)
+{
+    static_assert(alignof(HttpConnection) <= CACHE_LINE, "slot alignment");
+    //mmap的内存按页对齐，只预留地址空间，没有用到的槽不占物理内存
+    void* mem = mmap(nullptr, m_capacity * SLOT_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    m_memory = mem == MAP_FAILED ? nullptr : static_cast<char*>(mem);
+}
+
+ConnectionSlab::~ConnectionSlab()
+{
+    if(!m_memory)
+        return;
+    for(size_t i = 0; i < m_capacity; i++)
+    {
+        if(m_constructed[i])
+            slot(i)->~HttpConnection();
+    }
+    munmap(m_memory, m_capacity * SLOT_SIZE);
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include<vector>
+#include<new>
+#include<sys/mman.h>
+#include<assert.h>
+#include"../http/httpconnection.h"
+
+//按fd下标存放连接的预分配表，代替unordered_map<int, HttpConnection>
+//整块内存一次mmap预留，每个槽按缓存行对齐，第一次用到某个fd时才构造连接（此时才真正占用物理页）
+//连接关闭后对象和它的缓冲区都留在槽里，下一个复用该fd的连接直接initHttpConn
+class ConnectionSlab
+{
+public:
+    explicit ConnectionSlab(size_t capacity);
+    ~ConnectionSlab();
+
+    ConnectionSlab(const ConnectionSlab&) = delete;
+    ConnectionSlab& operator=(const ConnectionSlab&) = delete;
+
+public:
+    //取fd对应的连接，槽还没用过就先构造
+    HttpConnection* get(int fd)
+    {
+        assert(fd >= 0 && static_cast<size_t>(fd) < m_capacity);
+        HttpConnection* conn = slot(fd);
+        if(!m_constructed[fd])
+        {
+            new(conn) HttpConnection();
+            m_constructed[fd] = 1;
+        }
+        return conn;
+    }
+
+    size_t capacity() const
+    {
+        return m_capacity;
+    }
+
+    //预留地址空间失败（ulimit -v、overcommit限制）时为false，reactor不能启动
+    bool valid() const
+    {
+        return m_memory != nullptr;
+    }
+
+    //遍历构造过的槽，包括已经关闭的连接
+    template<typename F>
+    void forEach(F f)
+    {
+        for(size_t i = 0; i < m_capacity; i++)
+        {
+            if(m_constructed[i])
+                f(slot(i));
+        }
+    }
+
+private:
+    static const size_t CACHE_LINE = 64;
+    //每个槽占用的字节数，向上取整到缓存行
+    static const size_t SLOT_SIZE = (sizeof(HttpConnection) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+
+    HttpConnection* slot(int fd)
+    {
+        return reinterpret_cast<HttpConnection*>(m_memory + static_cast<size_t>(fd) * SLOT_SIZE);
+    }
+
+    size_t m_capacity;
+    char* m_memory;
+    std::vector<uint8_t> m_constructed;
+};
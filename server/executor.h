@@ -0,0 +1,55 @@
+#pragma once
+#include<stdint.h>
+#include<vector>
+#include<time.h>
+#include"task.h"
+
+//线程池的排队统计，waitNS是任务从加入到开始执行的时间
+struct PoolStats
+{
+    uint64_t tasks = 0;         //已经开始执行的任务数
+    uint64_t waitNS = 0;        //排队时间之和
+    uint64_t maxWaitNS = 0;     //上次取统计以来最长的排队时间
+    uint64_t steals = 0;        //从其他线程的队列偷来的任务数
+    uint64_t reassigns = 0;     //连接因为所属线程太忙被改派的次数
+    uint64_t threads = 0;       //当前的线程数
+    uint64_t scaleUps = 0;      //增加线程的次数
+    uint64_t scaleDowns = 0;    //减少线程的次数
+};
+
+//线程池一次伸缩的记录和当时的依据
+struct ScaleEvent
+{
+    int64_t timeNS;         //CLOCK_MONOTONIC
+    size_t from;
+    size_t to;
+    uint64_t waitNS;        //这个周期任务的平均排队时间
+    double busy;            //这个周期线程忙碌时间的比例
+};
+
+//reactor把连接的读写交给Executor执行，具体是哪种线程池由WebServer决定
+class Executor
+{
+public:
+    virtual ~Executor() {}
+
+    //任务按值传入，线程池内部只移动它
+    virtual void addTask(Task task) = 0;
+    //key相同的任务尽量由同一个线程执行，不区分的线程池忽略key
+    virtual void addTask(Task task, int key)
+    {
+        addTask(std::move(task));
+    }
+    //取累计的统计，maxWaitNS取完后清零
+    virtual PoolStats stats() = 0;
+    virtual const char* name() const = 0;
+    //取走上次以来的伸缩记录，线程数固定的线程池没有记录
+    virtual void takeScaleEvents(std::vector<ScaleEvent>& events) {}
+
+    static int64_t nowNS()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+};
@@ -0,0 +1,880 @@
+#include<malloc.h>
+#include<poll.h>
+#include<sys/eventfd.h>
+#include<algorithm>
+#include"reactor.h"
+
+size_t Reactor::memoryLimit = 0;
+std::atomic<int64_t> Reactor::s_memoryStatsTime(0);
+
+Reactor::Reactor(int port, int timeout, bool optLinger, uint32_t listenEvent, uint32_t connEvent,
+bool reusePort, Executor* threadpool, int ioMode) :
+    m_timer(new TimerManager(&Reactor::onTimeout, this)), m_epoller(new Epoller()), m_users(new ConnectionSlab(MAX_FD))
+{
+    m_ioMode = ioMode;
+    m_port = port;
+    m_timeout = timeout;
+    m_openLinger = optLinger;
+    m_reusePort = reusePort;
+    m_isClosed = false;
+    m_listenFd = -1;
+    m_listenEvent = listenEvent;
+    m_connEvent = connEvent;
+    m_threadpool = threadpool;
+    m_statsTime = TimerManager::nowMS();
+    m_inlineRequests = 0;
+    m_offloadRequests = 0;
+    m_lastInline = 0;
+    m_lastOffload = 0;
+    m_memoryTime = m_statsTime;
+    m_wakeFd = -1;
+}
+
+Reactor::~Reactor()
+{
+    if(m_listenFd >= 0)
+        close(m_listenFd);
+    //线程池先于reactor销毁，之后不会再有任务写m_wakeFd
+    if(m_wakeFd >= 0)
+        close(m_wakeFd);
+    m_isClosed = true;
+}
+
+bool Reactor::initSocket()
+{
+    int ret;
+    struct sockaddr_in addr;
+    if(m_port > 65535 || m_port < 1024)
+    {
+        LOG_ERROR("Port:%d error!",  m_port);
+        return false;
+    }
+    if(!m_users->valid())
+    {
+        LOG_ERROR("Connection slab mmap error!");
+        return false;
+    }
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(m_port);
+    struct linger optLinger;
+    optLinger = {0};
+    //设置优雅关闭，close时等待一段时间把剩余数据发送完
+    if(m_openLinger)
+    {
+        optLinger.l_onoff = 1;
+        optLinger.l_linger = 1;
+    }
+    m_listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if(m_listenFd < 0)
+    {
+        LOG_ERROR("Create socket error!", m_port);
+        return false;
+    }
+    ret = setsockopt(m_listenFd, SOL_SOCKET, SO_LINGER, &optLinger, sizeof(optLinger));
+    if(ret < 0)
+    {
+        close(m_listenFd);
+        LOG_ERROR("Init linger error!", m_port);
+        return false;
+    }
+
+    //设置端口复用，避免timewait时占用端口
+    int optval = 1;
+    ret = setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, (const void*)&optval, sizeof(int));
+    if(ret == -1)
+    {
+        LOG_ERROR("set socket setsockopt error !");
+        close(m_listenFd);
+        return false;
+    }
+
+    //多reactor模式下每个reactor绑定同一端口，由内核把新连接分散到各个监听套接字
+    if(m_reusePort)
+    {
+        ret = setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEPORT, (const void*)&optval, sizeof(int));
+        if(ret == -1)
+        {
+            LOG_ERROR("set SO_REUSEPORT error !");
+            close(m_listenFd);
+            return false;
+        }
+    }
+
+    //绑定监听套接字
+    ret = bind(m_listenFd, (struct sockaddr*)&addr, sizeof(addr));
+    if(ret < 0)
+    {
+        LOG_ERROR("Bind Port:%d error!", m_port);
+        close(m_listenFd);
+        return false;
+    }
+
+    //监听端口
+    ret = listen(m_listenFd, 5);
+    if(ret < 0)
+    {
+        LOG_ERROR("Listen port:%d error!", m_port);
+        close(m_listenFd);
+        return false;
+    }
+
+    //把监听套接字注册到epoll事件表里，io_uring模式在loop开始时提交accept
+    //监听套接字的data.ptr为空，和连接区分开
+    if(m_ioMode == IO_EPOLL && !m_epoller->addFd(m_listenFd, m_listenEvent | EPOLLIN, nullptr))
+    {
+        LOG_ERROR("Add listen error!");
+        close(m_listenFd);
+        return false;
+    }
+
+    //监听套接字非阻塞
+    setFdNonblock(m_listenFd);
+    LOG_INFO("Server port:%d", m_port);
+    return true;
+}
+
+//新建连接
+void Reactor::addConnection(int fd, sockaddr_in addr)
+{
+    assert(fd > 0);
+    //初始化连接信息，槽里的对象和缓冲区是复用的
+    HttpConnection* client = m_users->get(fd);
+    client->initHttpConn(fd, addr);
+    //设置定时器
+    if(m_timeout > 0)
+    {
+        client->timerNode()->data = client;
+        m_timer->addTimer(client->timerNode(), m_timeout);
+    }
+    //注册到事件表
+    m_epoller->addFd(fd, EPOLLIN | m_connEvent, client);
+    setFdNonblock(fd);
+    setFdNoDelay(fd);
+    LOG_INFO("Client[%d] in!", client->getFd());
+}
+
+//关闭连接
+void Reactor::closeConnection(HttpConnection* client)
+{
+    assert(client);
+    if(m_uring)
+    {
+        //还有在途的请求或者连接在线程池里时不能close，否则fd可能被新连接复用；shutdown让这些请求尽快完成
+        HttpConnection::UringState& state = client->uringState();
+        if(state.closing)
+            return;
+        LOG_INFO("Client[%d] quit!", client->getFd());
+        m_timer->del(client->timerNode());
+        state.closing = true;
+        if(state.recving || state.sending || state.working)
+            shutdown(client->getFd(), SHUT_RDWR);
+        tryCloseUring(client);
+        return;
+    }
+    LOG_INFO("Client[%d] quit!", client->getFd());
+    //线程池模式下可能在工作线程里关闭，计时器只能由reactor线程操作，留到超时再处理
+    if(!m_threadpool)
+    {
+        m_timer->del(client->timerNode());
+    }
+    m_epoller->delFd(client->getFd());
+    client->closeHttpConn();
+}
+
+void Reactor::sendError(int fd, const char* info)
+{
+    assert(fd > 0);
+    int ret = send(fd, info, strlen(info), 0);
+    if(ret < 0)
+    {
+        LOG_WARN("send error to client[%d] error!", fd);
+    }
+    close(fd);
+}
+
+//重置定时器
+void Reactor::extentTime(HttpConnection* client)
+{
+    assert(client);
+    if(m_timeout > 0)
+    {
+        m_timer->update(client->timerNode(), m_timeout);
+    }
+}
+
+//时间轮的超时回调
+void Reactor::onTimeout(void* reactor, void* client)
+{
+    static_cast<Reactor*>(reactor)->closeConnection(static_cast<HttpConnection*>(client));
+}
+
+//处理监听套接字，触发后就建立新连接
+void Reactor::handleListen()
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    do
+    {
+        int fd = accept(m_listenFd, (struct sockaddr*)&addr, &len);
+        if(fd <= 0)
+        {
+            return;
+        }
+        else if(HttpConnection::userCount >= MAX_FD || fd >= MAX_FD)
+        {
+            sendError(fd, "Server busy");
+            LOG_WARN("Clients is full!");
+            return;
+        }
+        addConnection(fd, addr);
+    }while(m_listenEvent & EPOLLET);    //监听需要持续进行
+}
+
+//处理读行为：reactor直接读取、解析并尝试应答，有线程池时只把需要读盘、sendfile或者带消息体的请求交给线程池
+void Reactor::handleRead(HttpConnection* client)
+{
+    assert(client);
+    extentTime(client);
+    onRead(client, m_threadpool != nullptr);
+}
+
+//写内存里的应答不会阻塞，直接在reactor线程写；还有sendfile发送的文件时可能读盘，交给线程池
+void Reactor::handleWrite(HttpConnection* client)
+{
+    assert(client);
+    extentTime(client);
+    if(m_threadpool && client->hasFileToSend())
+    {
+        m_threadpool->addTask([this, client] { onWrite(client, false); }, client->getFd());
+    }
+    else
+    {
+        onWrite(client, m_threadpool != nullptr);
+    }
+}
+
+void Reactor::onRead(HttpConnection* client, bool inlineOnly)
+{
+    assert(client);
+    int ret = -1;
+    int readErrno = 0;
+    ret = client->readBuffer(&readErrno);    //读取数据
+    if(ret <= 0 && readErrno != EAGAIN)     //连接关闭
+    {
+        closeConnection(client);
+        return;
+    }
+    //大的请求体或者很长的流水线，解析也要花时间
+    if(inlineOnly && client->readBytes() > INLINE_MAX_READ)
+    {
+        m_threadpool->addTask([this, client] { onProcess(client, false); }, client->getFd());
+        return;
+    }
+    onProcess(client, inlineOnly);
+}
+
+void Reactor::onWrite(HttpConnection* client, bool inlineOnly)
+{
+    assert(client);
+    int ret = -1;
+    int writeErrno = 0;
+    ret = client->writeBuffer(&writeErrno);
+    //没有写入新的数据
+    if(client->writeBytes() == 0)
+    {
+        //如果是长连接，不断开
+        if(client->isKeepAlive())
+        {
+            onProcess(client, inlineOnly);
+            return;
+        }
+    }
+    else if(ret < 0)
+    {
+        //缓冲区满了,继续传输
+        if(writeErrno == EAGAIN)
+        {
+            m_epoller->modFd(client->getFd(), m_connEvent | EPOLLOUT, client);
+            return;
+        }
+    }
+    closeConnection(client);
+}
+
+void Reactor::onProcess(HttpConnection* client, bool inlineOnly)
+{
+    //已经有http请求，马上尝试发送，写不完再等EPOLLOUT
+    if(client->handleHttpConn(inlineOnly))
+    {
+        if(inlineOnly || !m_threadpool)
+            m_inlineRequests.fetch_add(client->responseCount(), std::memory_order_relaxed);
+        else
+            m_offloadRequests.fetch_add(client->responseCount(), std::memory_order_relaxed);
+        onWrite(client, inlineOnly);
+    }
+    //下一个请求不能在reactor线程应答
+    else if(client->hasDeferred())
+    {
+        m_threadpool->addTask([this, client] { onProcess(client, false); }, client->getFd());
+    }
+    //无http请求，可读；没有剩下半个请求时连接空闲，先释放缓冲区
+    else
+    {
+        if(client->readBytes() == 0)
+            client->releaseIdle();
+        m_epoller->modFd(client->getFd(), m_connEvent | EPOLLIN, client);
+    }
+}
+
+int Reactor::setFdNonblock(int fd)
+{
+    assert(fd > 0);
+    return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+int Reactor::setFdNoDelay(int fd)
+{
+    assert(fd > 0);
+    int optval = 1;
+    return setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+}
+
+void Reactor::loop()
+{
+    //io_uring只允许创建它的线程提交请求，所以在reactor线程里创建
+    if(m_ioMode == IO_URING)
+    {
+        m_uring.reset(new IoUring());
+        //有线程池时还要一个eventfd，线程池处理完的连接通过它交回reactor线程
+        if(m_threadpool && m_wakeFd < 0)
+            m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if(m_uring->init() && (!m_threadpool || m_wakeFd >= 0))
+        {
+            loopUring();
+            return;
+        }
+        LOG_WARN("io_uring unavailable, fall back to epoll");
+        m_uring.reset();
+        m_epoller->addFd(m_listenFd, m_listenEvent | EPOLLIN, nullptr);
+    }
+    int timeMS = -1;//epoll默认一直阻塞
+    while(!m_isClosed)
+    {
+        if(m_timeout > 0)
+        {
+            timeMS = m_timer->getNextHandle();//最小超时时间
+        }
+        //有内存上限时没有事件也要定期检查
+        if(memoryLimit > 0 && (timeMS < 0 || timeMS > MEMORY_CHECK_MS))
+        {
+            timeMS = MEMORY_CHECK_MS;
+        }
+        int eventCnt = m_epoller->wait(timeMS);//等到计时结束关闭连接还没触发就退出等待
+        for(int i = 0; i < eventCnt; i++)
+        {
+            //获取触发的连接和event，data.ptr为空的是监听套接字
+            HttpConnection* client = static_cast<HttpConnection*>(m_epoller->getEventPtr(i));
+            uint32_t events = m_epoller->getEvents(i);
+
+            //有新连接
+            if(client == nullptr)
+            {
+                handleListen();
+            }
+            //对端已关闭连接
+            else if(events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            {
+                closeConnection(client);
+            }
+            //读
+            else if(events & EPOLLIN)
+            {
+                handleRead(client);
+            }
+            //写
+            else if(events & EPOLLOUT)
+            {
+                handleWrite(client);
+            }
+            else
+            {
+                LOG_ERROR("Unexpected event");
+            }
+        }
+        if(m_threadpool)
+        {
+            logPoolStats();
+        }
+        checkMemory();
+    }
+}
+
+//每隔一段时间记录线程池这段时间的任务数、排队时间和伸缩
+void Reactor::logPoolStats()
+{
+    int64_t now = TimerManager::nowMS();
+    if(now - m_statsTime < STATS_INTERVAL_MS)
+        return;
+    m_statsTime = now;
+    PoolStats stats = m_threadpool->stats();
+    uint64_t tasks = stats.tasks - m_lastStats.tasks;
+    if(tasks > 0)
+    {
+        LOG_INFO("Pool[%s]: %llu threads, %llu tasks, avg wait %lluus, max wait %lluus, %llu steals, %llu reassigns",
+                 m_threadpool->name(), (unsigned long long)stats.threads, (unsigned long long)tasks,
+                 (unsigned long long)((stats.waitNS - m_lastStats.waitNS) / tasks / 1000),
+                 (unsigned long long)(stats.maxWaitNS / 1000),
+                 (unsigned long long)(stats.steals - m_lastStats.steals),
+                 (unsigned long long)(stats.reassigns - m_lastStats.reassigns));
+    }
+    m_lastStats = stats;
+    //两条路径上应答的请求数
+    uint64_t inlineRequests = m_inlineRequests.load(std::memory_order_relaxed);
+    uint64_t offloadRequests = m_offloadRequests.load(std::memory_order_relaxed);
+    uint64_t requests = inlineRequests - m_lastInline + offloadRequests - m_lastOffload;
+    if(requests > 0)
+    {
+        LOG_INFO("Requests: %llu inline (%.1f%%), %llu offloaded", (unsigned long long)(inlineRequests - m_lastInline),
+                 100.0 * (inlineRequests - m_lastInline) / requests, (unsigned long long)(offloadRequests - m_lastOffload));
+    }
+    m_lastInline = inlineRequests;
+    m_lastOffload = offloadRequests;
+    //线程池伸缩的记录和依据
+    m_scaleEvents.clear();
+    m_threadpool->takeScaleEvents(m_scaleEvents);
+    for(const ScaleEvent& event : m_scaleEvents)
+    {
+        LOG_INFO("Pool[%s]: %zu -> %zu threads, avg wait %lluus, busy %d%%", m_threadpool->name(), event.from, event.to,
+                 (unsigned long long)(event.waitNS / 1000), static_cast<int>(event.busy * 100));
+    }
+}
+
+//RSS从/proc/self/statm的第二列读，单位是页
+size_t Reactor::residentBytes()
+{
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if(!fp)
+        return 0;
+    unsigned long size = 0, resident = 0;
+    int n = fscanf(fp, "%lu %lu", &size, &resident);
+    fclose(fp);
+    return n == 2 ? resident * sysconf(_SC_PAGESIZE) : 0;
+}
+
+void Reactor::checkMemory()
+{
+    int64_t now = TimerManager::nowMS();
+    if(now - m_memoryTime < MEMORY_CHECK_MS)
+        return;
+    m_memoryTime = now;
+    int64_t last = s_memoryStatsTime.load(std::memory_order_relaxed);
+    bool logStats = now - last >= STATS_INTERVAL_MS && s_memoryStatsTime.compare_exchange_strong(last, now);
+    if(memoryLimit == 0 && !logStats)
+        return;
+    size_t rss = residentBytes();
+    size_t users = HttpConnection::userCount;
+    if(logStats)
+    {
+        LOG_INFO("Memory: rss %zuMB, %zu connections, %.1fKB/connection", rss >> 20, users,
+                 users ? rss / 1024.0 / users : 0.0);
+    }
+    if(memoryLimit == 0 || rss <= memoryLimit || users == 0)
+        return;
+    //按平均每个连接占用的内存估算要关闭的连接数
+    size_t perConnection = std::max<size_t>(rss / users, 1);
+    shedIdle((rss - memoryLimit) / perConnection + 1, users);
+}
+
+//所有reactor一共要关闭total个连接，本reactor按自己的空闲连接数分摊，关闭其中空闲最久的
+//关闭后把堆里空闲的内存还给系统；分摊得不准时下一次检查再补
+void Reactor::shedIdle(size_t total, size_t users)
+{
+    int64_t now = TimerManager::nowMS();
+    std::vector<std::pair<int64_t, HttpConnection*>> idle;
+    m_users->forEach([&](HttpConnection* client)
+    {
+        int64_t since = client->idleSince();
+        if(since > 0 && now - since >= MIN_IDLE_MS)
+            idle.emplace_back(since, client);
+    });
+    size_t count = std::min(idle.size(), (total * idle.size() + users - 1) / users);
+    if(count == 0)
+        return;
+    std::nth_element(idle.begin(), idle.begin() + count - 1, idle.end());
+    for(size_t i = 0; i < count; i++)
+    {
+        HttpConnection* client = idle[i].second;
+        m_timer->del(client->timerNode());
+        closeConnection(client);
+    }
+    malloc_trim(0);
+    LOG_WARN("Memory over %zuMB, closed %zu idle connections", memoryLimit >> 20, count);
+}
+
+uint64_t Reactor::uringData(int op, int fd)
+{
+    return (static_cast<uint64_t>(op) << 32) | static_cast<uint32_t>(fd);
+}
+
+void Reactor::loopUring()
+{
+    int timeMS = -1;
+    m_uring->prepAcceptMultishot(m_listenFd, uringData(OP_ACCEPT, m_listenFd));
+    if(m_threadpool)
+    {
+        m_uring->prepPollAdd(m_wakeFd, POLLIN, uringData(OP_WAKE, m_wakeFd));
+    }
+    while(!m_isClosed)
+    {
+        if(m_timeout > 0)
+        {
+            timeMS = m_timer->getNextHandle();
+        }
+        if(memoryLimit > 0 && (timeMS < 0 || timeMS > MEMORY_CHECK_MS))
+        {
+            timeMS = MEMORY_CHECK_MS;
+        }
+        //提交上一轮产生的请求，同时等待新的完成事件，一次系统调用
+        int eventCnt = m_uring->wait(timeMS);
+        for(int i = 0; i < eventCnt; i++)
+        {
+            uint64_t data = m_uring->getUserData(i);
+            int op = static_cast<int>(data >> 32);
+            int fd = static_cast<int>(data & 0xffffffff);
+            int res = m_uring->getRes(i);
+            uint32_t flags = m_uring->getFlags(i);
+            switch(op)
+            {
+                case OP_ACCEPT:
+                    onAcceptUring(res, flags);
+                    break;
+                case OP_RECV:
+                    onRecvUring(m_users->get(fd), res, flags);
+                    break;
+                case OP_SEND:
+                    onSendUring(m_users->get(fd), res);
+                    break;
+                case OP_POLL:
+                    onPollUring(m_users->get(fd), res);
+                    break;
+                case OP_WAKE:
+                    onWakeUring();
+                    break;
+                default:
+                    LOG_ERROR("Unexpected completion");
+                    break;
+            }
+        }
+        if(m_threadpool)
+        {
+            logPoolStats();
+        }
+        checkMemory();
+    }
+}
+
+//新连接：初始化后提交multishot recv
+void Reactor::onAcceptUring(int res, uint32_t flags)
+{
+    //multishot accept被内核终止，重新提交
+    if(!(flags & IORING_CQE_F_MORE))
+    {
+        m_uring->prepAcceptMultishot(m_listenFd, uringData(OP_ACCEPT, m_listenFd));
+    }
+    if(res < 0)
+    {
+        LOG_WARN("accept error: %d", -res);
+        return;
+    }
+    int fd = res;
+    if(HttpConnection::userCount >= MAX_FD || fd >= MAX_FD)
+    {
+        sendError(fd, "Server busy");
+        LOG_WARN("Clients is full!");
+        return;
+    }
+    sockaddr_in addr = {0};
+    socklen_t len = sizeof(addr);
+    getpeername(fd, (struct sockaddr*)&addr, &len);
+    HttpConnection* client = m_users->get(fd);
+    client->initHttpConn(fd, addr);
+    if(m_timeout > 0)
+    {
+        client->timerNode()->data = client;
+        m_timer->addTimer(client->timerNode(), m_timeout);
+    }
+    //大文件用sendfile发送，写满socket时等可写，不能阻塞
+    setFdNonblock(fd);
+    setFdNoDelay(fd);
+    client->uringState().recving = true;
+    m_uring->prepRecvMultishot(fd, uringData(OP_RECV, fd));
+    LOG_INFO("Client[%d] in!", fd);
+}
+
+void Reactor::onRecvUring(HttpConnection* client, int res, uint32_t flags)
+{
+    HttpConnection::UringState& state = client->uringState();
+    if(!(flags & IORING_CQE_F_MORE))
+    {
+        state.recving = false;
+    }
+    //数据从provided buffer拷到连接的读缓冲区，缓冲区马上归还给内核；连接在线程池里时先暂存
+    if(flags & IORING_CQE_F_BUFFER)
+    {
+        uint16_t bid = flags >> IORING_CQE_BUFFER_SHIFT;
+        if(res > 0 && state.working)
+        {
+            client->stageRead(m_uring->getBuffer(bid), res);
+        }
+        //读缓冲区扩大不了时按出错关闭连接
+        else if(res > 0 && !client->appendReadBuffer(m_uring->getBuffer(bid), res))
+        {
+            res = -ENOMEM;
+        }
+        m_uring->recycleBuffer(bid);
+    }
+    if(state.closing)
+    {
+        tryCloseUring(client);
+        return;
+    }
+    //对端关闭或出错，ENOBUFS只说明缓冲区暂时用完了
+    if(res <= 0 && res != -ENOBUFS)
+    {
+        closeConnection(client);
+        return;
+    }
+    extentTime(client);
+    if(!state.recving)
+    {
+        state.recving = true;
+        m_uring->prepRecvMultishot(client->getFd(), uringData(OP_RECV, client->getFd()));
+    }
+    //上一个应答还没发完或者连接在线程池里时，等它们完成后再处理
+    if(state.sending == 0 && !state.working)
+    {
+        processUring(client);
+    }
+}
+
+void Reactor::onSendUring(HttpConnection* client, int res)
+{
+    HttpConnection::UringState& state = client->uringState();
+    state.sending--;
+    if(state.closing)
+    {
+        tryCloseUring(client);
+        return;
+    }
+    if(res < 0)
+    {
+        closeConnection(client);
+        return;
+    }
+    extentTime(client);
+    //WAITALL一般会发完，被信号等打断时接着发剩下的部分
+    client->advanceWrite(res);
+    if(client->writeBytes() > 0)
+    {
+        sendUring(client);
+        return;
+    }
+    finishSendUring(client);
+}
+
+//socket可写了，继续sendfile
+void Reactor::onPollUring(HttpConnection* client, int res)
+{
+    HttpConnection::UringState& state = client->uringState();
+    state.sending--;
+    if(state.closing)
+    {
+        tryCloseUring(client);
+        return;
+    }
+    if(res < 0 || (res & (POLLERR | POLLHUP)))
+    {
+        closeConnection(client);
+        return;
+    }
+    extentTime(client);
+    writeUring(client);
+}
+
+//这一批应答都发完了
+void Reactor::finishSendUring(HttpConnection* client)
+{
+    if(client->isKeepAlive())
+    {
+        processUring(client);
+    }
+    else
+    {
+        closeConnection(client);
+    }
+}
+
+//解析读缓冲区里的所有请求，这一批应答的头部和文件用一个sendmsg发出
+//有线程池时和epoll模式一样，reactor线程只应答内存里的请求，其余交给线程池
+void Reactor::processUring(HttpConnection* client)
+{
+    //大的请求体或者很长的流水线，解析也要花时间
+    if(m_threadpool && client->readBytes() > INLINE_MAX_READ)
+    {
+        offloadUring(client, TASK_PROCESS);
+        return;
+    }
+    if(client->handleHttpConn(m_threadpool != nullptr))
+    {
+        m_inlineRequests.fetch_add(client->responseCount(), std::memory_order_relaxed);
+        sendUring(client);
+    }
+    else if(client->hasDeferred())
+    {
+        offloadUring(client, TASK_PROCESS);
+    }
+    else if(client->readBytes() == 0)
+    {
+        client->releaseIdle();
+    }
+}
+
+void Reactor::sendUring(HttpConnection* client)
+{
+    //有大文件时和epoll模式一样用非阻塞的writev/sendfile发送，io_uring只负责等待可写
+    if(client->hasFileToSend())
+    {
+        writeUring(client);
+        return;
+    }
+    HttpConnection::UringState& state = client->uringState();
+    memset(&state.msg, 0, sizeof(state.msg));
+    state.msg.msg_iov = client->getIov();
+    state.msg.msg_iovlen = client->getIovCnt();
+    m_uring->prepSendmsg(client->getFd(), &state.msg, uringData(OP_SEND, client->getFd()));
+    state.sending++;
+}
+
+//sendfile可能读盘，有线程池时交给线程池，写完的结果交回reactor线程后在afterWriteUring里处理
+void Reactor::writeUring(HttpConnection* client)
+{
+    if(m_threadpool)
+    {
+        offloadUring(client, TASK_WRITE);
+        return;
+    }
+    int writeErrno = 0;
+    ssize_t ret = client->writeBuffer(&writeErrno);
+    afterWriteUring(client, ret, writeErrno);
+}
+
+void Reactor::afterWriteUring(HttpConnection* client, ssize_t ret, int writeErrno)
+{
+    if(client->writeBytes() == 0)
+    {
+        finishSendUring(client);
+    }
+    else if(ret < 0 && writeErrno == EAGAIN)
+    {
+        m_uring->prepPollAdd(client->getFd(), POLLOUT, uringData(OP_POLL, client->getFd()));
+        client->uringState().sending++;
+    }
+    else
+    {
+        closeConnection(client);
+    }
+}
+
+//所有在途请求都完成后才真正关闭fd
+void Reactor::tryCloseUring(HttpConnection* client)
+{
+    HttpConnection::UringState& state = client->uringState();
+    if(state.closing && !state.recving && state.sending == 0 && !state.working)
+    {
+        client->closeHttpConn();
+    }
+}
+
+//交给线程池，期间reactor线程只暂存收到的数据，不碰连接的其他状态；完成后连接放进m_done，唤醒reactor线程
+void Reactor::offloadUring(HttpConnection* client, int task)
+{
+    HttpConnection::UringState& state = client->uringState();
+    state.working = true;
+    state.task = task;
+    m_threadpool->addTask([this, client]
+    {
+        HttpConnection::UringState& state = client->uringState();
+        state.error = 0;
+        if(state.task == TASK_PROCESS)
+        {
+            state.result = client->handleHttpConn(false);
+            if(state.result)
+                m_offloadRequests.fetch_add(client->responseCount(), std::memory_order_relaxed);
+        }
+        else
+        {
+            state.result = client->writeBuffer(&state.error);
+        }
+        bool wake;
+        {
+            std::lock_guard<std::mutex> locker(m_doneMtx);
+            //列表不空时之前放进去的一方已经唤醒过
+            wake = m_done.empty();
+            m_done.push_back(client);
+        }
+        if(wake)
+        {
+            uint64_t one = 1;
+            if(write(m_wakeFd, &one, sizeof(one)) < 0)
+                LOG_ERROR("wake reactor error: %d", errno);
+        }
+    }, client->getFd());
+}
+
+//线程池处理完的连接回到reactor线程：先接上期间收到的数据，再继续发送或者处理
+void Reactor::onWakeUring()
+{
+    uint64_t count;
+    if(read(m_wakeFd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        LOG_ERROR("read eventfd error: %d", errno);
+    m_uring->prepPollAdd(m_wakeFd, POLLIN, uringData(OP_WAKE, m_wakeFd));
+    {
+        std::lock_guard<std::mutex> locker(m_doneMtx);
+        m_doneBatch.swap(m_done);
+    }
+    for(HttpConnection* client : m_doneBatch)
+    {
+        HttpConnection::UringState& state = client->uringState();
+        state.working = false;
+        if(state.closing)
+        {
+            tryCloseUring(client);
+            continue;
+        }
+        size_t before = client->readBytes();
+        if(!client->unstageRead())
+        {
+            closeConnection(client);
+            continue;
+        }
+        if(state.task == TASK_WRITE)
+        {
+            afterWriteUring(client, state.result, state.error);
+        }
+        else if(state.result)
+        {
+            sendUring(client);
+        }
+        //请求还不完整，暂存的数据可能补全了它；没有新数据时等下一次recv
+        else if(client->readBytes() > before)
+        {
+            processUring(client);
+        }
+        else if(client->readBytes() == 0)
+        {
+            client->releaseIdle();
+        }
+    }
+    m_doneBatch.clear();
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include<fcntl.h>
+#include<unistd.h>
+#include<assert.h>
+#include<errno.h>
+#include<mutex>
+#include<sys/socket.h>
+#include<netinet/in.h>
+#include<arpa/inet.h>
+#include<netinet/tcp.h>
+#include"executor.h"
+#include"connectionslab.h"
+#include"../epoller/epoller.h"
+#include"../epoller/iouring.h"
+#include"../timer/timer.h"
+#include"../http/httpconnection.h"
+#include"../log/log.h"
+
+//一个事件循环：独立的监听套接字、epoll、计时器和连接表
+//threadpool为空时连接的读写都在本线程完成，连接不会离开所属线程
+class Reactor
+{
+public:
+    //IO_EPOLL：epoll就绪通知；IO_URING：io_uring完成通知，内核不支持时退回epoll
+    enum IO_MODE{IO_EPOLL, IO_URING};
+    //每个reactor最多的连接数
+    static const int MAX_FD = 65535;
+    //进程RSS的上限，超过时关闭空闲最久的连接，0表示不限制
+    static size_t memoryLimit;
+
+public:
+    Reactor(int port, int timeout, bool optLinger, uint32_t listenEvent, uint32_t connEvent,
+            bool reusePort, Executor* threadpool, int ioMode = IO_EPOLL);
+    ~Reactor();
+
+public:
+    bool initSocket();
+    void loop();
+
+private:
+    void addConnection(int fd, sockaddr_in addr);
+    void closeConnection(HttpConnection* client);
+
+    void handleListen();
+    void handleWrite(HttpConnection* client);
+    void handleRead(HttpConnection* client);
+
+    //inlineOnly表示在reactor线程上执行，只处理不会阻塞的部分，其余交给线程池
+    void onRead(HttpConnection* client, bool inlineOnly);
+    void onWrite(HttpConnection* client, bool inlineOnly);
+    void onProcess(HttpConnection* client, bool inlineOnly);
+
+    //io_uring模式：能从内存应答的请求在reactor线程处理，一批应答用一个sendmsg发出
+    //有线程池时，要读盘、带消息体或者很大的请求和sendfile发送交给线程池，只有reactor线程提交io_uring请求
+    void loopUring();
+    void onAcceptUring(int res, uint32_t flags);
+    void onRecvUring(HttpConnection* client, int res, uint32_t flags);
+    void onSendUring(HttpConnection* client, int res);
+    void processUring(HttpConnection* client);
+    void sendUring(HttpConnection* client);
+    void writeUring(HttpConnection* client);
+    void afterWriteUring(HttpConnection* client, ssize_t ret, int writeErrno);
+    void onPollUring(HttpConnection* client, int res);
+    void finishSendUring(HttpConnection* client);
+    void tryCloseUring(HttpConnection* client);
+    void offloadUring(HttpConnection* client, int task);
+    void onWakeUring();
+
+    enum URING_OP{OP_ACCEPT = 1, OP_RECV, OP_SEND, OP_POLL, OP_WAKE};
+    //io_uring模式下交给线程池的工作：处理请求、写出带sendfile文件的应答
+    enum URING_TASK{TASK_PROCESS, TASK_WRITE};
+    static uint64_t uringData(int op, int fd);
+
+    void sendError(int fd, const char* info);
+    void extentTime(HttpConnection* client);
+    static void onTimeout(void* reactor, void* client);
+    void logPoolStats();
+    //每秒检查一次RSS，超过上限时按比例关闭本reactor里空闲最久的连接；定期记录每个连接平均占用的内存
+    void checkMemory();
+    void shedIdle(size_t total, size_t users);
+    static size_t residentBytes();
+
+    static const int STATS_INTERVAL_MS = 10000;
+    static const int MEMORY_CHECK_MS = 1000;
+    //空闲不到这么久的连接不关闭，刚空闲下来的连接可能还在线程池里
+    static const int MIN_IDLE_MS = 1000;
+    //RSS的统计每个间隔只由一个reactor记录
+    static std::atomic<int64_t> s_memoryStatsTime;
+    //读缓冲区超过这个大小时整批交给线程池解析
+    static const size_t INLINE_MAX_READ = 64 * 1024;
+    static int setFdNonblock(int fd);
+    //响应头和文件分两次写出，关掉Nagle，否则文件那部分要等对端的延迟确认
+    static int setFdNoDelay(int fd);
+
+private:
+    int m_ioMode;
+    int m_port;
+    int m_timeout;
+    bool m_openLinger;
+    bool m_reusePort;
+    bool m_isClosed;
+    int m_listenFd;
+
+    uint32_t m_listenEvent;
+    uint32_t m_connEvent;
+
+    Executor* m_threadpool;
+    int64_t m_statsTime;
+    PoolStats m_lastStats;
+    std::vector<ScaleEvent> m_scaleEvents;
+    //在reactor线程和线程池里应答的请求数
+    std::atomic<uint64_t> m_inlineRequests;
+    std::atomic<uint64_t> m_offloadRequests;
+    uint64_t m_lastInline;
+    uint64_t m_lastOffload;
+    int64_t m_memoryTime;
+    std::unique_ptr<TimerManager> m_timer;
+    std::unique_ptr<Epoller> m_epoller;
+    std::unique_ptr<IoUring> m_uring;
+    //io_uring模式下线程池处理完的连接，放进m_done后写m_wakeFd唤醒reactor线程
+    int m_wakeFd;
+    std::mutex m_doneMtx;
+    std::vector<HttpConnection*> m_done;
+    std::vector<HttpConnection*> m_doneBatch;
+    std::unique_ptr<ConnectionSlab> m_users;
+};
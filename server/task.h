@@ -0,0 +1,112 @@
+#pragma once
+#include<new>
+#include<utility>
+#include<type_traits>
+#include<stddef.h>
+
+//线程池的任务：可调用对象直接放在对象内部的定长空间里，构造、移动都不申请内存
+//放不下的可调用对象编译不过，没有退回到堆上的路径；常见的(处理函数, 连接)只占两个指针
+class Task
+{
+public:
+    static const size_t CAPACITY = 48;
+
+    Task() : m_ops(nullptr) {}
+
+    template<typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, Task>::value>::type>
+    Task(F&& func)
+    {
+        typedef typename std::decay<F>::type Func;
+        static_assert(sizeof(Func) <= CAPACITY, "callable too large for Task");
+        static_assert(alignof(Func) <= alignof(max_align_t), "callable over-aligned for Task");
+        static_assert(std::is_nothrow_move_constructible<Func>::value, "callable must be nothrow movable");
+        new(m_storage) Func(std::forward<F>(func));
+        m_ops = &Ops<Func>::table;
+    }
+
+    Task(Task&& other) noexcept : m_ops(other.m_ops)
+    {
+        if(m_ops)
+        {
+            m_ops->move(m_storage, other.m_storage);
+            other.m_ops = nullptr;
+        }
+    }
+
+    Task& operator=(Task&& other) noexcept
+    {
+        if(this != &other)
+        {
+            reset();
+            m_ops = other.m_ops;
+            if(m_ops)
+            {
+                m_ops->move(m_storage, other.m_storage);
+                other.m_ops = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task()
+    {
+        reset();
+    }
+
+public:
+    void operator()()
+    {
+        m_ops->invoke(m_storage);
+    }
+
+    explicit operator bool() const
+    {
+        return m_ops != nullptr;
+    }
+
+    void reset()
+    {
+        if(m_ops)
+        {
+            m_ops->destroy(m_storage);
+            m_ops = nullptr;
+        }
+    }
+
+private:
+    //每种可调用对象一张函数表，move把对象移到新位置并析构旧的
+    struct VTable
+    {
+        void (*invoke)(void*);
+        void (*move)(void* dst, void* src);
+        void (*destroy)(void*);
+    };
+
+    template<typename Func>
+    struct Ops
+    {
+        static void invoke(void* p)
+        {
+            (*static_cast<Func*>(p))();
+        }
+        static void move(void* dst, void* src)
+        {
+            new(dst) Func(std::move(*static_cast<Func*>(src)));
+            static_cast<Func*>(src)->~Func();
+        }
+        static void destroy(void* p)
+        {
+            static_cast<Func*>(p)->~Func();
+        }
+        static const VTable table;
+    };
+
+    alignas(max_align_t) unsigned char m_storage[CAPACITY];
+    const VTable* m_ops;
+};
+
+template<typename Func>
+const Task::VTable Task::Ops<Func>::table = {&Task::Ops<Func>::invoke, &Task::Ops<Func>::move, &Task::Ops<Func>::destroy};
@@ -1,11 +1,15 @@
+#pragma once
 #include<thread>
 #include<condition_variable>
 #include<mutex>
 #include<queue>
-#include<functional>
+#include<vector>
+#include<algorithm>
 #include<assert.h>
+#include"executor.h"
 
-class ThreadPool
+//一个队列、一把锁的线程池，保留用来和WorkStealingPool对比
+class ThreadPool : public Executor
 {
 public:
     //构造函数，把队列里的任务取出并执行
@@ -15,17 +19,21 @@ public:
         for(size_t i = 0; i < threadNumber; i++)
         {
             //起一个线程，传入lambda表达式
-            std::thread([pool = m_pool]  
+            m_threads.emplace_back([pool = m_pool]
             {
                 std::unique_lock<std::mutex> locker(pool->mtx);//防竞争，上锁
                 while(1)
                 {
                     if(!pool->tasks.empty())
                     {
-                        auto task = std::move(pool->tasks.front());//从队列中取出一个任务
+                        auto item = std::move(pool->tasks.front());//从队列中取出一个任务
                         pool->tasks.pop();
+                        uint64_t wait = nowNS() - item.enqueueNS;
+                        pool->stats.tasks++;
+                        pool->stats.waitNS += wait;
+                        pool->stats.maxWaitNS = std::max(pool->stats.maxWaitNS, wait);
                         locker.unlock();//获取锁
-                        task();
+                        item.task();
                         locker.lock();//释放锁
                     }
                     else if(pool->isClosed) //线程池终止时通知所有线程退出执行
@@ -37,7 +45,7 @@ public:
                         pool->cond.wait(locker);//任务队列为空，且线程池未关闭，则线程阻塞等待
                     }
                 }
-            }).detach();//分离线程
+            });
         }
     }
 
@@ -55,26 +63,52 @@ public:
             }
             m_pool->cond.notify_all();//通知所有线程，isClosed已被修改
         }
+        //等线程执行完队列里剩下的任务再退出
+        for(auto& t : m_threads)
+        {
+            t.join();
+        }
     }
 
 public:
-    template<typename T>
-    void addTask(T&& task)  //万能引用
+    void addTask(Task task) override
     {
         {
             std::lock_guard<std::mutex> locker(m_pool->mtx);
-            m_pool->tasks.emplace(std::forward<T>(task)); //完美转发
+            m_pool->tasks.push({std::move(task), nowNS()});
         }
         m_pool->cond.notify_one();    //队列中加入了新任务，唤醒阻塞线程
     }
 
+    PoolStats stats() override
+    {
+        std::lock_guard<std::mutex> locker(m_pool->mtx);
+        PoolStats stats = m_pool->stats;
+        stats.threads = m_threads.size();
+        m_pool->stats.maxWaitNS = 0;
+        return stats;
+    }
+
+    const char* name() const override
+    {
+        return "queue";
+    }
+
 private:
+    struct Item
+    {
+        Task task;
+        int64_t enqueueNS;
+    };
+
     struct Pool
     {
-        bool isClosed;
+        bool isClosed = false;
         std::mutex mtx;
         std::condition_variable cond;
-        std::queue<std::function<void()>> tasks;
+        std::queue<Item> tasks;
+        PoolStats stats;
     };
     std::shared_ptr<Pool> m_pool;
-};
\ No newline at end of file
+    std::vector<std::thread> m_threads;
+};
@@ -1,58 +1,50 @@
-#include<unordered_map>
-#include<fcntl.h>
-#include<unistd.h>
-#include<assert.h>
-#include<errno.h>
-#include<sys/socket.h>
-#include<netinet/in.h>
-#include<arpa/inet.h>
+#include<vector>
+#include<thread>
+#include"reactor.h"
 #include"threadpool.h"
-#include"../epoller/epoller.h"
-#include"../timer/timer.h"
-#include"../http/httpconnection.h"
-#include"../log/log.h"
+#include"workstealingpool.h"
 
 class WebServer
 {
 public:
-    WebServer(int port, int trigMode, int timeout, bool optLinger, int threadNumber, bool openLog, int logLevel, int logSize);
+    enum POOL_MODE{POOL_QUEUE, POOL_STEAL, POOL_AFFINE};
+
+public:
+    //reactorNumber为0时是单reactor+线程池模型；大于0时启动reactorNumber个reactor线程，
+    //每个线程用SO_REUSEPORT绑定自己的监听套接字，连接的读写都在所属线程完成，不使用线程池
+    //ioMode为Reactor::IO_URING时使用io_uring，和epoll一样内存里的请求在reactor线程应答，单reactor时其余交给线程池；内核不支持时退回epoll
+    //fileCacheMB是静态文件缓存的容量，0表示不缓存；不小于sendfileKB的文件用sendfile发送，更小的直接发送缓存里映射的内存
+    //poolMode选择单reactor模式下的线程池：POOL_QUEUE是一个加锁的队列，POOL_STEAL是每个线程一个无锁队列并互相偷任务，
+    //POOL_AFFINE把每个连接固定给一个线程；pinCpu把线程池的线程绑定到核上
+    //maxThreadNumber大于threadNumber时，POOL_STEAL和POOL_AFFINE的线程数在两者之间按排队时间伸缩
+    //ringBuffer时连接的读缓冲区用镜像环形缓冲区；内核不支持memfd时退回普通缓冲区，
+    //每个环形缓冲区占两个映射，映射数到了vm.max_map_count时新映射失败的连接退回普通缓冲区
+    //memoryMB是进程RSS的上限，超过时关闭空闲最久的连接，0表示不限制
+    //timeout是连接的空闲超时（毫秒），maxRequests是每个连接最多处理的请求数，两者都写进Keep-Alive头部，0表示不限制
+    WebServer(int port, int trigMode, int timeout, bool optLinger, int threadNumber, bool openLog, int logLevel, int logSize, bool binaryLog, int accessLog,
+              int reactorNumber = 0, int ioMode = Reactor::IO_EPOLL, int fileCacheMB = 64, int sendfileKB = 64,
+              int poolMode = POOL_STEAL, bool pinCpu = false, int maxThreadNumber = 0, bool ringBuffer = false, int memoryMB = 0,
+              int maxRequests = 0);
     ~WebServer();
 
     void start();
+    //初始化失败，start会直接返回
+    bool isClosed() const
+    {
+        return m_isClosed;
+    }
 
 private:
-    bool initSocket();
-    void initEvenMode(int trigMode);
-    void addConnection(int fd, sockaddr_in addr);
-    void closeConnection(HttpConnection* client);
-
-    void handleListen();
-    void handleWrite(HttpConnection* client);
-    void handleRead(HttpConnection* client);
-
-    void onRead(HttpConnection* client);
-    void onWrite(HttpConnection* client);
-    void onProcess(HttpConnection* client);
-
-    void sendError(int fd, const char* info);
-    void extentTime(HttpConnection* client);
-
-    static const int MAX_FD = 65535;
-    static int setFdNonblock(int fd);
+    void initEvenMode(int trigMode, bool oneShot);
 
 private:
     int m_port;
-    int m_timeout;
     bool m_isClosed;
-    int m_listenFd;
-    bool m_openLinger;
     char* m_srcDir;
 
     uint32_t m_listenEvent;
     uint32_t m_connEvent;
 
-    std::unique_ptr<TimerManager> m_timer;
-    std::unique_ptr<ThreadPool> m_threadpool;
-    std::unique_ptr<Epoller> m_epoller;
-    std::unordered_map<int, HttpConnection> m_users;
-};
\ No newline at end of file
+    std::unique_ptr<Executor> m_threadpool;
+    std::vector<std::unique_ptr<Reactor>> m_reactors;
+};
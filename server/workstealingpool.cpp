@@ -0,0 +1,540 @@
+#include"workstealingpool.h"
+#include<algorithm>
+#include<chrono>
+
+WorkStealingPool::TaskRing::TaskRing(size_t capacity)
+{
+    //容量取2的幂，下标用掩码计算
+    size_t size = 2;
+    while(size < capacity)
+        size <<= 1;
+    m_cells.reset(new Cell[size]);
+    for(size_t i = 0; i < size; i++)
+        m_cells[i].seq.store(i, std::memory_order_relaxed);
+    m_mask = size - 1;
+    m_head.store(0, std::memory_order_relaxed);
+    m_tail.store(0, std::memory_order_relaxed);
+}
+
+//格子的序号等于位置时可写，等于位置+1时可读；写完把序号加一，读完把序号推进一圈
+bool WorkStealingPool::TaskRing::push(Item& item)
+{
+    size_t pos = m_tail.load(std::memory_order_relaxed);
+    Cell* cell;
+    while(1)
+    {
+        cell = &m_cells[pos & m_mask];
+        size_t seq = cell->seq.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if(diff == 0)
+        {
+            if(m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if(diff < 0)
+        {
+            return false;   //队列满
+        }
+        else
+        {
+            pos = m_tail.load(std::memory_order_relaxed);
+        }
+    }
+    cell->item = std::move(item);
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool WorkStealingPool::TaskRing::pop(Item& item)
+{
+    size_t pos = m_head.load(std::memory_order_relaxed);
+    Cell* cell;
+    while(1)
+    {
+        cell = &m_cells[pos & m_mask];
+        size_t seq = cell->seq.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+        if(diff == 0)
+        {
+            if(m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if(diff < 0)
+        {
+            return false;   //队列空
+        }
+        else
+        {
+            pos = m_head.load(std::memory_order_relaxed);
+        }
+    }
+    item = std::move(cell->item);
+    cell->seq.store(pos + m_mask + 1, std::memory_order_release);
+    return true;
+}
+
+bool WorkStealingPool::TaskRing::empty() const
+{
+    size_t pos = m_head.load(std::memory_order_relaxed);
+    return m_cells[pos & m_mask].seq.load(std::memory_order_acquire) != pos + 1;
+}
+
+size_t WorkStealingPool::TaskRing::size() const
+{
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    size_t head = m_head.load(std::memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+}
+
+WorkStealingPool::WorkStealingPool(size_t threadNumber, size_t maxThreadNumber, size_t queueSize, int mode, bool pinCpu,
+size_t rebalanceThreshold)
+{
+    maxThreadNumber = std::max(threadNumber, maxThreadNumber);
+    assert(threadNumber > 0 && maxThreadNumber < NO_HOME);
+    m_mode = mode;
+    m_pinCpu = pinCpu;
+    m_rebalanceThreshold = rebalanceThreshold;
+    m_minThreads = threadNumber;
+    m_pushing = 0;
+    m_next = 0;
+    m_isClosed = false;
+    m_overflowSize = 0;
+    m_idle = 0;
+    m_spinning = 0;
+    m_reassigns = 0;
+    m_scaleUps = 0;
+    m_scaleDowns = 0;
+    //只有一个核时自旋没有意义，投递任务的线程要等自旋的线程让出CPU
+    m_maxSpinning = std::thread::hardware_concurrency() / 2;
+    m_homeSize = 0;
+    if(m_mode == AFFINE)
+    {
+        m_homeSize = 65536;
+        m_home.reset(new std::atomic<uint16_t>[m_homeSize]);
+        for(size_t i = 0; i < m_homeSize; i++)
+            m_home[i].store(NO_HOME, std::memory_order_relaxed);
+    }
+    for(size_t i = 0; i < maxThreadNumber; i++)
+    {
+        m_workers.emplace_back(new Worker(queueSize));
+    }
+    //所有队列建好之后再启动线程，偷任务时会访问其他线程的队列
+    m_active = threadNumber;
+    for(size_t i = 0; i < threadNumber; i++)
+    {
+        m_workers[i]->thread = std::thread(&WorkStealingPool::run, this, i);
+    }
+    if(maxThreadNumber > threadNumber)
+    {
+        m_controller = std::thread(&WorkStealingPool::control, this);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> locker(m_controlMtx);
+        m_isClosed = true;
+    }
+    m_controlCond.notify_one();
+    if(m_controller.joinable())
+    {
+        m_controller.join();
+    }
+    for(size_t i = 0; i < m_workers.size(); i++)
+    {
+        wake(i);
+    }
+    for(auto& worker : m_workers)
+    {
+        if(worker->thread.joinable())
+            worker->thread.join();
+    }
+}
+
+//把线程绑定到一个核，失败时只记录不影响运行
+void WorkStealingPool::pin(size_t index)
+{
+    unsigned cpus = std::thread::hardware_concurrency();
+    if(cpus == 0)
+        return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(index % cpus, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+//放进index线程的队列，满了就换下一个，全满才加锁放进溢出队列；然后唤醒需要的线程
+void WorkStealingPool::push(size_t index, size_t active, Item& item)
+{
+    size_t target = index;
+    bool pushed = false;
+    for(size_t i = 0; i < active && !pushed; i++)
+    {
+        target = (index + i) % active;
+        pushed = m_workers[target]->ring.push(item);
+    }
+    if(!pushed)
+    {
+        std::lock_guard<std::mutex> locker(m_overflowMtx);
+        m_overflow.push_back(std::move(item));
+        m_overflowSize.fetch_add(1, std::memory_order_relaxed);
+    }
+    //和run里睡眠前的检查配对：要么投递方看到线程睡着了，要么睡眠的线程看到这个任务
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(m_idle.load(std::memory_order_relaxed) == 0)
+        return;
+    if(m_workers[target]->parked.load(std::memory_order_relaxed))
+    {
+        wake(target);
+    }
+    else if(m_mode == STEAL || !pushed)
+    {
+        //目标线程正忙，叫醒一个睡着的线程来偷；溢出队列所有线程都会取
+        for(size_t i = 1; i < active; i++)
+        {
+            size_t other = (target + i) % active;
+            if(m_workers[other]->parked.load(std::memory_order_relaxed))
+            {
+                wake(other);
+                break;
+            }
+        }
+    }
+}
+
+void WorkStealingPool::wake(size_t index)
+{
+    Worker& worker = *m_workers[index];
+    {
+        std::lock_guard<std::mutex> locker(worker.parkMtx);
+    }
+    worker.parkCond.notify_one();
+}
+
+//投递期间计数，shrink据此确认没有投递还拿着旧的线程数
+class PushGuard
+{
+public:
+    explicit PushGuard(std::atomic<int>& pushing) : m_pushing(pushing)
+    {
+        m_pushing.fetch_add(1, std::memory_order_seq_cst);
+    }
+    ~PushGuard()
+    {
+        m_pushing.fetch_sub(1, std::memory_order_release);
+    }
+
+private:
+    std::atomic<int>& m_pushing;
+};
+
+void WorkStealingPool::addTask(Task task)
+{
+    Item item{std::move(task), nowNS()};
+    PushGuard guard(m_pushing);
+    size_t active = m_active.load(std::memory_order_seq_cst);
+    push(m_next.fetch_add(1, std::memory_order_relaxed) % active, active, item);
+}
+
+void WorkStealingPool::addTask(Task task, int key)
+{
+    if(m_mode != AFFINE || key < 0)
+    {
+        addTask(std::move(task));
+        return;
+    }
+    Item item{std::move(task), nowNS()};
+    PushGuard guard(m_pushing);
+    size_t active = m_active.load(std::memory_order_seq_cst);
+    size_t slot = static_cast<size_t>(key) % m_homeSize;
+    size_t home = m_home[slot].load(std::memory_order_relaxed);
+    //新连接或者所属线程已经被撤掉
+    if(home >= active)
+    {
+        home = key % active;
+        m_home[slot].store(static_cast<uint16_t>(home), std::memory_order_relaxed);
+    }
+    if(m_workers[home]->ring.size() > m_rebalanceThreshold)
+    {
+        home = reassign(key, home, active);
+    }
+    push(home, active, item);
+}
+
+//所属线程积压太多，改派给队列最短的线程，之后这个连接的任务都投递到新线程
+size_t WorkStealingPool::reassign(int key, size_t home, size_t active)
+{
+    size_t best = home;
+    size_t bestSize = m_workers[home]->ring.size();
+    for(size_t i = 0; i < active; i++)
+    {
+        size_t size = m_workers[i]->ring.size();
+        if(size < bestSize)
+        {
+            best = i;
+            bestSize = size;
+        }
+    }
+    //差距不大时不改派，避免连接在线程之间来回跳
+    if(bestSize * 2 > m_workers[home]->ring.size())
+        return home;
+    m_home[static_cast<size_t>(key) % m_homeSize].store(static_cast<uint16_t>(best), std::memory_order_relaxed);
+    m_reassigns.fetch_add(1, std::memory_order_relaxed);
+    return best;
+}
+
+//先取自己的队列，STEAL模式再从下一个线程开始偷，最后取溢出队列
+bool WorkStealingPool::take(size_t index, Item& item)
+{
+    Worker& self = *m_workers[index];
+    if(self.ring.pop(item))
+        return true;
+    if(m_mode == STEAL)
+    {
+        size_t active = m_active.load(std::memory_order_relaxed);
+        for(size_t i = 1; i < active; i++)
+        {
+            if(m_workers[(index + i) % active]->ring.pop(item))
+            {
+                self.steals.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+    }
+    if(m_overflowSize.load(std::memory_order_relaxed) > 0)
+    {
+        std::lock_guard<std::mutex> locker(m_overflowMtx);
+        if(!m_overflow.empty())
+        {
+            item = std::move(m_overflow.front());
+            m_overflow.pop_front();
+            m_overflowSize.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+//index线程能取到的任务是否存在
+bool WorkStealingPool::hasWork(size_t index) const
+{
+    if(!m_workers[index]->ring.empty())
+        return true;
+    if(m_mode == STEAL)
+    {
+        size_t active = m_active.load(std::memory_order_relaxed);
+        for(size_t i = 0; i < active; i++)
+        {
+            if(!m_workers[i]->ring.empty())
+                return true;
+        }
+    }
+    return m_overflowSize.load(std::memory_order_relaxed) > 0;
+}
+
+void WorkStealingPool::execute(Worker& worker, Item& item)
+{
+    int64_t start = nowNS();
+    uint64_t wait = start - item.enqueueNS;
+    worker.tasks.store(worker.tasks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    worker.waitNS.store(worker.waitNS.load(std::memory_order_relaxed) + wait, std::memory_order_relaxed);
+    if(wait > worker.maxWaitNS.load(std::memory_order_relaxed))
+        worker.maxWaitNS.store(wait, std::memory_order_relaxed);
+    Task task = std::move(item.task);
+    task();
+    worker.busyNS.store(worker.busyNS.load(std::memory_order_relaxed) + (nowNS() - start), std::memory_order_relaxed);
+}
+
+void WorkStealingPool::run(size_t index)
+{
+    Worker& self = *m_workers[index];
+    if(m_pinCpu)
+    {
+        pin(index);
+    }
+    Item item;
+    while(1)
+    {
+        if(self.retire.load(std::memory_order_acquire))
+        {
+            //shrink确认不会再有任务投进来，取完剩下的就退出
+            while(self.ring.pop(item))
+            {
+                execute(self, item);
+            }
+            break;
+        }
+        if(take(index, item))
+        {
+            execute(self, item);
+            continue;
+        }
+        //短时间内很可能有新任务，先自旋，避免睡眠和唤醒的系统调用
+        if(m_spinning.fetch_add(1, std::memory_order_relaxed) < m_maxSpinning)
+        {
+            bool found = false;
+            for(int i = 0; i < SPIN_COUNT && !found; i++)
+            {
+#if defined(__x86_64__) || defined(__i386__)
+                __builtin_ia32_pause();
+#endif
+                found = hasWork(index);
+            }
+            m_spinning.fetch_sub(1, std::memory_order_relaxed);
+            if(found)
+                continue;
+        }
+        else
+        {
+            m_spinning.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        std::unique_lock<std::mutex> locker(self.parkMtx);
+        self.parked.store(true, std::memory_order_relaxed);
+        m_idle.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(!hasWork(index) && !self.retire.load(std::memory_order_relaxed))
+        {
+            if(m_isClosed)
+            {
+                self.parked.store(false, std::memory_order_relaxed);
+                m_idle.fetch_sub(1, std::memory_order_relaxed);
+                break;
+            }
+            self.parkCond.wait(locker);
+        }
+        self.parked.store(false, std::memory_order_relaxed);
+        m_idle.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+void WorkStealingPool::totals(uint64_t& tasks, uint64_t& waitNS, uint64_t& busyNS) const
+{
+    tasks = waitNS = busyNS = 0;
+    for(auto& worker : m_workers)
+    {
+        tasks += worker->tasks.load(std::memory_order_relaxed);
+        waitNS += worker->waitNS.load(std::memory_order_relaxed);
+        busyNS += worker->busyNS.load(std::memory_order_relaxed);
+    }
+}
+
+//每个周期算出平均排队时间和忙碌比例，连续满足条件才伸缩
+void WorkStealingPool::control()
+{
+    uint64_t lastTasks, lastWait, lastBusy;
+    totals(lastTasks, lastWait, lastBusy);
+    int64_t lastTime = nowNS();
+    int growTicks = 0;
+    int shrinkTicks = 0;
+    int cooldown = 0;
+    std::unique_lock<std::mutex> locker(m_controlMtx);
+    while(!m_isClosed)
+    {
+        m_controlCond.wait_for(locker, std::chrono::milliseconds(CONTROL_INTERVAL_MS));
+        if(m_isClosed)
+            break;
+        uint64_t tasks, waitNS, busyNS;
+        totals(tasks, waitNS, busyNS);
+        int64_t now = nowNS();
+        size_t active = m_active.load(std::memory_order_relaxed);
+        uint64_t avgWait = tasks > lastTasks ? (waitNS - lastWait) / (tasks - lastTasks) : 0;
+        double busy = static_cast<double>(busyNS - lastBusy) / (static_cast<double>(now - lastTime) * active);
+        lastTasks = tasks;
+        lastWait = waitNS;
+        lastBusy = busyNS;
+        lastTime = now;
+        if(cooldown > 0)
+        {
+            cooldown--;
+            continue;
+        }
+        if((avgWait > GROW_WAIT_NS || busy > GROW_BUSY) && active < m_workers.size())
+        {
+            shrinkTicks = 0;
+            if(++growTicks >= GROW_TICKS)
+            {
+                grow();
+                record(active, active + 1, avgWait, busy);
+                growTicks = 0;
+                cooldown = COOLDOWN_TICKS;
+            }
+        }
+        else if(avgWait < SHRINK_WAIT_NS && busy < SHRINK_BUSY && active > m_minThreads)
+        {
+            growTicks = 0;
+            if(++shrinkTicks >= SHRINK_TICKS)
+            {
+                shrink();
+                record(active, active - 1, avgWait, busy);
+                shrinkTicks = 0;
+                cooldown = COOLDOWN_TICKS;
+            }
+        }
+        else
+        {
+            growTicks = 0;
+            shrinkTicks = 0;
+        }
+    }
+}
+
+//只由控制线程调用；先启动线程再公开，投递方看到新的线程数时队列已经有人处理
+void WorkStealingPool::grow()
+{
+    size_t index = m_active.load(std::memory_order_relaxed);
+    Worker& worker = *m_workers[index];
+    worker.retire.store(false, std::memory_order_relaxed);
+    worker.thread = std::thread(&WorkStealingPool::run, this, index);
+    m_active.store(index + 1, std::memory_order_seq_cst);
+    m_scaleUps.fetch_add(1, std::memory_order_relaxed);
+}
+
+//撤掉最后一个线程：先让新的投递看不到它，等拿着旧线程数的投递结束，再让它取完自己的队列后退出
+void WorkStealingPool::shrink()
+{
+    size_t index = m_active.load(std::memory_order_relaxed) - 1;
+    Worker& worker = *m_workers[index];
+    m_active.store(index, std::memory_order_seq_cst);
+    while(m_pushing.load(std::memory_order_seq_cst) != 0)
+    {
+        std::this_thread::yield();
+    }
+    worker.retire.store(true, std::memory_order_release);
+    wake(index);
+    worker.thread.join();
+    m_scaleDowns.fetch_add(1, std::memory_order_relaxed);
+}
+
+void WorkStealingPool::record(size_t from, size_t to, uint64_t waitNS, double busy)
+{
+    std::lock_guard<std::mutex> locker(m_eventMtx);
+    if(m_events.size() >= MAX_SCALE_EVENTS)
+        m_events.erase(m_events.begin());
+    m_events.push_back({nowNS(), from, to, waitNS, busy});
+}
+
+void WorkStealingPool::takeScaleEvents(std::vector<ScaleEvent>& events)
+{
+    std::lock_guard<std::mutex> locker(m_eventMtx);
+    events.insert(events.end(), m_events.begin(), m_events.end());
+    m_events.clear();
+}
+
+PoolStats WorkStealingPool::stats()
+{
+    PoolStats stats;
+    for(auto& worker : m_workers)
+    {
+        stats.tasks += worker->tasks.load(std::memory_order_relaxed);
+        stats.waitNS += worker->waitNS.load(std::memory_order_relaxed);
+        stats.maxWaitNS = std::max<uint64_t>(stats.maxWaitNS, worker->maxWaitNS.exchange(0, std::memory_order_relaxed));
+        stats.steals += worker->steals.load(std::memory_order_relaxed);
+    }
+    stats.reassigns = m_reassigns.load(std::memory_order_relaxed);
+    stats.threads = m_active.load(std::memory_order_relaxed);
+    stats.scaleUps = m_scaleUps.load(std::memory_order_relaxed);
+    stats.scaleDowns = m_scaleDowns.load(std::memory_order_relaxed);
+    return stats;
+}
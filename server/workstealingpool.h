@@ -0,0 +1,157 @@
+#pragma once
+#include<thread>
+#include<atomic>
+#include<mutex>
+#include<condition_variable>
+#include<deque>
+#include<vector>
+#include<memory>
+#include<pthread.h>
+#include<assert.h>
+#include"executor.h"
+
+//每个工作线程一个无锁的有界队列，reactor投递时不经过全局锁
+//STEAL模式：轮流投递，线程先取自己的队列，空了就从其他线程的队列偷
+//AFFINE模式：按连接固定投递到一个线程且不偷，连接的缓冲区和请求状态一直留在同一个核的缓存里；
+//            所属线程的队列超过阈值时才把这个连接改派给最空闲的线程
+//取不到任务时先自旋一会儿，最后才睡眠；每个线程单独睡眠，投递方只在目标线程睡着时才去拿它的锁
+//队列在构造时一次分配好，任务按值放在格子里，投递和执行都不申请内存；只有所有队列都满时溢出队列才会申请
+//线程数在[threadNumber, maxThreadNumber]之间伸缩：控制线程定期根据排队时间和忙碌比例增减线程，
+//增加要连续几个周期都排队严重，减少要持续空闲更久，每次调整后冷却一段时间，避免来回抖动
+class WorkStealingPool : public Executor
+{
+public:
+    enum MODE{STEAL, AFFINE};
+
+    //maxThreadNumber不大于threadNumber时线程数固定；pinCpu把第i个线程绑定到第i % 核数个核
+    WorkStealingPool(size_t threadNumber = 8, size_t maxThreadNumber = 0, size_t queueSize = 1024, int mode = STEAL,
+                     bool pinCpu = false, size_t rebalanceThreshold = 64);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+public:
+    void addTask(Task task) override;
+    //AFFINE模式下key相同的任务投递到同一个线程，key一般是连接的fd；STEAL模式忽略key
+    void addTask(Task task, int key) override;
+    PoolStats stats() override;
+    void takeScaleEvents(std::vector<ScaleEvent>& events) override;
+    const char* name() const override
+    {
+        return m_mode == AFFINE ? "affine" : "steal";
+    }
+
+private:
+    struct Item
+    {
+        Task task;
+        int64_t enqueueNS;
+    };
+
+    //多生产者多消费者的有界环形队列，每个格子带序号，push和pop各自用CAS抢位置
+    class TaskRing
+    {
+    public:
+        explicit TaskRing(size_t capacity);
+        bool push(Item& item);
+        bool pop(Item& item);
+        bool empty() const;
+        //近似的长度，只用于比较负载
+        size_t size() const;
+
+    private:
+        struct Cell
+        {
+            std::atomic<size_t> seq;
+            Item item;
+        };
+        std::unique_ptr<Cell[]> m_cells;
+        size_t m_mask;
+        alignas(64) std::atomic<size_t> m_head;    //下一个pop的位置
+        alignas(64) std::atomic<size_t> m_tail;    //下一个push的位置
+    };
+
+    //每个线程的统计只由自己写，取统计时汇总
+    struct alignas(64) Worker
+    {
+        explicit Worker(size_t queueSize) : ring(queueSize) {}
+        TaskRing ring;
+        std::atomic<uint64_t> tasks{0};
+        std::atomic<uint64_t> waitNS{0};
+        std::atomic<uint64_t> maxWaitNS{0};
+        std::atomic<uint64_t> steals{0};
+        std::atomic<uint64_t> busyNS{0};
+        std::thread thread;
+
+        //睡眠和唤醒
+        std::mutex parkMtx;
+        std::condition_variable parkCond;
+        std::atomic<bool> parked{false};
+        //被撤掉，取完自己队列里的任务后退出
+        std::atomic<bool> retire{false};
+    };
+
+    void run(size_t index);
+    bool take(size_t index, Item& item);
+    bool hasWork(size_t index) const;
+    void execute(Worker& worker, Item& item);
+    void push(size_t index, size_t active, Item& item);
+    void wake(size_t index);
+    size_t reassign(int key, size_t home, size_t active);
+    void pin(size_t index);
+    void control();
+    void grow();
+    void shrink();
+    void record(size_t from, size_t to, uint64_t waitNS, double busy);
+    void totals(uint64_t& tasks, uint64_t& waitNS, uint64_t& busyNS) const;
+
+    static const int SPIN_COUNT = 2000;
+    static const uint16_t NO_HOME = 0xffff;
+    //伸缩的参数：周期、触发条件要连续满足的周期数、调整后的冷却周期数
+    static constexpr int CONTROL_INTERVAL_MS = 100;
+    static const int GROW_TICKS = 2;
+    static const int SHRINK_TICKS = 30;
+    static const int COOLDOWN_TICKS = 5;
+    static const int64_t GROW_WAIT_NS = 500000;
+    static const int64_t SHRINK_WAIT_NS = 50000;
+    static constexpr double GROW_BUSY = 0.85;
+    static constexpr double SHRINK_BUSY = 0.3;
+    static const size_t MAX_SCALE_EVENTS = 64;
+
+    int m_mode;
+    bool m_pinCpu;
+    size_t m_rebalanceThreshold;
+    //同时自旋的线程数上限，自旋的线程占着核，太多会抢走reactor和干活线程的CPU
+    int m_maxSpinning;
+    std::atomic<int> m_spinning;
+
+    //按最大线程数建好，只有前m_active个有线程在跑
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::atomic<size_t> m_active;
+    size_t m_minThreads;
+    //正在投递的线程数，减少线程时等它归零，之后不会再有任务投到被撤掉的队列
+    std::atomic<int> m_pushing;
+    std::atomic<size_t> m_next;
+    std::atomic<bool> m_isClosed;
+    std::atomic<int> m_idle;
+
+    //AFFINE模式下每个key所属的线程，只由投递方读写
+    std::unique_ptr<std::atomic<uint16_t>[]> m_home;
+    size_t m_homeSize;
+    std::atomic<uint64_t> m_reassigns;
+
+    //伸缩控制
+    std::thread m_controller;
+    std::mutex m_controlMtx;
+    std::condition_variable m_controlCond;
+    std::atomic<uint64_t> m_scaleUps;
+    std::atomic<uint64_t> m_scaleDowns;
+    std::mutex m_eventMtx;
+    std::vector<ScaleEvent> m_events;
+
+    //所有队列都满时放到这里
+    std::mutex m_overflowMtx;
+    std::deque<Item> m_overflow;
+    std::atomic<size_t> m_overflowSize;
+};
@@ -0,0 +1,106 @@
+//访问日志的基准：请求线程每处理完一个请求调用一次append，统计每次调用的耗时
+//先不限速测最大速度，再按固定的总速率（默认10万请求/秒）均匀发出，检查耗时和有没有丢记录
+//make bench && ./test/bench_accesslog [线程数] [每秒请求数] [秒数]
+#include<chrono>
+#include<thread>
+#include<vector>
+#include<algorithm>
+#include<iostream>
+#include<stdlib.h>
+#include<arpa/inet.h>
+#include"../log/accesslog.h"
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static const char* USER_AGENT = "Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36";
+
+struct Result
+{
+    double seconds;
+    vector<uint32_t> latency;   //每次调用的耗时ns
+};
+
+//每个线程发requests个请求，interval不为0时每隔interval发一个
+Result run(int threads, int requests, Clock::duration interval)
+{
+    Result result;
+    vector<vector<uint32_t>> latency(threads, vector<uint32_t>(requests));
+    vector<thread> workers;
+    auto start = Clock::now();
+    for(int i = 0; i < threads; i++)
+    {
+        workers.emplace_back([&, i]
+        {
+            struct sockaddr_in addr = {};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(0x7f000001 + i);
+            auto next = start;
+            for(int j = 0; j < requests; j++)
+            {
+                if(interval.count() > 0)
+                {
+                    next += interval;
+                    while(Clock::now() < next)
+                        this_thread::yield();
+                }
+                int64_t end = AccessLog::nowNS();
+                auto t0 = Clock::now();
+                AccessLog::instance()->append(addr, "GET", "/index.html", "1.1", 200, 3148, end - 150000, end, "", USER_AGENT);
+                latency[i][j] = chrono::duration_cast<chrono::nanoseconds>(Clock::now() - t0).count();
+            }
+        });
+    }
+    for(auto& t : workers)
+        t.join();
+    result.seconds = chrono::duration<double>(Clock::now() - start).count();
+    for(auto& v : latency)
+        result.latency.insert(result.latency.end(), v.begin(), v.end());
+    sort(result.latency.begin(), result.latency.end());
+    return result;
+}
+
+void report(const char* name, Result& r)
+{
+    size_t n = r.latency.size();
+    double sum = 0;
+    for(uint32_t l : r.latency)
+        sum += l;
+    printf("%-8s %10.0f req/s  latency avg %5.0fns  p50 %5uns  p99 %6uns  p99.9 %7uns\n",
+           name, n / r.seconds, sum / n, r.latency[n / 2], r.latency[n * 99 / 100], r.latency[n * 999 / 1000]);
+}
+
+//等后台线程把记录都写出去，打印写进文件的和丢掉的记录数
+void check(uint64_t issued)
+{
+    for(int i = 0; i < 50 && AccessLog::instance()->written() + AccessLog::instance()->dropped() < issued; i++)
+    {
+        AccessLog::instance()->flush();
+        this_thread::sleep_for(chrono::milliseconds(100));
+    }
+    printf("         written %lu of %lu, dropped %lu\n", static_cast<unsigned long>(AccessLog::instance()->written()),
+           static_cast<unsigned long>(issued), static_cast<unsigned long>(AccessLog::instance()->dropped()));
+}
+
+int main(int argc, char* argv[])
+{
+    int threads = argc > 1 ? atoi(argv[1]) : 4;
+    int rate = argc > 2 ? atoi(argv[2]) : 100000;
+    int seconds = argc > 3 ? atoi(argv[3]) : 2;
+    system("rm -rf /tmp/bench_accesslog");
+    AccessLog::instance()->init("/tmp/bench_accesslog", AccessLog::COMBINED);
+
+    uint64_t issued = 0;
+    int requests = rate * seconds / threads;
+    Result paced = run(threads, requests, chrono::nanoseconds(1000000000LL * threads / rate));
+    issued += paced.latency.size();
+    report("paced", paced);
+    check(issued);
+
+    Result burst = run(threads, requests, Clock::duration::zero());
+    issued += burst.latency.size();
+    report("burst", burst);
+    check(issued);
+    system("rm -rf /tmp/bench_accesslog");
+    return 0;
+}
@@ -0,0 +1,251 @@
+//缓冲区的基准：对比原来的vector缓冲区（initPtr整块清零、resize扩容、readFd用64KB的栈上暂存区）、块链表缓冲区和镜像环形缓冲区
+//按服务器里的用法：写缓冲区每批应答重置后写入动态头部和小文件；读缓冲区从socket读入请求后取走；大的消息体分多次到达；
+//一次读进很多流水线请求，逐个连续地取出
+//make bench && ./test/bench_buffer [次数]
+#include<chrono>
+#include<vector>
+#include<string>
+#include<atomic>
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<errno.h>
+#include<unistd.h>
+#include<sys/uio.h>
+#include<sys/socket.h>
+#include"../buffer/buffer.h"
+#include"../buffer/ringbuffer.h"
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+//原来的实现，只保留用到的接口
+class OldBuffer
+{
+public:
+    OldBuffer(int initBufferSize = 1024) : m_buffer(initBufferSize), m_readPos(0), m_writePos(0){}
+
+    size_t writeableBytes() const
+    {
+        return m_buffer.size() - m_writePos;
+    }
+    size_t readableBytes() const
+    {
+        return m_writePos - m_readPos;
+    }
+    const char* curReadPtr() const
+    {
+        return &m_buffer[0] + m_readPos;
+    }
+    void updateReadPtr(size_t len)
+    {
+        m_readPos += len;
+    }
+    void initPtr()
+    {
+        bzero(&m_buffer[0], m_buffer.size());
+        m_readPos = 0;
+        m_writePos = 0;
+    }
+    void append(const char* str, size_t len)
+    {
+        if(writeableBytes() < len)
+            allocateSpace(len);
+        std::copy(str, str + len, &m_buffer[0] + m_writePos);
+        m_writePos += len;
+    }
+    ssize_t readFd(int fd, int* Errno)
+    {
+        char buf[65535];
+        struct iovec iov[2];
+        const size_t writeable = writeableBytes();
+        iov[0].iov_base = &m_buffer[0] + m_writePos;
+        iov[0].iov_len = writeable;
+        iov[1].iov_base = buf;
+        iov[1].iov_len = sizeof(buf);
+        const ssize_t len = readv(fd, iov, 2);
+        if(len < 0)
+            *Errno = errno;
+        else if(static_cast<size_t>(len) < writeable)
+            m_writePos += len;
+        else
+        {
+            m_writePos = m_buffer.size();
+            append(buf, len - writeable);
+        }
+        return len;
+    }
+
+private:
+    void allocateSpace(size_t len)
+    {
+        if(writeableBytes() + m_readPos < len)
+        {
+            m_buffer.resize(m_writePos + len + 1);
+        }
+        else
+        {
+            size_t readable = readableBytes();
+            std::copy(&m_buffer[0] + m_readPos, &m_buffer[0] + m_writePos, &m_buffer[0]);
+            m_readPos = 0;
+            m_writePos = readable;
+        }
+    }
+
+    std::vector<char> m_buffer;
+    std::atomic<std::size_t> m_readPos;
+    std::atomic<std::size_t> m_writePos;
+};
+
+template<typename F>
+double nsPer(int n, F f)
+{
+    auto start = Clock::now();
+    for(int i = 0; i < n; i++)
+        f(i);
+    return chrono::duration<double, nano>(Clock::now() - start).count() / n;
+}
+
+static const char DATE[] = "Date: Sat, 18 Oct 2026 03:30:00 GMT\r\n\r\n";
+static const char REQUEST[] = "GET /index.html HTTP/1.1\r\nHost: 127.0.0.1:8081\r\nUser-Agent: bench\r\nConnection: keep-alive\r\n\r\n";
+
+//写缓冲区：重置，写入动态头部和一个3KB的小文件
+template<typename B>
+double writePath(int n)
+{
+    string file(3148, 'x');
+    B buff;
+    return nsPer(n, [&](int)
+    {
+        buff.initPtr();
+        buff.append(DATE, sizeof(DATE) - 1);
+        buff.append(file.data(), file.size());
+    });
+}
+
+//读缓冲区：对端写入一个请求，readFd读入后取走
+template<typename B>
+double readPath(int n)
+{
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    B buff;
+    int err = 0;
+    double ns = nsPer(n, [&](int)
+    {
+        if(write(fds[1], REQUEST, sizeof(REQUEST) - 1) < 0)
+            return;
+        buff.readFd(fds[0], &err);
+        buff.updateReadPtr(buff.readableBytes());
+    });
+    close(fds[0]);
+    close(fds[1]);
+    return ns;
+}
+
+//1MB的消息体按16KB到达，每次到达后解析器要看到连续的数据
+double bodyOld(int n)
+{
+    string chunk(16384, 'x');
+    return nsPer(n, [&](int)
+    {
+        OldBuffer buff;
+        for(int i = 0; i < 64; i++)
+        {
+            buff.append(chunk.data(), chunk.size());
+            volatile char c = *buff.curReadPtr();
+            (void)c;
+        }
+    });
+}
+
+double bodyNew(int n)
+{
+    string chunk(16384, 'x');
+    return nsPer(n, [&](int)
+    {
+        Buffer buff;
+        for(int i = 0; i < 64; i++)
+        {
+            buff.append(chunk.data(), chunk.size());
+            volatile char c = *buff.linearize();
+            (void)c;
+        }
+    });
+}
+
+double bodyRing(int n)
+{
+    string chunk(16384, 'x');
+    RingBuffer buff;
+    return nsPer(n, [&](int)
+    {
+        buff.initPtr();
+        //解析器看到Content-Length后一次扩大到能放下整个消息体
+        buff.ensureWriteable(chunk.size() * 64);
+        for(int i = 0; i < 64; i++)
+        {
+            buff.append(chunk.data(), chunk.size());
+            volatile char c = *buff.curReadPtr();
+            (void)c;
+        }
+    });
+}
+
+//对端一次写入64个流水线请求，readFd读入后每个请求要连续地看到再取走
+const char* contiguous(OldBuffer& buff)
+{
+    return buff.curReadPtr();
+}
+
+const char* contiguous(Buffer& buff)
+{
+    return buff.linearize();
+}
+
+const char* contiguous(RingBuffer& buff)
+{
+    return buff.curReadPtr();
+}
+
+template<typename B>
+double pipelined(int n)
+{
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    string batch;
+    for(int i = 0; i < 64; i++)
+        batch += REQUEST;
+    const size_t request = sizeof(REQUEST) - 1;
+    B buff;
+    int err = 0;
+    double ns = nsPer(n, [&](int)
+    {
+        if(write(fds[1], batch.data(), batch.size()) < 0)
+            return;
+        while(buff.readableBytes() < batch.size())
+            buff.readFd(fds[0], &err);
+        while(buff.readableBytes() >= request)
+        {
+            volatile char c = contiguous(buff)[request - 1];
+            (void)c;
+            buff.updateReadPtr(request);
+        }
+    });
+    close(fds[0]);
+    close(fds[1]);
+    return ns;
+}
+
+int main(int argc, char* argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : 1000000;
+    printf("write path (reset + date + 3KB file): old %7.1fns  slabs %7.1fns\n", writePath<OldBuffer>(n), writePath<Buffer>(n));
+    printf("read path (readFd + consume)        : old %7.1fns  slabs %7.1fns  ring %7.1fns\n",
+           readPath<OldBuffer>(n), readPath<Buffer>(n), readPath<RingBuffer>(n));
+    printf("64 pipelined requests               : old %7.1fus  slabs %7.1fus  ring %7.1fus\n",
+           pipelined<OldBuffer>(n / 100) / 1000, pipelined<Buffer>(n / 100) / 1000, pipelined<RingBuffer>(n / 100) / 1000);
+    printf("1MB body in 16KB pieces             : old %7.0fus  slabs %7.0fus  ring %7.0fus\n",
+           bodyOld(n / 1000) / 1000, bodyNew(n / 1000) / 1000, bodyRing(n / 1000) / 1000);
+    return 0;
+}
@@ -0,0 +1,340 @@
+//日志的基准：对比原来的加锁日志（每行三次加锁、localtime、拷成string进阻塞队列、每行fflush）和现在的线程缓冲区日志，
+//以及只记格式id和原始参数的二进制日志
+//几个线程同时按服务器里常见的格式写日志，统计每秒写的行数和每次调用在请求线程上花的时间
+//make bench && ./test/bench_log [线程数] [每个线程的行数]
+#include<chrono>
+#include<thread>
+#include<vector>
+#include<algorithm>
+#include<iostream>
+#include<stdlib.h>
+#include<string.h>
+#include<dirent.h>
+#include"../log/log.h"
+#include"../log/blockqueue.h"
+#include"../buffer/buffer.h"
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+//原来的实现，只保留服务器用到的接口
+class OldLog
+{
+public:
+    static OldLog* instance()
+    {
+        static OldLog inst;
+        return &inst;
+    }
+
+    void init(int level, const char* path, const char* suffix, int maxCapacity)
+    {
+        m_isOpen = true;
+        m_level = level;
+        if(maxCapacity > 0)
+        {
+            m_isAsync = true;
+            if(!m_bq)
+            {
+                m_bq.reset(new BlockQueue<std::string>);
+                m_writeThread.reset(new std::thread([this]{ asyncWrite(); }));
+            }
+        }
+        m_lineCount = 0;
+        time_t timer = time(nullptr);
+        struct tm t = *localtime(&timer);
+        m_path = path;
+        m_suffix = suffix;
+        char filename[LOG_NAME_LEN] = {0};
+        snprintf(filename, LOG_NAME_LEN - 1, "%s/%04d_%02d_%02d%s", m_path, t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, m_suffix);
+        m_today = t.tm_mday;
+        {
+            std::lock_guard<std::mutex> locker(m_mutex);
+            m_buffer.initPtr();
+            m_fp = fopen(filename, "a");
+            if(m_fp == nullptr)
+            {
+                mkdir(m_path, 0777);
+                m_fp = fopen(filename, "a");
+            }
+            assert(m_fp);
+        }
+    }
+
+    int getLevel()
+    {
+        std::lock_guard<std::mutex> locker(m_mutex);
+        return m_level;
+    }
+
+    bool isOpen()
+    {
+        std::lock_guard<std::mutex> locker(m_mutex);
+        return m_isOpen;
+    }
+
+    void write(int level, const char* format, ...)
+    {
+        struct timeval now = {0, 0};
+        gettimeofday(&now, nullptr);
+        time_t tsec = now.tv_sec;
+        struct tm t = *localtime(&tsec);
+        va_list valist;
+
+        if(m_today != t.tm_mday || (m_lineCount && (m_lineCount % MAX_LINES == 0)))
+        {
+            std::unique_lock<std::mutex> locker(m_mutex);
+            locker.unlock();
+            char newfile[LOG_NAME_LEN];
+            char tail[36] = {0};
+            snprintf(tail, 36, "%04d_%02d_%02d", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
+            if(m_today != t.tm_mday)
+            {
+                snprintf(newfile, LOG_NAME_LEN - 72, "%s%s%s", m_path, tail, m_suffix);
+                m_today = t.tm_mday;
+                m_lineCount = 0;
+            }
+            else
+            {
+                snprintf(newfile, LOG_NAME_LEN - 72, "%s%s-%d%s", m_path, tail, (m_lineCount / MAX_LINES), m_suffix);
+            }
+            locker.lock();
+            flush();
+            fclose(m_fp);
+            m_fp = fopen(newfile, "a");
+            assert(m_fp);
+        }
+
+        {
+            std::unique_lock<std::mutex> locker(m_mutex);
+            m_lineCount++;
+            int n = snprintf(m_buffer.curWritePtr(), 128, "%d-%02d-%02d %02d:%02d:%02d.%06ld ", t.tm_year + 1900,
+            t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec, now.tv_usec);
+            m_buffer.updateWritePtr(n);
+            m_buffer.append("[info]:  ", 9);
+            va_start(valist, format);
+            int m = vsnprintf(m_buffer.curWritePtr(), m_buffer.writeableBytes(), format, valist);
+            va_end(valist);
+            m_buffer.updateWritePtr(m);
+            m_buffer.append("\n\0", 2);
+            if(m_isAsync && m_bq && !m_bq->full())
+            {
+                m_bq->push_back(m_buffer.alltoStr());
+            }
+            else
+            {
+                fputs(m_buffer.curReadPtr(), m_fp);
+            }
+            m_buffer.initPtr();
+        }
+    }
+
+    void flush()
+    {
+        if(m_isAsync)
+            m_bq->flush();
+        fflush(m_fp);
+    }
+
+private:
+    OldLog() : m_lineCount(0), m_today(0), m_isAsync(false), m_fp(nullptr) {}
+    ~OldLog()
+    {
+        if(m_writeThread && m_writeThread->joinable())
+        {
+            while(!m_bq->empty())
+            {
+                m_bq->flush();
+            }
+            m_bq->close();
+            m_writeThread->join();
+        }
+        if(m_fp)
+        {
+            std::lock_guard<std::mutex> locker(m_mutex);
+            flush();
+            fclose(m_fp);
+        }
+    }
+
+    void asyncWrite()
+    {
+        std::string str = "";
+        while(m_bq->pop(str))
+        {
+            std::lock_guard<std::mutex> locker(m_mutex);
+            fputs(str.c_str(), m_fp);
+        }
+    }
+
+    static const int LOG_NAME_LEN = 256;
+    static const int MAX_LINES = 50000;
+    const char* m_path;
+    const char* m_suffix;
+    int m_lineCount;
+    int m_today;
+    bool m_isOpen;
+    int m_level;
+    bool m_isAsync;
+    Buffer m_buffer;
+    FILE* m_fp;
+    std::unique_ptr<BlockQueue<std::string>> m_bq;
+    std::unique_ptr<std::thread> m_writeThread;
+    std::mutex m_mutex;
+};
+
+//原来的LOG_BASE展开后的样子
+#define OLD_LOG_INFO(format, ...) \
+    do {\
+        OldLog* log = OldLog::instance();\
+        if (log->isOpen() && log->getLevel() <= 1) {\
+            log->write(1, format, ##__VA_ARGS__); \
+            log->flush();\
+        }\
+    } while(0);
+
+struct Result
+{
+    double seconds;
+    vector<uint32_t> latency;   //每次调用的耗时ns
+};
+
+//threads个线程各写lines行，服务器里最常见的连接进出日志
+template<typename F>
+Result run(int threads, int lines, F logLine)
+{
+    Result result;
+    vector<vector<uint32_t>> latency(threads, vector<uint32_t>(lines));
+    vector<thread> workers;
+    auto start = Clock::now();
+    for(int i = 0; i < threads; i++)
+    {
+        workers.emplace_back([&, i]
+        {
+            for(int j = 0; j < lines; j++)
+            {
+                auto t0 = Clock::now();
+                logLine(i, j);
+                latency[i][j] = chrono::duration_cast<chrono::nanoseconds>(Clock::now() - t0).count();
+            }
+        });
+    }
+    for(auto& t : workers)
+        t.join();
+    result.seconds = chrono::duration<double>(Clock::now() - start).count();
+    for(auto& v : latency)
+        result.latency.insert(result.latency.end(), v.begin(), v.end());
+    sort(result.latency.begin(), result.latency.end());
+    return result;
+}
+
+void report(const char* name, int threads, Result& r)
+{
+    size_t n = r.latency.size();
+    double sum = 0;
+    for(uint32_t l : r.latency)
+        sum += l;
+    printf("%-4s %2d threads: %10.0f lines/s  latency avg %6.0fns  p50 %6uns  p99 %7uns  max %8uns\n",
+           name, threads, n / r.seconds, sum / n, r.latency[n / 2], r.latency[n * 99 / 100], r.latency[n - 1]);
+}
+
+//写得比后台线程落盘快时丢行，单独算实际写进文件的速度
+uint64_t reportDropped(const char* name, Result& r, uint64_t before)
+{
+    uint64_t dropped = Log::instance()->dropped() - before;
+    printf("%-4s dropped %lu lines (buffer full), %.0f lines/s kept\n", name, static_cast<unsigned long>(dropped),
+           (r.latency.size() - dropped) / r.seconds);
+    return r.latency.size() - dropped;
+}
+
+//目录下所有日志文件写进去的字节数，还在写的段末尾是预先分配的0，不算
+uint64_t dirBytes(const char* path)
+{
+    uint64_t bytes = 0;
+    DIR* dir = opendir(path);
+    if(!dir)
+        return 0;
+    while(struct dirent* entry = readdir(dir))
+    {
+        string file = string(path) + "/" + entry->d_name;
+        FILE* fp = fopen(file.c_str(), "rb");
+        if(!fp)
+            continue;
+        char buf[1 << 16];
+        uint64_t offset = 0, used = 0;
+        size_t n;
+        while((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        {
+            for(size_t i = n; i > 0; i--)
+            {
+                if(buf[i - 1] != 0)
+                {
+                    used = offset + i;
+                    break;
+                }
+            }
+            offset += n;
+        }
+        fclose(fp);
+        bytes += used;
+    }
+    closedir(dir);
+    return bytes;
+}
+
+//等后台线程把缓冲区里的都写出去
+void drain()
+{
+    Log::instance()->flush();
+    this_thread::sleep_for(chrono::milliseconds(300));
+}
+
+int main(int argc, char* argv[])
+{
+    int threads = argc > 1 ? atoi(argv[1]) : 4;
+    int lines = argc > 2 ? atoi(argv[2]) : 200000;
+    system("rm -rf /tmp/bench_log_old* /tmp/bench_log_new /tmp/bench_log_bin");
+
+    OldLog::instance()->init(1, "/tmp/bench_log_old", ".log", 1024);
+    //不压缩，最后比较两种格式的字节数
+    Log::instance()->init(1, "/tmp/bench_log_new", ".log", 1024, false, 16 << 20, false);
+    //测的是写日志本身，不限速
+    Log::instance()->setRateLimit(0);
+
+    uint64_t textLines = 0;
+    for(int n : {1, threads})
+    {
+        Result old = run(n, lines, [](int i, int j)
+        {
+            OLD_LOG_INFO("Client[%d](%s:%d) in, userCount:%d", j & 0xffff, "127.0.0.1", 40000 + i, j);
+        });
+        report("old", n, old);
+
+        uint64_t dropped = Log::instance()->dropped();
+        Result cur = run(n, lines, [](int i, int j)
+        {
+            LOG_INFO("Client[%d](%s:%d) in, userCount:%d", j & 0xffff, "127.0.0.1", 40000 + i, j);
+        });
+        report("new", n, cur);
+        textLines += reportDropped("new", cur, dropped);
+    }
+
+    //二进制模式：调用点只拷参数，格式化留给logdecoder
+    drain();
+    Log::instance()->init(1, "/tmp/bench_log_bin", ".blog", 1024, true, 16 << 20, false);
+    uint64_t binaryLines = 0;
+    for(int n : {1, threads})
+    {
+        uint64_t dropped = Log::instance()->dropped();
+        Result bin = run(n, lines, [](int i, int j)
+        {
+            LOG_INFO("Client[%d](%s:%d) in, userCount:%d", j & 0xffff, "127.0.0.1", 40000 + i, j);
+        });
+        report("bin", n, bin);
+        binaryLines += reportDropped("bin", bin, dropped);
+    }
+    drain();
+    printf("bytes per line on disk: text %.1f, binary %.1f\n", static_cast<double>(dirBytes("/tmp/bench_log_new")) / textLines,
+           static_cast<double>(dirBytes("/tmp/bench_log_bin")) / binaryLines);
+    return 0;
+}
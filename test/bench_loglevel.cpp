@@ -0,0 +1,126 @@
+//关掉的日志语句的开销：编译时去掉的LOG_DEBUG、运行时级别不够的LOG_INFO和空循环比较，再和原来每次检查都加锁的做法比较
+//以及每个调用点限速后，错误日志洪水时每次调用的开销和实际写进文件的行数
+//用-DLOG_MIN_LEVEL=1编译，make bench && ./test/bench_loglevel [循环次数] [洪水线程数]
+#include<chrono>
+#include<thread>
+#include<vector>
+#include<mutex>
+#include<atomic>
+#include<stdlib.h>
+#include<stdio.h>
+#include<dirent.h>
+#include"../log/log.h"
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+//不让编译器把循环本身优化掉
+#define BARRIER() asm volatile("" ::: "memory")
+
+template<typename F>
+double nsPerCall(long loops, F f)
+{
+    auto start = Clock::now();
+    for(long i = 0; i < loops; i++)
+    {
+        f(i);
+        BARRIER();
+    }
+    return chrono::duration<double, nano>(Clock::now() - start).count() / loops;
+}
+
+//原来的isOpen和getLevel各加一次锁
+struct LockedLevel
+{
+    mutex mtx;
+    bool isOpen = true;
+    int level = 2;
+    bool enabled(int l)
+    {
+        bool open;
+        int current;
+        {
+            lock_guard<mutex> locker(mtx);
+            open = isOpen;
+        }
+        {
+            lock_guard<mutex> locker(mtx);
+            current = level;
+        }
+        return open && current <= l;
+    }
+};
+
+//目录下日志文件里的行数
+long countLines(const char* path)
+{
+    long lines = 0;
+    DIR* dir = opendir(path);
+    if(!dir)
+        return 0;
+    while(struct dirent* entry = readdir(dir))
+    {
+        string file = string(path) + "/" + entry->d_name;
+        FILE* fp = fopen(file.c_str(), "rb");
+        if(!fp)
+            continue;
+        int c;
+        while((c = fgetc(fp)) != EOF)
+            lines += c == '\n';
+        fclose(fp);
+    }
+    closedir(dir);
+    return lines;
+}
+
+int main(int argc, char* argv[])
+{
+    long loops = argc > 1 ? atol(argv[1]) : 100000000;
+    int threads = argc > 2 ? atoi(argv[2]) : 4;
+    system("rm -rf /tmp/bench_loglevel");
+    //WARN级别，LOG_INFO运行时关掉，LOG_DEBUG编译时已经去掉
+    Log::instance()->init(2, "/tmp/bench_loglevel", ".log", 1024, false, 16 << 20, false);
+
+    volatile long sink = 0;
+    printf("empty loop         %6.2fns/call\n", nsPerCall(loops, [&](long i){ sink = i; }));
+    printf("LOG_DEBUG (removed)%6.2fns/call\n", nsPerCall(loops, [&](long i){ sink = i; LOG_DEBUG("request %ld", i); }));
+    printf("LOG_INFO (off)     %6.2fns/call\n", nsPerCall(loops, [&](long i){ sink = i; LOG_INFO("request %ld", i); }));
+    LockedLevel locked;
+    printf("locked check (old) %6.2fns/call\n", nsPerCall(loops / 10, [&](long i)
+    {
+        sink = i;
+        if(locked.enabled(1))
+            LOG_INFO("request %ld", i);
+    }));
+
+    //洪水：几个线程一直写同一个调用点，限速默认关闭，这里打开，每秒只有限额内的行写进文件
+    const uint32_t rateLimit = 1000;
+    Log::instance()->setRateLimit(rateLimit);
+    const int seconds = 2;
+    atomic<long> calls(0);
+    vector<thread> workers;
+    auto deadline = Clock::now() + chrono::seconds(seconds);
+    auto start = Clock::now();
+    for(int t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&]
+        {
+            long n = 0;
+            while(Clock::now() < deadline)
+            {
+                for(int k = 0; k < 1000; k++, n++)
+                    LOG_ERROR("RequestLine Error");
+            }
+            calls += n;
+        });
+    }
+    for(auto& w : workers)
+        w.join();
+    double elapsed = chrono::duration<double>(Clock::now() - start).count();
+    Log::instance()->flush();
+    this_thread::sleep_for(chrono::milliseconds(300));
+    printf("LOG_ERROR flood    %6.2fns/call, %ld calls from %d threads in %.1fs, limit %u lines/s, %ld lines written\n",
+           elapsed * 1e9 * threads / calls, calls.load(), threads, elapsed, rateLimit, countLines("/tmp/bench_loglevel"));
+    system("rm -rf /tmp/bench_loglevel");
+    return 0;
+}
@@ -0,0 +1,203 @@
+//请求解析的微基准：对比原来基于std::regex的解析和现在的增量状态机解析，以及不同指令集的字节扫描
+//make bench && ./test/bench_parser
+#include<chrono>
+#include<regex>
+#include<unordered_map>
+#include<iostream>
+#include"../http/httprequest.h"
+using namespace std;
+
+//原来的解析实现，只保留解析相关的部分用于对比
+class RegexRequest
+{
+public:
+    enum PARSE_STATE{REQUEST_LINE, HEADERS, BODY, FINISH};
+
+    void init()
+    {
+        m_method = m_path = m_version = m_body = "";
+        m_state = REQUEST_LINE;
+        m_header.clear();
+        m_post.clear();
+    }
+
+    bool parse(Buffer& buff)
+    {
+        const char* CRLF = "\r\n";
+        if(buff.readableBytes() <= 0)
+            return false;
+        while(buff.readableBytes() && m_state != FINISH)
+        {
+            const char* lineEnd = std::search(buff.curReadPtr(), buff.curWritePtrConst(), CRLF, CRLF + 2);
+            std::string line(buff.curReadPtr(), lineEnd);
+            switch(m_state)
+            {
+                case REQUEST_LINE:
+                    if(!parseRequestLine(line))
+                        return false;
+                    break;
+                case HEADERS:
+                    parseHeader(line);
+                    if(buff.readableBytes() <= 2)
+                        m_state = FINISH;
+                    break;
+                case BODY:
+                    parseBody(line);
+                    break;
+                default:
+                    break;
+            }
+            if(lineEnd == buff.curWritePtr())
+                break;
+            buff.updateReadPtrUntilEnd(lineEnd + 2);
+        }
+        return true;
+    }
+
+private:
+    bool parseRequestLine(const std::string& line)
+    {
+        std::regex pattern("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");
+        std::smatch submatch;
+        if(regex_match(line, submatch, pattern))
+        {
+            m_method = submatch[1];
+            m_path = submatch[2];
+            m_version = submatch[3];
+            m_state = HEADERS;
+            return true;
+        }
+        return false;
+    }
+
+    void parseHeader(const std::string& line)
+    {
+        std::regex pattern("^([^:]*): ?(.*)$");
+        std::smatch submatch;
+        if(regex_match(line, submatch, pattern))
+            m_header[submatch[1]] = submatch[2];
+        else
+            m_state = BODY;
+    }
+
+    void parseBody(const std::string& line)
+    {
+        m_body = line;
+        if(m_method == "POST" && m_header["Content-Type"] == "application/x-www-form-urlencoded")
+        {
+            std::regex pattern("(?!&)(.*?)=(.*?)(?=&|$)");
+            std::smatch submatch;
+            std::string::const_iterator beg = m_body.begin();
+            std::string::const_iterator end = m_body.end();
+            while(std::regex_search(beg, end, submatch, pattern))
+            {
+                m_post[submatch[1]] = submatch[2];
+                beg = submatch[0].second;
+            }
+        }
+        m_state = FINISH;
+    }
+
+    PARSE_STATE m_state;
+    std::string m_method, m_path, m_version, m_body;
+    std::unordered_map<std::string, std::string> m_header;
+    std::unordered_map<std::string, std::string> m_post;
+};
+
+static const char* SMALL_GET =
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: 127.0.0.1:8081\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+static const char* BROWSER_GET =
+    "GET /images/instagram-image1.jpg HTTP/1.1\r\n"
+    "Host: 127.0.0.1:8081\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:91.0) Gecko/20100101 Firefox/91.0\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8\r\n"
+    "Accept-Language: zh-CN,zh;q=0.8,zh-TW;q=0.7,zh-HK;q=0.5,en-US;q=0.3,en;q=0.2\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Referer: http://127.0.0.1:8081/picture.html\r\n"
+    "Cookie: session=8f14e45fceea167a5a36dedd4bea2543; theme=dark; lang=zh-CN; tracking=a87ff679a2f3e71d9181a67b7542122c\r\n"
+    "Connection: keep-alive\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "\r\n";
+
+static const char* POST =
+    "POST /login HTTP/1.1\r\n"
+    "Host: 127.0.0.1:8081\r\n"
+    "Content-Type: application/x-www-form-urlencoded\r\n"
+    "Content-Length: 29\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n"
+    "username=root&password=123456";
+
+//每次解析前把请求写入缓冲区，和服务器里readFd之后再解析一致
+template<typename Request>
+double bench(const char* text, int n)
+{
+    Request request;
+    Buffer buff;
+    size_t len = strlen(text);
+    auto start = chrono::steady_clock::now();
+    for(int i = 0; i < n; i++)
+    {
+        request.init();
+        buff.append(text, len);
+        if(!request.parse(buff))
+        {
+            cout << "parse error" << endl;
+            return 0;
+        }
+        buff.updateReadPtr(buff.readableBytes());
+    }
+    double sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return n / sec;
+}
+
+//长行扫描的吞吐，单位GB/s
+static double benchScan(const std::string& line, int n)
+{
+    const char* begin = line.data();
+    const char* end = begin + line.size();
+    size_t sum = 0;
+    auto start = chrono::steady_clock::now();
+    for(int i = 0; i < n; i++)
+    {
+        sum += HttpScan::findCtl(begin, end) - begin;
+        sum += HttpScan::skipToken(begin, end) - begin;
+    }
+    double sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if(sum == 0)
+        cout << "unexpected" << endl;
+    return 2.0 * line.size() * n / sec / 1e9;
+}
+
+int main(int argc, char* argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : 200000;
+    struct Case { const char* name; const char* text; } cases[] = {
+        {"small get", SMALL_GET}, {"browser get", BROWSER_GET}, {"post", POST},
+    };
+    for(const Case& c : cases)
+    {
+        double regexRate = bench<RegexRequest>(c.text, n / 10);
+        double newRate = bench<HttpRequest>(c.text, n);
+        printf("%-12s regex: %10.0f req/s   state machine: %10.0f req/s   x%.1f\n",
+               c.name, regexRate, newRate, newRate / regexRate);
+    }
+
+    //同样的请求在各个指令集下解析，长行模拟带大cookie的请求
+    std::string longLine(4096, 'a');
+    longLine += "\r\n";
+    HttpScan::ISA best = HttpScan::detect();
+    for(int isa = HttpScan::SCALAR; isa <= best; isa++)
+    {
+        HttpScan::force(static_cast<HttpScan::ISA>(isa));
+        printf("%-8s browser get: %10.0f req/s   4KB line scan: %6.2f GB/s\n", HttpScan::isaName(),
+               bench<HttpRequest>(BROWSER_GET, n), benchScan(longLine, n / 10));
+    }
+    HttpScan::force(best);
+    return 0;
+}
@@ -0,0 +1,230 @@
+//线程池的基准：一个线程模拟reactor不停投递短任务，对比加锁队列、work stealing和连接亲和的吞吐和排队时间
+//每个任务属于一个连接，读写这个连接的状态；同一个连接同时最多一个任务，相当于EPOLLONESHOT
+//替换了全局的operator new，统计每投递一个任务申请内存的次数；用perf_event_open统计线程池线程的L1D和LLC读缺失
+//make bench && ./test/bench_pool [线程数] [任务数] [每个任务的工作量ns] [连接数] [每个连接的状态KB] [pin]
+#include<chrono>
+#include<atomic>
+#include<vector>
+#include<functional>
+#include<iostream>
+#include<stdlib.h>
+#include<string.h>
+#include<unistd.h>
+#include<sys/ioctl.h>
+#include<sys/syscall.h>
+#include<linux/perf_event.h>
+#include"../server/threadpool.h"
+#include"../server/workstealingpool.h"
+using namespace std;
+
+static atomic<uint64_t> g_allocs{0};
+
+void* operator new(size_t size)
+{
+    g_allocs.fetch_add(1, memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if(!p)
+        throw bad_alloc();
+    return p;
+}
+
+//new和delete都替换成了malloc和free，编译器看不到这一点
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+//统计本进程和之后创建的线程，线程退出后计数才合并到这个fd上
+class PerfCounter
+{
+public:
+    PerfCounter(uint32_t type, uint64_t config)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        m_fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    ~PerfCounter()
+    {
+        if(m_fd >= 0)
+            close(m_fd);
+    }
+    //不支持时返回-1
+    long long read()
+    {
+        long long value;
+        if(m_fd < 0 || ::read(m_fd, &value, sizeof(value)) != sizeof(value))
+            return -1;
+        return value;
+    }
+
+private:
+    int m_fd;
+};
+
+static const uint64_t L1D_READ_MISS = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+static const uint64_t LLC_READ_MISS = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+static void spin(int64_t ns)
+{
+    int64_t end = Executor::nowNS() + ns;
+    while(Executor::nowNS() < end)
+    {
+    }
+}
+
+//模拟连接：缓冲区和请求状态，处理时整块读写一遍
+struct Conn
+{
+    vector<char> state;
+    atomic<bool> pending{false};
+};
+
+//模拟reactor的处理函数
+struct Handler
+{
+    atomic<int> done{0};
+    int work = 0;
+    void onRead(Conn* conn)
+    {
+        for(size_t i = 0; i < conn->state.size(); i += 64)
+            conn->state[i]++;
+        spin(work);
+        conn->pending.store(false, memory_order_release);
+        done.fetch_add(1, memory_order_relaxed);
+    }
+};
+
+//原来的写法：std::bind(&Reactor::onRead, this, client)包成std::function，超过std::function内部的空间时要申请内存
+static void benchBind(int tasks)
+{
+    Handler handler;
+    Conn conn;
+    vector<function<void()>> queue;
+    queue.reserve(tasks);
+    uint64_t allocs = g_allocs.load();
+    for(int i = 0; i < tasks; i++)
+    {
+        queue.emplace_back(std::bind(&Handler::onRead, &handler, &conn));
+    }
+    printf("%-6s allocs/task %5.2f\n", "bind", static_cast<double>(g_allocs.load() - allocs) / tasks);
+}
+
+template<typename Factory>
+static void bench(Factory create, vector<Conn>& conns, int tasks, int work)
+{
+    PerfCounter l1(PERF_TYPE_HW_CACHE, L1D_READ_MISS);
+    PerfCounter llc(PERF_TYPE_HW_CACHE, LLC_READ_MISS);
+    long long l1Start = l1.read();
+    long long llcStart = llc.read();
+    Handler handler;
+    handler.work = work;
+    string name;
+    PoolStats stats;
+    uint64_t allocs;
+    double sec;
+    {
+        unique_ptr<Executor> pool(create());
+        name = pool->name();
+        auto start = chrono::steady_clock::now();
+        allocs = g_allocs.load();
+        for(int i = 0; i < tasks; i++)
+        {
+            int key = i % conns.size();
+            Conn* conn = &conns[key];
+            while(conn->pending.load(memory_order_acquire))
+            {
+                this_thread::yield();
+            }
+            conn->pending.store(true, memory_order_relaxed);
+            pool->addTask([h = &handler, conn] { h->onRead(conn); }, key);
+        }
+        while(handler.done.load() < tasks)
+        {
+            this_thread::yield();
+        }
+        allocs = g_allocs.load() - allocs;
+        sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        stats = pool->stats();
+    }
+    //等线程退出，计数合并到父线程
+    this_thread::sleep_for(chrono::milliseconds(50));
+    long long l1Miss = l1.read() - l1Start;
+    long long llcMiss = llc.read() - llcStart;
+    printf("%-6s allocs/task %5.2f   %6.2f M tasks/s   avg wait %8.2f us   steals %8llu   reassigns %6llu",
+           name.data(), static_cast<double>(allocs) / tasks, tasks / sec / 1e6, stats.waitNS / 1e3 / stats.tasks,
+           (unsigned long long)stats.steals, (unsigned long long)stats.reassigns);
+    if(l1Start >= 0 && llcStart >= 0)
+        printf("   L1D miss/task %7.1f   LLC miss/task %6.2f\n", static_cast<double>(l1Miss) / tasks, static_cast<double>(llcMiss) / tasks);
+    else
+        printf("   perf counters unavailable\n");
+}
+
+//伸缩：先持续投递重任务，再空闲，打印每次伸缩和它的依据
+static void benchElastic(size_t minThreads, size_t maxThreads)
+{
+    WorkStealingPool pool(minThreads, maxThreads);
+    atomic<int> pending{0};
+    auto phase = [&](const char* name, int ms, int work, size_t window) {
+        auto end = chrono::steady_clock::now() + chrono::milliseconds(ms);
+        while(chrono::steady_clock::now() < end)
+        {
+            if(static_cast<size_t>(pending.load()) < window)
+            {
+                pending++;
+                pool.addTask([&pending, work] { spin(work); pending--; });
+            }
+            else
+            {
+                this_thread::yield();
+            }
+        }
+        printf("after %-5s threads %llu\n", name, (unsigned long long)pool.stats().threads);
+    };
+    phase("burst", 2000, 50000, 256);
+    phase("idle", 5000, 0, 0);
+    if(pending.load() != 0)
+        printf("%d tasks lost\n", pending.load());
+    vector<ScaleEvent> events;
+    pool.takeScaleEvents(events);
+    for(const ScaleEvent& event : events)
+    {
+        printf("  %2zu -> %2zu threads   avg wait %8.1f us   busy %3d%%\n", event.from, event.to, event.waitNS / 1e3,
+               static_cast<int>(event.busy * 100));
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int threads = argc > 1 ? atoi(argv[1]) : 16;
+    int tasks = argc > 2 ? atoi(argv[2]) : 1000000;
+    int work = argc > 3 ? atoi(argv[3]) : 200;
+    int connNumber = argc > 4 ? atoi(argv[4]) : 1024;
+    int stateKB = argc > 5 ? atoi(argv[5]) : 16;
+    bool pinCpu = argc > 6 && atoi(argv[6]) != 0;
+    printf("%d threads, %d tasks, %dns each, %d connections with %dKB state\n", threads, tasks, work, connNumber, stateKB);
+    vector<Conn> conns(connNumber);
+    for(Conn& conn : conns)
+        conn.state.assign(stateKB * 1024, 0);
+    size_t queueSize = connNumber / threads + 1;
+    benchBind(tasks);
+    bench([&] { return new ThreadPool(threads); }, conns, tasks, work);
+    bench([&] { return new WorkStealingPool(threads, threads, queueSize, WorkStealingPool::STEAL, pinCpu); }, conns, tasks, work);
+    bench([&] { return new WorkStealingPool(threads, threads, queueSize, WorkStealingPool::AFFINE, pinCpu); }, conns, tasks, work);
+    benchElastic(2, 8);
+    return 0;
+}
@@ -0,0 +1,143 @@
+//大文件发送的基准：对比每次mmap+writev和服务器的OutputQueue（头部writev、文件分块sendfile），统计发送线程每GB消耗的CPU时间
+//make bench && ./test/bench_sendfile [文件] [次数]
+#include<chrono>
+#include<thread>
+#include<iostream>
+#include<string>
+#include<fcntl.h>
+#include<unistd.h>
+#include<time.h>
+#include<sys/stat.h>
+#include<sys/mman.h>
+#include<sys/uio.h>
+#include<sys/socket.h>
+#include<netinet/in.h>
+#include<arpa/inet.h>
+#include"../http/outputqueue.h"
+using namespace std;
+
+//两种方式都先发同样的头部
+static const char HEAD[] = "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\n\r\n";
+
+static double threadCpu()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//建立一条本地TCP连接，对端由线程不停读走数据
+static int connectPair(int& peer)
+{
+    int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    bind(listenFd, (struct sockaddr*)&addr, sizeof(addr));
+    listen(listenFd, 1);
+    getsockname(listenFd, (struct sockaddr*)&addr, &len);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+    peer = accept(listenFd, nullptr, nullptr);
+    close(listenFd);
+    return fd;
+}
+
+static void drain(int fd)
+{
+    static char buf[1 << 20];
+    while(read(fd, buf, sizeof(buf)) > 0)
+    {
+    }
+}
+
+//原来的方式：每个应答映射整个文件，头部和文件一起writev直到写完，再munmap
+static void sendMmap(int sock, const char* path, size_t size)
+{
+    int fd = open(path, O_RDONLY);
+    char* data = (char*)mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    struct iovec iov[2] = {{const_cast<char*>(HEAD), sizeof(HEAD) - 1}, {data, size}};
+    int idx = 0;
+    while(idx < 2)
+    {
+        ssize_t len = writev(sock, iov + idx, 2 - idx);
+        if(len <= 0)
+            break;
+        while(idx < 2 && static_cast<size_t>(len) >= iov[idx].iov_len)
+            len -= iov[idx++].iov_len;
+        if(idx < 2)
+        {
+            iov[idx].iov_base = (char*)iov[idx].iov_base + len;
+            iov[idx].iov_len -= len;
+        }
+    }
+    munmap(data, size);
+}
+
+//服务器的方式：fd由文件缓存保持打开，头部块和文件段排进OutputQueue，
+//每次flush一个系统调用，文件段每次最多sendfile OutputQueue::SENDFILE_CHUNK字节
+static void sendQueue(int sock, int fd, size_t size, Buffer& buffer, OutputQueue& queue)
+{
+    buffer.initPtr();
+    queue.clear();
+    queue.addBlock(HEAD, sizeof(HEAD) - 1);
+    queue.addFile(fd, 0, size);
+    queue.build(buffer);
+    int err = 0;
+    while(queue.bytes() > 0)
+    {
+        if(queue.flush(sock, &err) < 0)
+        {
+            printf("flush error: %d\n", err);
+            break;
+        }
+    }
+}
+
+template<typename Func>
+static void bench(const char* name, size_t size, int n, Func send)
+{
+    int peer;
+    int sock = connectPair(peer);
+    thread reader(drain, peer);
+    auto start = chrono::steady_clock::now();
+    double cpu = threadCpu();
+    for(int i = 0; i < n; i++)
+        send(sock);
+    cpu = threadCpu() - cpu;
+    double sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    shutdown(sock, SHUT_WR);
+    reader.join();
+    close(sock);
+    close(peer);
+    double gb = static_cast<double>(size) * n / 1e9;
+    printf("%-14s %8.2f GB/s   cpu %6.3f s/GB\n", name, gb / sec, cpu / gb);
+}
+
+int main(int argc, char* argv[])
+{
+    string path = argc > 1 ? argv[1] : "/tmp/bench_sendfile.bin";
+    int n = argc > 2 ? atoi(argv[2]) : 50;
+    struct stat st;
+    if(stat(path.data(), &st) < 0)
+    {
+        //没有指定文件时生成一个32MB的文件
+        int fd = open(path.data(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        string block(1 << 20, 'x');
+        for(int i = 0; i < 32; i++)
+            write(fd, block.data(), block.size());
+        close(fd);
+        stat(path.data(), &st);
+    }
+    size_t size = st.st_size;
+    int fd = open(path.data(), O_RDONLY);
+    printf("file %s, %zu bytes, %d times, sendfile chunk %zuKB\n", path.data(), size, n, OutputQueue::SENDFILE_CHUNK / 1024);
+    Buffer buffer;
+    OutputQueue queue;
+    bench("mmap+writev", size, n, [&](int sock) { sendMmap(sock, path.data(), size); });
+    bench("OutputQueue", size, n, [&](int sock) { sendQueue(sock, fd, size, buffer, queue); });
+    close(fd);
+    return 0;
+}
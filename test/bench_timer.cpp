@@ -0,0 +1,201 @@
+//计时器的基准：对比原来的小根堆+哈希表和现在的分层时间轮，统计加入、更新、超时处理的吞吐
+//make bench && ./test/bench_timer [连接数] [更新次数]
+#include<chrono>
+#include<thread>
+#include<vector>
+#include<functional>
+#include<unordered_map>
+#include<iostream>
+#include"../timer/timer.h"
+using namespace std;
+
+typedef std::function<void()> TimeoutCallBack;
+typedef std::chrono::high_resolution_clock Clock;
+typedef std::chrono::milliseconds MS;
+typedef Clock::time_point TimeStamp;
+
+//原来的实现，只保留服务器用到的接口
+class HeapTimer
+{
+public:
+    void addTimer(int id, int timeout, const TimeoutCallBack& cb)
+    {
+        size_t i;
+        if(m_hash.count(id))
+        {
+            i = m_hash[id];
+            m_heap[i].expire = Clock::now() + MS(timeout);
+            m_heap[i].cb = cb;
+            if(!shiftdown(i, m_heap.size()))
+                shiftup(i);
+        }
+        else
+        {
+            i = m_heap.size();
+            m_hash[id] = i;
+            m_heap.push_back({id, Clock::now() + MS(timeout), cb});
+            shiftup(i);
+        }
+    }
+
+    void update(int id, int timeout)
+    {
+        size_t i = m_hash[id];
+        m_heap[i].expire = Clock::now() + MS(timeout);
+        shiftdown(i, m_heap.size());
+    }
+
+    void handleExpiredEvent()
+    {
+        while(!m_heap.empty())
+        {
+            Node node = m_heap.front();
+            if(std::chrono::duration_cast<MS>(node.expire - Clock::now()).count() > 0)
+                break;
+            node.cb();
+            del(0);
+        }
+    }
+
+    size_t size() const
+    {
+        return m_heap.size();
+    }
+
+private:
+    struct Node
+    {
+        int id;
+        TimeStamp expire;
+        TimeoutCallBack cb;
+        bool operator<(const Node& rhs) const { return expire < rhs.expire; }
+        bool operator>(const Node& rhs) const { return expire > rhs.expire; }
+    };
+
+    void swapNode(size_t i, size_t j)
+    {
+        std::swap(m_heap[i], m_heap[j]);
+        m_hash[m_heap[i].id] = i;
+        m_hash[m_heap[j].id] = j;
+    }
+
+    void shiftup(size_t i)
+    {
+        int j = (i - 1) / 2;
+        while(j >= 0)
+        {
+            if(m_heap[j] < m_heap[i])
+                break;
+            swapNode(i, j);
+            i = j;
+            j = (i - 1) / 2;
+        }
+    }
+
+    bool shiftdown(size_t index, size_t n)
+    {
+        size_t i = index;
+        size_t j = i * 2 + 1;
+        while(j < n)
+        {
+            if(j + 1 < n && m_heap[j + 1] < m_heap[j])
+                j++;
+            if(m_heap[j] > m_heap[i])
+                break;
+            swapNode(i, j);
+            i = j;
+            j = i * 2 + 1;
+        }
+        return i > index;
+    }
+
+    void del(size_t i)
+    {
+        size_t n = m_heap.size();
+        if(i < n - 1)
+        {
+            swapNode(i, n - 1);
+            if(!shiftdown(i, n - 1))
+                shiftup(i);
+        }
+        m_hash.erase(m_heap.back().id);
+        m_heap.pop_back();
+    }
+
+    std::vector<Node> m_heap;
+    std::unordered_map<int, size_t> m_hash;
+};
+
+struct Conn
+{
+    TimerNode node;
+    int closed = 0;
+};
+
+static const int TIMEOUT = 50;
+
+static double since(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static void report(const char* name, int n, int updates, double add, double update, double expire)
+{
+    printf("%-6s add %7.2f M/s   update %7.2f M/s   expire %7.2f M/s\n",
+           name, n / add / 1e6, updates / update / 1e6, n / expire / 1e6);
+}
+
+int main(int argc, char* argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : 50000;
+    int updates = argc > 2 ? atoi(argv[2]) : 2000000;
+    //两种实现使用同样的随机更新序列
+    vector<int> ids(updates);
+    srand(1);
+    for(int& id : ids)
+        id = rand() % n;
+    vector<Conn> conns(n);
+    int closed = 0;
+
+    {
+        HeapTimer heap;
+        auto start = chrono::steady_clock::now();
+        for(int i = 0; i < n; i++)
+            heap.addTimer(i, TIMEOUT, [&conns, &closed, i]() { conns[i].closed++; closed++; });
+        double add = since(start);
+        start = chrono::steady_clock::now();
+        for(int id : ids)
+            heap.update(id, TIMEOUT);
+        double update = since(start);
+        this_thread::sleep_for(MS(TIMEOUT + 10));
+        start = chrono::steady_clock::now();
+        heap.handleExpiredEvent();
+        double expire = since(start);
+        report("heap", n, updates, add, update, expire);
+    }
+
+    {
+        TimerManager wheel([](void* ctx, void* data) {
+            static_cast<Conn*>(data)->closed++;
+            (*static_cast<int*>(ctx))++;
+        }, &closed);
+        for(Conn& conn : conns)
+            conn.node.data = &conn;
+        auto start = chrono::steady_clock::now();
+        for(int i = 0; i < n; i++)
+            wheel.addTimer(&conns[i].node, TIMEOUT);
+        double add = since(start);
+        start = chrono::steady_clock::now();
+        for(int id : ids)
+            wheel.update(&conns[id].node, TIMEOUT);
+        double update = since(start);
+        this_thread::sleep_for(MS(TIMEOUT + 10));
+        start = chrono::steady_clock::now();
+        wheel.handleExpiredEvent();
+        double expire = since(start);
+        report("wheel", n, updates, add, update, expire);
+    }
+    if(closed != 2 * n)
+        printf("expected %d timeouts, got %d\n", 2 * n, closed);
+    return 0;
+}
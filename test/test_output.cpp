@@ -0,0 +1,94 @@
+//输出队列：写缓冲区里跨块的段、超过IOV_MAX个的共享内存块、文件的一段混在一起，
+//发送端的socket缓冲区很小，每次flush只写进一部分，检查对端收到的数据和段拼起来的一样
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<fcntl.h>
+#include<errno.h>
+#include<unistd.h>
+#include<sys/socket.h>
+#include<iostream>
+#include<string>
+#include<vector>
+#include<algorithm>
+#include"../http/outputqueue.h"
+using namespace std;
+
+//对端读走现有的数据
+void drain(int fd, string& received)
+{
+    char buf[65536];
+    ssize_t n;
+    while((n = read(fd, buf, sizeof(buf))) > 0)
+        received.append(buf, n);
+}
+
+int main()
+{
+    int fds[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+        return 1;
+    int sndbuf = 4096;
+    setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+    //文件内容用不同的字节，方便发现偏移错误
+    char path[] = "/tmp/test_outputXXXXXX";
+    int file = mkstemp(path);
+    string content;
+    for(int i = 0; i < 3 * 1024 * 1024 / 7; i++)
+        content += to_string(i % 10) + "abcdef";
+    if(write(file, content.data(), content.size()) != static_cast<ssize_t>(content.size()))
+        return 1;
+    unlink(path);
+
+    Buffer buffer;
+    OutputQueue queue;
+    string expected;
+    //写缓冲区里的段，跨过好几个块
+    string head(Buffer::SLAB_SIZE * 3 + 100, 'h');
+    buffer.append(head);
+    queue.addBuffer(0, head.size());
+    expected += head;
+    //比IOV_MAX多的共享块
+    vector<string> blocks;
+    for(int i = 0; i < IOV_MAX + 500; i++)
+        blocks.push_back("block" + to_string(i) + ";");
+    for(const string& b : blocks)
+    {
+        queue.addBlock(b.data(), b.size());
+        expected += b;
+    }
+    //文件中间的一段，后面接着写缓冲区里的段
+    queue.addFile(file, 1000, content.size() - 2000);
+    expected += content.substr(1000, content.size() - 2000);
+    size_t tail = buffer.readableBytes();
+    buffer.append("tail\r\n");
+    queue.addBuffer(tail, 6);
+    expected += "tail\r\n";
+    queue.build(buffer);
+
+    string received;
+    int flushes = 0, maxIov = 0;
+    while(queue.bytes() > 0)
+    {
+        maxIov = max(maxIov, queue.iovCnt());
+        int err = 0;
+        ssize_t n = queue.flush(fds[0], &err);
+        flushes++;
+        if(n < 0 && err != EAGAIN)
+        {
+            cout<<"flush error:"<<strerror(err)<<endl;
+            return 1;
+        }
+        drain(fds[1], received);
+    }
+    drain(fds[1], received);
+    cout<<"bytes:"<<expected.size()<<", match:"<<(received == expected)<<endl;
+    cout<<"maxIov<=IOV_MAX:"<<(maxIov <= IOV_MAX)<<", partial:"<<(flushes > 2)<<endl;
+    close(file);
+    close(fds[0]);
+    close(fds[1]);
+    return received == expected ? 0 : 1;
+}
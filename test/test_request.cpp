@@ -1,4 +1,3 @@
-#include "../pool/threadpool.h"
 #include "../http/httprequest.h"
 #include <iostream>
 using namespace std;
@@ -21,6 +20,7 @@ void testPost()
     cout<<"method:"<<request.getMethod()<<endl;
     cout<<"path:"<<request.getPath()<<endl;
     cout<<"version:"<<request.getVersion()<<endl;
+    cout<<"username:"<<request.getPost("username")<<endl;
     if(request.isKeepAlive())   
         cout<<"isKeepAlive"<<endl;
 }
@@ -47,11 +47,142 @@ void testGet()
     if(request.isKeepAlive())   
         cout<<"isKeepAlive"<<endl;
 }
- 
+
+//数据分几次到达，每次都从上次停下的位置继续解析
+void testPartial()
+{
+    HttpRequest request;
+    Buffer input;
+    const char* parts[] = {"GET /index HT", "TP/1.1\r\nHost: 127.0", ".0.1\r\nConnection: keep-alive\r", "\n\r\n"};
+    for(const char* part : parts)
+    {
+        input.append(part, strlen(part));
+        if(!request.parse(input))
+        {
+            cout<<"parse error"<<endl;
+            return;
+        }
+        cout<<"finish:"<<request.isFinish()<<endl;
+    }
+    cout<<"path:"<<request.getPath()<<endl;
+    cout<<"host:"<<request.getHeader("host")<<endl;
+    if(request.isKeepAlive())
+        cout<<"isKeepAlive"<<endl;
+}
+
+//缓冲区由多个块组成，流水线里的请求跨过块的边界，消息体比一块大
+void testSlabs()
+{
+    HttpRequest request;
+    Buffer input;
+    std::string get = "GET /index HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n\r\n";
+    int count = 0;
+    for(size_t len = 0; len < Buffer::SLAB_SIZE * 3; len += get.size())
+        input.append(get);
+    while(input.readableBytes() > 0 && request.parse(input) && request.isFinish() && request.getPath() == "/index.html")
+        count++;
+    cout<<"pipelined:"<<count<<", left:"<<input.readableBytes()<<endl;
+
+    std::string body(Buffer::SLAB_SIZE * 5 / 2, 'x');
+    std::string post = "POST /login HTTP/1.1\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+    input.append(post);
+    for(size_t off = 0; off < body.size(); off += 1000)
+    {
+        input.append(body.data() + off, std::min<size_t>(1000, body.size() - off));
+        if(!request.parse(input))
+        {
+            cout<<"parse error"<<endl;
+            return;
+        }
+    }
+    cout<<"body:"<<(request.isFinish() && request.getBody() == body)<<", left:"<<input.readableBytes()<<endl;
+}
+
+//请求跨过环形缓冲区的末尾，以及消息体超过默认容量时扩大
+void testRing()
+{
+    if(!RingBuffer::available())
+    {
+        cout<<"memfd unavailable"<<endl;
+        return;
+    }
+    HttpRequest request;
+    RingBuffer input;
+    std::string get = "GET /index HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n\r\n";
+    int count = 0;
+    for(int round = 0; round < 3; round++)
+    {
+        for(size_t len = 0; len + get.size() <= RingBuffer::DEFAULT_CAPACITY * 2 / 3; len += get.size())
+            input.append(get);
+        while(input.readableBytes() > 0 && request.parse(input) && request.isFinish() && request.getPath() == "/index.html")
+            count++;
+    }
+    cout<<"pipelined:"<<count<<", left:"<<input.readableBytes()<<", capacity:"<<input.capacity()<<endl;
+
+    std::string body(RingBuffer::DEFAULT_CAPACITY * 3, 'x');
+    std::string post = "POST /login HTTP/1.1\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+    input.append(post);
+    for(size_t off = 0; off < body.size(); off += 10000)
+    {
+        input.append(body.data() + off, std::min<size_t>(10000, body.size() - off));
+        if(!request.parse(input))
+        {
+            cout<<"parse error"<<endl;
+            return;
+        }
+    }
+    cout<<"body:"<<(request.isFinish() && request.getBody() == body)<<", left:"<<input.readableBytes()<<", capacity:"<<input.capacity()<<endl;
+    input.initPtr();
+    cout<<"after init capacity:"<<input.capacity()<<endl;
+}
+
+//按版本和Connection头部判断是否保持连接，token不区分大小写，可以是列表
+void testKeepAlive()
+{
+    struct Case
+    {
+        const char* version;
+        const char* connection;     //为空时不带Connection头部
+        bool keepAlive;
+    } cases[] = {
+        {"1.1", nullptr, true},
+        {"1.1", "Keep-Alive", true},
+        {"1.1", "close", false},
+        {"1.1", "Upgrade, CLOSE", false},
+        {"1.0", nullptr, false},
+        {"1.0", "keep-alive", true},
+        {"1.0", "KEEP-ALIVE", true},
+        {"1.0", "TE , keep-alive", true},
+        {"1.0", "keep-alive-x", false},
+        {"2", nullptr, true},
+    };
+    int pass = 0, total = sizeof(cases) / sizeof(cases[0]);
+    for(const Case& c : cases)
+    {
+        HttpRequest request;
+        Buffer input;
+        input.append(std::string("GET /index HTTP/") + c.version + "\r\nHost: 127.0.0.1\r\n" +
+                     (c.connection ? std::string("Connection: ") + c.connection + "\r\n" : std::string()) + "\r\n");
+        if(request.parse(input) && request.isFinish() && request.isKeepAlive() == c.keepAlive)
+            pass++;
+        else
+            cout<<"HTTP/"<<c.version<<" Connection: "<<(c.connection ? c.connection : "(none)")<<" failed"<<endl;
+    }
+    cout<<"keepAlive:"<<pass<<"/"<<total<<endl;
+}
+
 int main()
 {
     cout<<"POST------------------------------------------"<<endl;
     testPost();
     cout<<"GET-------------------------------------------"<<endl;
     testGet();
+    cout<<"PARTIAL---------------------------------------"<<endl;
+    testPartial();
+    cout<<"SLABS-----------------------------------------"<<endl;
+    testSlabs();
+    cout<<"RING------------------------------------------"<<endl;
+    testRing();
+    cout<<"KEEPALIVE-------------------------------------"<<endl;
+    testKeepAlive();
 }
\ No newline at end of file
@@ -1,150 +1,247 @@
 #include"timer.h"
+#include<algorithm>
 
-//交换节点在vector里的位置，并改变m_hash表的映射
-void TimerManager::swapNode(size_t i, size_t j)
+TimerManager::TimerManager(TimeoutHandler handler, void* ctx)
 {
-    assert(i >= 0 && i < m_heap.size());
-    assert(j >= 0 && j < m_heap.size());
-    using std::swap;
-    swap(m_heap[i], m_heap[j]);
-    m_hash[m_heap[i].id] = i;
-    m_hash[m_heap[j].id] = j;
+    m_handler = handler;
+    m_ctx = ctx;
+    m_start = nowMS();
+    m_base = 0;
+    m_size = 0;
+    for(Slot& slot : m_root)
+        slot.head.prev = slot.head.next = &slot.head;
+    for(auto& level : m_levels)
+    {
+        for(Slot& slot : level)
+            slot.head.prev = slot.head.next = &slot.head;
+    }
+    for(uint64_t& bits : m_rootBits)
+        bits = 0;
 }
 
-//维护小根堆，把剩余时间小的节点上移
-void TimerManager::shiftup(size_t i)
+//单调时钟，粗粒度的版本不陷入内核，精度对连接超时足够
+int64_t TimerManager::nowMS()
 {
-    assert(i >= 0 && i < m_heap.size());
-    int j = (i - 1) / 2;
-    while(j >= 0)
-    {
-        if(m_heap[j] < m_heap[i])
-            break;
-        swapNode(i, j);
-        i = j;
-        j = (i - 1) / 2;
-    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
 }
 
-//向下调整，非递归实现
-bool TimerManager::shiftdown(size_t index, size_t n)
+void TimerManager::link(Slot& slot, TimerNode* node)
 {
-    assert(index >= 0 && index < m_heap.size());
-    assert(n >= 0 && n <= m_heap.size());
-    size_t i = index;
-    size_t j = i * 2 + 1;
-    while(j < n)
-    {
-        if(j + 1 < n && m_heap[j + 1] < m_heap[j])
-            j++;
-        if(m_heap[j] > m_heap[i])
-            break;
-        swapNode(i, j);
-        i = j;
-        j = i * 2 + 1;
-    }
-    return i > index;   //若true说明发生了向下调整
+    node->prev = slot.head.prev;
+    node->next = &slot.head;
+    slot.head.prev->next = node;
+    slot.head.prev = node;
+}
+
+void TimerManager::unlink(TimerNode* node)
+{
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = nullptr;
 }
 
-//删除堆元素：和最后一个节点交换，然后调整并移除
-void TimerManager::del(size_t i)
+//按离m_base的距离选择层，过期时间的对应位选择槽
+void TimerManager::insert(TimerNode* node)
 {
-    assert(!m_heap.empty() && i >= 0 && i < m_heap.size());
-    size_t n = m_heap.size();
-    if(i < n - 1)
+    int64_t expire = node->expire;
+    int64_t delta = expire - m_base;
+    if(delta < 0)
+    {
+        expire = m_base;
+    }
+    else if(delta > MAX_DELAY)
     {
-        swapNode(i, n - 1);
-        if(!shiftdown(i, n - 1))
+        expire = m_base + MAX_DELAY;
+        delta = MAX_DELAY;
+    }
+    if(delta < ROOT_SIZE)
+    {
+        int index = expire & (ROOT_SIZE - 1);
+        link(m_root[index], node);
+        m_rootBits[index / 64] |= 1ULL << (index % 64);
+        return;
+    }
+    for(int level = 0; level < LEVELS; level++)
+    {
+        int shift = ROOT_BITS + level * LEVEL_BITS;
+        if(delta < (1LL << (shift + LEVEL_BITS)) || level == LEVELS - 1)
         {
-            shiftup(i);
+            link(m_levels[level][(expire >> shift) & (LEVEL_SIZE - 1)], node);
+            return;
         }
     }
-    m_hash.erase(m_heap.back().id);
-    m_heap.pop_back();
 }
 
-//删除id节点，调用回调函数
-void TimerManager::work(int id)
+void TimerManager::addTimer(TimerNode* node, int timeout)
 {
-    if(m_heap.empty() || !m_hash.count(id))
-        return;
-    size_t i = m_hash[id];
-    m_heap[i].cb();
-    del(i);
+    assert(node);
+    if(node->linked())
+    {
+        unlink(node);
+        m_size--;
+    }
+    node->expire = nowMS() - m_start + timeout;
+    insert(node);
+    m_size++;
 }
 
-//更新计时器的过期时间
-void TimerManager::update(int id, int timeout)
+//只推迟过期时间，节点留在原来的槽里，到期时再按新的时间插入；节点已经不在时间轮里时忽略
+void TimerManager::update(TimerNode* node, int timeout)
 {
-    assert(!m_heap.empty() && m_hash.count(id));
-    size_t i = m_hash[id];
-    m_heap[i].expire = Clock::now() + MS(timeout);
-    shiftdown(i, m_heap.size());  //过期时间只会增大，向下调整即可
+    assert(node);
+    if(!node->linked())
+        return;
+    int64_t expire = nowMS() - m_start + timeout;
+    if(expire > node->expire)
+    {
+        node->expire = expire;
+    }
 }
 
-//弹出第一个元素
-void TimerManager::pop()
+void TimerManager::del(TimerNode* node)
 {
-    assert(!m_heap.empty());
-    del(0);
+    assert(node);
+    if(node->linked())
+    {
+        unlink(node);
+        m_size--;
+    }
 }
 
-void TimerManager::clear()
+//把上层一个槽里的节点放回更低的层
+void TimerManager::cascade(int level, int index)
 {
-    m_heap.clear();
-    m_hash.clear();
+    Slot& slot = m_levels[level][index];
+    TimerNode* node = slot.head.next;
+    slot.head.prev = slot.head.next = &slot.head;
+    while(node != &slot.head)
+    {
+        TimerNode* next = node->next;
+        insert(node);
+        node = next;
+    }
 }
 
-void TimerManager::addTimer(int id, int timeout, const TimeoutCallBack& cb)
+//处理第0层的一个槽：过期的调用回调，被update推迟的重新插入
+void TimerManager::runSlot(int index)
 {
-    assert(id >= 0);
-    size_t i;
-    if(m_hash.count(id))//已存在计时器堆里，更新过期时间和回调函数并调整堆
+    Slot& slot = m_root[index];
+    m_rootBits[index / 64] &= ~(1ULL << (index % 64));
+    //先把槽取下来，回调里可能删除或加入计时器
+    TimerNode pending;
+    if(slot.head.next == &slot.head)
+        return;
+    pending.next = slot.head.next;
+    pending.prev = slot.head.prev;
+    pending.next->prev = &pending;
+    pending.prev->next = &pending;
+    slot.head.prev = slot.head.next = &slot.head;
+    while(pending.next != &pending)
     {
-        i = m_hash[id];
-        m_heap[i].expire = Clock::now() + MS(timeout);
-        m_heap[i].cb = cb;
-        if(!shiftdown(i, m_heap.size()))
+        TimerNode* node = pending.next;
+        unlink(node);
+        if(node->expire > m_base)
         {
-            shiftup(i);
+            insert(node);
+            continue;
         }
+        m_size--;
+        if(m_handler)
+            m_handler(m_ctx, node->data);
     }
-    else    //计时器id不存在，在m_heap后面加入并调整
+}
+
+//第0层从index开始的下一个可能非空的槽，没有时返回ROOT_SIZE
+int TimerManager::nextRootSlot(int index) const
+{
+    for(int word = index / 64; word < ROOT_SIZE / 64; word++)
     {
-        i = m_heap.size();
-        m_hash[id] = i;
-        m_heap.emplace_back(id, Clock::now() + MS(timeout), cb);
-        shiftup(i);
+        uint64_t bits = m_rootBits[word];
+        if(word == index / 64)
+            bits &= ~0ULL << (index % 64);
+        if(bits)
+            return word * 64 + __builtin_ctzll(bits);
+    }
+    return ROOT_SIZE;
+}
+
+//推进到now，跳过空槽，每转一圈把上层对应的槽降下来
+void TimerManager::advance(int64_t now)
+{
+    while(m_base <= now)
+    {
+        int index = m_base & (ROOT_SIZE - 1);
+        if(index == 0)
+        {
+            for(int level = 0; level < LEVELS; level++)
+            {
+                int shift = ROOT_BITS + level * LEVEL_BITS;
+                int slot = (m_base >> shift) & (LEVEL_SIZE - 1);
+                cascade(level, slot);
+                if(slot != 0)
+                    break;
+            }
+        }
+        int next = nextRootSlot(index);
+        if(next != index)
+        {
+            //中间都是空槽，直接跳到下一个非空槽或者下一圈的开始
+            m_base = std::min(m_base + (next - index), now + 1);
+            continue;
+        }
+        runSlot(index);
+        m_base++;
     }
 }
 
-//淘汰已经超时的计时器
+//处理已经超时的计时器
 void TimerManager::handleExpiredEvent()
 {
-    if(m_heap.empty())
-        return;
-    while(!m_heap.empty())
+    if(m_size == 0)
     {
-        //小根堆堆顶
-        TimerNode node = m_heap.front();
-        //还没到过期时间
-        if(std::chrono::duration_cast<MS>(node.expire - Clock::now()).count() > 0)
-            break;
-        node.cb();
-        pop();          
+        //没有计时器时不用逐个槽推进
+        m_base = nowMS() - m_start + 1;
+        return;
     }
+    advance(nowMS() - m_start);
 }
 
-//下次过期还多久
+//下次过期还多久，时间轮只能给出下一个非空槽或者下一圈的时间，提前醒来没有影响
 int TimerManager::getNextHandle()
 {
     handleExpiredEvent();
-    size_t ret = -1;
-    if(!m_heap.empty())
+    if(m_size == 0)
+        return -1;
+    int index = m_base & (ROOT_SIZE - 1);
+    int next = nextRootSlot(index);
+    int64_t wake = m_base + (next - index);
+    int64_t ret = wake - (nowMS() - m_start);
+    return ret < 0 ? 0 : static_cast<int>(ret);
+}
+
+void TimerManager::clear()
+{
+    for(Slot& slot : m_root)
     {
-        ret = std::chrono::duration_cast<MS>(m_heap.front().expire - Clock::now()).count();
-        if(ret < 0)
-            ret = 0;
+        while(slot.head.next != &slot.head)
+            unlink(slot.head.next);
     }
-    return ret;    
+    for(auto& level : m_levels)
+    {
+        for(Slot& slot : level)
+        {
+            while(slot.head.next != &slot.head)
+                unlink(slot.head.next);
+        }
+    }
+    for(uint64_t& bits : m_rootBits)
+        bits = 0;
+    m_size = 0;
+}
+
+size_t TimerManager::size() const
+{
+    return m_size;
 }
@@ -1,58 +1,77 @@
 #pragma once
-#include<queue>
-#include<deque>
-#include<unordered_map>
-#include<ctime>
-#include<chrono>
-#include<functional>
-#include<memory>
+#include<stdint.h>
+#include<time.h>
 #include<assert.h>
-#include"../http/httpconnection.h"
-
-typedef std::function<void()> TimeoutCallBack;
-typedef std::chrono::high_resolution_clock Clock;
-typedef std::chrono::milliseconds MS;
-typedef Clock::time_point TimeStamp;
 
+//计时器节点，嵌入在使用者（HttpConnection）里，不单独申请内存
 struct TimerNode
 {
-    int id;
-    TimeStamp expire;
-    TimeoutCallBack cb;
-    
-    TimerNode(int i, TimeStamp e, TimeoutCallBack c) : id(i), expire(e), cb(c) {}
-    bool operator<(const TimerNode& rhs)
-    {
-        return expire < rhs.expire;
-    }
-    bool operator>(const TimerNode& rhs)
+    TimerNode* prev = nullptr;
+    TimerNode* next = nullptr;
+    int64_t expire = 0;     //过期时间，毫秒
+    void* data = nullptr;   //超时回调的参数
+
+    bool linked() const
     {
-        return expire > rhs.expire;
+        return prev != nullptr;
     }
 };
 
+//分层时间轮，精度1毫秒：第0层256个槽，之后三层各64个槽，最长约18小时
+//update只修改节点的过期时间，不移动节点；节点所在的槽到期时发现还没过期再重新插入
+//插入、更新、删除都是O(1)，不需要堆调整和哈希表
 class TimerManager
 {
 public:
-    TimerManager() {m_heap.reserve(64);}
+    //超时回调，ctx是构造时传入的参数，data是节点的参数
+    typedef void (*TimeoutHandler)(void* ctx, void* data);
+
+    TimerManager(TimeoutHandler handler = nullptr, void* ctx = nullptr);
     ~TimerManager() {clear();}
 
 public:
-    void addTimer(int id, int timeout, const TimeoutCallBack& cb);
+    //加入计时器，节点已经在时间轮里时重新设置过期时间
+    void addTimer(TimerNode* node, int timeout);
+    //推迟过期时间
+    void update(TimerNode* node, int timeout);
+    void del(TimerNode* node);
     void handleExpiredEvent();
+    //下次需要处理时间轮的时间，毫秒，没有计时器时返回-1
     int getNextHandle();
-
-    void update(int id, int timeout);
-    void work(int id);
-    void pop();
     void clear();
+    size_t size() const;
+
+    static int64_t nowMS();
 
 private:
-    void del(size_t i);
-    void shiftup(size_t i);
-    bool shiftdown(size_t index, size_t n);
-    void swapNode(size_t i, size_t j);
-
-    std::vector<TimerNode> m_heap;    //用vector维护小根堆i（为了随机存取）
-    std::unordered_map<int, size_t> m_hash;   //从计时器id到堆序号的哈希表
-};
\ No newline at end of file
+    static const int ROOT_BITS = 8;
+    static const int LEVEL_BITS = 6;
+    static const int ROOT_SIZE = 1 << ROOT_BITS;
+    static const int LEVEL_SIZE = 1 << LEVEL_BITS;
+    static const int LEVELS = 3;
+    static const int64_t MAX_DELAY = (1LL << (ROOT_BITS + LEVELS * LEVEL_BITS)) - 1;
+
+    //槽是带头节点的双向循环链表
+    struct Slot
+    {
+        TimerNode head;
+    };
+
+    void insert(TimerNode* node);
+    void advance(int64_t now);
+    void cascade(int level, int index);
+    void runSlot(int index);
+    int nextRootSlot(int index) const;
+    static void link(Slot& slot, TimerNode* node);
+    static void unlink(TimerNode* node);
+
+    TimeoutHandler m_handler;
+    void* m_ctx;
+    int64_t m_start;
+    int64_t m_base;     //下一个要处理的时刻，相对m_start
+    size_t m_size;
+
+    Slot m_root[ROOT_SIZE];
+    Slot m_levels[LEVELS][LEVEL_SIZE];
+    uint64_t m_rootBits[ROOT_SIZE / 64];     //第0层哪些槽非空，用于跳过空槽
+};
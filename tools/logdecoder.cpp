@@ -0,0 +1,287 @@
+//把二进制日志还原成和文本日志一样的行：时间 级别 内容
+//make logdecoder && ./logdecoder log/2024_01_01.blog log/2024_01_01-1.blog.gz [更多文件...]，不给文件时读标准输入
+//压缩过的段和没压缩的都能直接读
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<time.h>
+#include<unistd.h>
+#include<zlib.h>
+#include<string>
+#include<vector>
+#include"../log/logbinary.h"
+using namespace std;
+
+static const char* const LEVEL_TITLE[] = {"[debug]: ", "[info]:  ", "[warn]:  ", "[error]: "};
+
+struct Format
+{
+    int level;
+    string signature;
+    string format;
+};
+
+//解码时的一个参数
+struct Arg
+{
+    char tag;
+    uint64_t bits;
+    string str;
+};
+
+class Decoder
+{
+public:
+    //返回false表示遇到了坏的记录
+    bool decode(const string& data, FILE* out)
+    {
+        size_t pos = 0;
+        while(pos + LogBinary::HEADER_SIZE <= data.size())
+        {
+            uint16_t size, id;
+            int64_t timeNS;
+            memcpy(&size, &data[pos], 2);
+            memcpy(&id, &data[pos + 2], 2);
+            memcpy(&timeNS, &data[pos + 4], 8);
+            //没正常关闭的段末尾是预先分配的0
+            if(size == 0)
+                return true;
+            if(size < LogBinary::HEADER_SIZE || pos + size > data.size())
+            {
+                fprintf(stderr, "bad record at offset %zu\n", pos);
+                return false;
+            }
+            const char* body = &data[pos + LogBinary::HEADER_SIZE];
+            size_t len = size - LogBinary::HEADER_SIZE;
+            pos += size;
+
+            if(id == LogBinary::SESSION_ID)
+            {
+                m_formats.clear();
+            }
+            else if(id == LogBinary::FORMAT_ID)
+            {
+                if(!addFormat(body, len))
+                {
+                    fprintf(stderr, "bad format record at offset %zu\n", pos - size);
+                    return false;
+                }
+            }
+            else if(!writeLine(id, timeNS, body, len, out))
+            {
+                fprintf(stderr, "bad log record at offset %zu\n", pos - size);
+                return false;
+            }
+        }
+        if(pos != data.size())
+        {
+            fprintf(stderr, "truncated record at offset %zu\n", pos);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    bool addFormat(const char* body, size_t len)
+    {
+        if(len < 4)
+            return false;
+        uint16_t formatId;
+        memcpy(&formatId, body, 2);
+        uint8_t level = body[2];
+        uint8_t argc = body[3];
+        if(len < 4u + argc || formatId < LogBinary::FIRST_SITE_ID)
+            return false;
+        size_t index = formatId - LogBinary::FIRST_SITE_ID;
+        if(m_formats.size() <= index)
+            m_formats.resize(index + 1);
+        m_formats[index].level = level;
+        m_formats[index].signature.assign(body + 4, argc);
+        m_formats[index].format.assign(body + 4 + argc, len - 4 - argc);
+        return true;
+    }
+
+    //按格式里的类型取出参数
+    bool readArgs(const Format& f, const char* body, size_t len, vector<Arg>& args)
+    {
+        size_t pos = 0;
+        for(char tag : f.signature)
+        {
+            Arg arg = {tag, 0, ""};
+            size_t n = (tag == 'i' || tag == 'u') ? 4 : (tag == 's') ? 2 : 8;
+            if(pos + n > len)
+                return false;
+            if(tag == 's')
+            {
+                uint16_t slen;
+                memcpy(&slen, body + pos, 2);
+                pos += 2;
+                if(pos + slen > len)
+                    return false;
+                arg.str.assign(body + pos, slen);
+                pos += slen;
+            }
+            else if(n == 4)
+            {
+                uint32_t v;
+                memcpy(&v, body + pos, 4);
+                arg.bits = tag == 'i' ? static_cast<uint64_t>(static_cast<int64_t>(static_cast<int32_t>(v))) : v;
+                pos += 4;
+            }
+            else
+            {
+                memcpy(&arg.bits, body + pos, 8);
+                pos += 8;
+            }
+            args.push_back(arg);
+        }
+        return pos == len;
+    }
+
+    //把一个转换说明去掉长度修饰，按参数的类型重新加上，*替换成参数的值
+    void formatSpec(const string& spec, vector<Arg>& args, size_t& next, string& line)
+    {
+        char conv = spec.back();
+        string fmt;
+        for(size_t i = 0; i + 1 < spec.size(); i++)
+        {
+            char c = spec[i];
+            if(c == '*')
+            {
+                fmt += next < args.size() ? to_string(static_cast<int>(args[next].bits)) : "0";
+                next++;
+            }
+            else if(!strchr("hlLqjzt", c))
+            {
+                fmt += c;
+            }
+        }
+        if(next >= args.size())
+        {
+            line += "<missing>";
+            return;
+        }
+        Arg& arg = args[next++];
+        char buf[1024];
+        int n;
+        if(conv == 's')
+        {
+            fmt += 's';
+            n = snprintf(buf, sizeof(buf), fmt.c_str(), arg.str.c_str());
+        }
+        else if(conv == 'p')
+        {
+            fmt += 'p';
+            n = snprintf(buf, sizeof(buf), fmt.c_str(), reinterpret_cast<void*>(arg.bits));
+        }
+        else if(strchr("fFeEgGaA", conv))
+        {
+            double v;
+            memcpy(&v, &arg.bits, 8);
+            fmt += conv;
+            n = snprintf(buf, sizeof(buf), fmt.c_str(), v);
+        }
+        else if(conv == 'c')
+        {
+            fmt += 'c';
+            n = snprintf(buf, sizeof(buf), fmt.c_str(), static_cast<int>(arg.bits));
+        }
+        else
+        {
+            //4字节的参数按原来的宽度输出，%x之类的负数不会变成16个f
+            uint64_t v = arg.bits;
+            if(arg.tag == 'i' || arg.tag == 'u')
+                v = (conv == 'd' || conv == 'i') ? v : static_cast<uint32_t>(v);
+            fmt += "ll";
+            fmt += conv;
+            n = snprintf(buf, sizeof(buf), fmt.c_str(), static_cast<long long>(v));
+        }
+        if(n > 0)
+            line.append(buf, min(static_cast<size_t>(n), sizeof(buf) - 1));
+    }
+
+    bool writeLine(uint16_t id, int64_t timeNS, const char* body, size_t len, FILE* out)
+    {
+        size_t index = id - LogBinary::FIRST_SITE_ID;
+        if(index >= m_formats.size() || m_formats[index].format.empty())
+            return false;
+        const Format& f = m_formats[index];
+        vector<Arg> args;
+        if(!readArgs(f, body, len, args))
+            return false;
+
+        time_t sec = timeNS / 1000000000;
+        struct tm t;
+        localtime_r(&sec, &t);
+        char head[64];
+        snprintf(head, sizeof(head), "%d-%02d-%02d %02d:%02d:%02d.%06ld %s", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
+                 t.tm_hour, t.tm_min, t.tm_sec, static_cast<long>(timeNS % 1000000000 / 1000),
+                 LEVEL_TITLE[(f.level >= 0 && f.level <= 3) ? f.level : 1]);
+        string line = head;
+
+        const char* format = f.format.c_str();
+        size_t pos = 0, last = 0, next = 0;
+        LogBinary::Spec spec;
+        while(LogBinary::nextSpec(format, pos, spec))
+        {
+            appendText(format + last, spec.begin - last, line);
+            formatSpec(string(format + spec.begin, spec.end - spec.begin), args, next, line);
+            last = pos;
+        }
+        appendText(format + last, f.format.size() - last, line);
+        line += '\n';
+        fwrite(line.data(), 1, line.size(), out);
+        return true;
+    }
+
+    //格式里的普通文字，%%还原成%
+    void appendText(const char* text, size_t len, string& line)
+    {
+        for(size_t i = 0; i < len; i++)
+        {
+            line += text[i];
+            if(text[i] == '%' && i + 1 < len && text[i + 1] == '%')
+                i++;
+        }
+    }
+
+    vector<Format> m_formats;
+};
+
+//读出整个文件，gzip格式的自动解压
+bool readAll(gzFile gz, string& data)
+{
+    char buf[1 << 16];
+    int n;
+    while((n = gzread(gz, buf, sizeof(buf))) > 0)
+        data.append(buf, n);
+    bool ok = n == 0;
+    gzclose(gz);
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    Decoder decoder;
+    bool ok = true;
+    if(argc < 2)
+    {
+        string data;
+        ok = readAll(gzdopen(STDIN_FILENO, "rb"), data) && decoder.decode(data, stdout);
+    }
+    for(int i = 1; i < argc; i++)
+    {
+        gzFile gz = gzopen(argv[i], "rb");
+        if(!gz)
+        {
+            fprintf(stderr, "open %s error\n", argv[i]);
+            ok = false;
+            continue;
+        }
+        string data;
+        if(!readAll(gz, data))
+            fprintf(stderr, "read %s error\n", argv[i]);
+        ok = decoder.decode(data, stdout) && ok;
+    }
+    return ok ? 0 : 1;
+}